@@ -13,13 +13,16 @@
 
 #include <CompilerFrontend.h>
 #include <ast.h>
+#include <StringVisitor.h>
+#include <StadardLibrary.h>
 
 #include <QCoreApplication>
 #include <QFile>
 
 #include <iostream>
 
-// usage: <input.pas> <output.cpp>
+// usage: <input.pas> <output.cpp> [--native]
+// --native emits module for ScriptVM::loadNativeModule, build it as shared library.
 int main(int argc, char *argv[])
 {
 	QCoreApplication application( argc, argv );
@@ -33,8 +36,11 @@ int main(int argc, char *argv[])
 
 	QString pascalSource = QString::fromUtf8(input.readAll()), cSource;
 
+	const int flags = args.contains("--native") ? StringVisitor::fNativeModule : StringVisitor::fNone;
 	CompilerFrontend compiler;
-	if (!compiler.pascal2c(pascalSource, cSource))
+	if (flags & StringVisitor::fNativeModule) // ScriptVM binds standard library for module as for bytecode.
+		compiler.addFuncs(SciptRuntimeLibrary::allStandardProtoTypes());
+	if (!compiler.pascal2c(pascalSource, cSource, flags))
 	{
 		for (auto & message : compiler.messages()._messages)
 		{
@@ -46,6 +46,8 @@ OpcodeSequence CodeGenerator::compile(const AST::ast &val) \
 	return ret;\
 }
 
+const int CodeGenerator::_version = 1;
+
 CodeGenerator::CodeGenerator(AST::CodeMessages* errors, ScriptVM *executor)
 {
 	_errors = errors;
@@ -68,6 +70,21 @@ void CodeGenerator::clear()
 	_tab->clear();
 	_executor->clear();
 	_withObjects.clear();
+	_codeTypes.clear();
+	_lazyBodies.clear();
+	_calledFunctions.clear();
+	_calledBodies.clear();
+}
+
+OpcodeSequence CodeGenerator::compileCalledBodies(int &skipped)
+{
+	OpcodeSequence ret;
+	while (!_calledBodies.isEmpty())
+		ret << this->compileProcBody(_calledBodies.takeFirst());
+	skipped = _lazyBodies.size();
+	_lazyBodies.clear();
+	_calledFunctions.clear();
+	return ret;
 }
 
 // =============================== blocks =============================================
@@ -101,7 +118,7 @@ CodeBlockInfo CodeGenerator::processBlock(const AST::primary &val)
 	if (!ident) { Error(val, "Internal compiler error."); return result; }
 
 
-	AST::primary prim = val;
+	const AST::primary& prim = val;
 
 	QString objectName = ident->_ident.toLower();
 	if (_currentFunc && objectName == _currentFunc->getName()) objectName = "Result";
@@ -116,7 +133,7 @@ CodeBlockInfo CodeGenerator::processBlock(const AST::primary &val)
 	bool hasWith = false;
 	if (!current.findAny(objectName, MetaObj::ffAllGlobal)){
 
-		foreach (CodeBlockInfo withObj, _withObjects)
+		foreach (const CodeBlockInfo& withObj, _withObjects)
 		{  // in "with" context
 			current = withObj.obj;
 			current.doAccess();
@@ -178,12 +195,9 @@ CodeBlockInfo CodeGenerator::processBlock(const AST::primary &val)
 				err = true; break;
 			}
 			_tab->_lastFuncObj = current.funcObj;
-			AST::expr_list callArgs;
-			callArgs = call_expr->_args;
-			callArgs._loc = ident->_loc;
 			QString errText;
 			OpcodeSequence resultSequence;
-			if (!emitCall(current.funcObj, callArgs, errText, ret,resultSequence))
+			if (!emitCall(current.funcObj, call_expr->_args, ident->_loc, errText, ret,resultSequence))
 			{
 				if (errText.size())
 				{
@@ -276,8 +290,8 @@ CodeBlockInfo CodeGenerator::processBlock(const AST::primary &val)
 
 	result.type = current.type();
 	result.obj = current;
-	result.code << resultsSequence;
-	result.code << ret;
+	result.code << std::move(resultsSequence);
+	result.code << std::move(ret);
 	result.code.optimize();
 	_codeTypes[val._loc] = result.type;
 	return result;
@@ -326,7 +340,8 @@ OpcodeSequence CodeGenerator::compile(const AST::primary &val)
 }
 
 bool CodeGenerator::emitCall(FuncObj *function,
-							 AST::expr_list &callArgs,
+							 const AST::expr_list &callArgs,
+							 const AST::CodeLocation &callLoc,
 							 QString &prim,
 							 OpcodeSequence &mainSequence,
 							 OpcodeSequence &resultSequence)
@@ -340,28 +355,26 @@ bool CodeGenerator::emitCall(FuncObj *function,
 		prim= QString("Passed %1 parameters, expected %2.").arg(argsSize).arg(signatureSize);
 		return false;
 	}
-	resultSequence.setLocVal(callArgs);
+	resultSequence.setLoc(callLoc._file, callLoc._line, callLoc._col);
 	resultSequence.setScope(_tab->getCurrentScope());
 
 	// allocating result on stack
 	foreach (auto typeCnt, function->getType()._type->getSignature())
 		resultSequence.EmitPush(typeCnt.first, typeCnt.second);
 
-	QList<AST::expr> realPassed;
+	QList<const AST::expr*> realPassed; // arguments are compiled in place, no subtree copies.
 	QList<int> realPassedDeref;
 	QHash<QString, int> name2index;
 
 	QList<FuncObj::FunctionArg> visibleArguments;
 	foreach (const FuncObj::FunctionArg &arg, function->getArguments())
 	{
-		AST::expr t;
-		if (arg._initializer.get()) t = *arg._initializer;
 		if (arg._name.toLower() == "self")
 			continue;
 
 		visibleArguments << arg;
 		name2index[arg._name.toLower()] = realPassed.size();
-		realPassed << t;
+		realPassed << arg._initializer.get();
 		realPassedDeref << 0;
 	}
 	for (int callArgsIndex = 0; callArgsIndex < argsSize; ++callArgsIndex)
@@ -383,7 +396,7 @@ bool CodeGenerator::emitCall(FuncObj *function,
 			 return false;
 		}
 
-		realPassed[realPassedIndex] = arg;
+		realPassed[realPassedIndex] = &arg;
 
 		RefType sigType = visibleArguments[realPassedIndex]._type;
 		bool sizeCheck = false;
@@ -419,30 +432,45 @@ bool CodeGenerator::emitCall(FuncObj *function,
 	}
 	for (int i = 0; i < realPassed.size(); ++i)
 	{
-		if (realPassed[i]._expr.which() == 0)
+		if (!realPassed[i] || realPassed[i]->_expr.which() == 0)
 		{
 			 prim = QString("Undefined parameter: %1").arg(visibleArguments[i]._name);
 			 return false;
 		}
-		mainSequence << this->compile(realPassed[i]);
+		mainSequence << this->compile(*realPassed[i]);
 		if (realPassedDeref[i])
 			mainSequence.Emit(BytecodeVM::DEREF, realPassedDeref[i]);
 	}
-	mainSequence.setLoc(callArgs._loc._file,
-						callArgs._loc._line,
-						callArgs._loc._col);
-	BytecodeVM &callOpCode =  mainSequence.Emit(r);
+	mainSequence.setLoc(callLoc._file,
+						callLoc._line,
+						callLoc._col);
+	CompilerOpcode &callOpCode =  mainSequence.Emit(r);
 	callOpCode.values.resize(4);
 	callOpCode.values[0].setValue( 0, ScriptVariant::T_AUTO);
 	callOpCode.values[1].setValue( function->callSize() , ScriptVariant::T_AUTO);
 	callOpCode.values[2].setValue( function->returnSize(), ScriptVariant::T_AUTO);
 	callOpCode.values[3].setValue( function->getScopeLevel(), ScriptVariant::T_AUTO);
 	callOpCode.gotoLabel = function->getFullName().toStdString();
+	if (_parserOptions & poLazyBodies)
+	{
+		_calledFunctions << function;
+		if (_lazyBodies.contains(function))
+			_calledBodies << _lazyBodies.take(function);
+	}
 
 	return true;
 } // CodeGenerator::emitCall
 
 
+void CodeGenerator::emitConstants(OpcodeSequence &sequence, std::vector<ScriptVariant> &constants)
+{
+	if (constants.size() == 1)
+		sequence.EmitPush(constants[0]);
+	else if (constants.size() > 1)
+		sequence.Emit(BytecodeVM::PUSHC, _executor->addConstants(constants), int(constants.size()));
+	constants.clear();
+}
+
 AST::expr_list CodeGenerator::flatExprList(const AST::expr &expr)
 {
 	AST::expr_list ret;
@@ -489,8 +517,8 @@ OpcodeSequence CodeGenerator::compile(const AST::binary &val)
 	OpcodeSequence ret;
 	ret.setLocVal(val);
 	ret.setScope(_tab->getCurrentScope());
-	ret << left;
-	ret << right;
+	ret << std::move(left);
+	ret << std::move(right);
 	BytecodeVM::BinOp sourceOp =  val._op;
 	int flags = BytecodeVM::bNo;
 	if (sourceOp == BytecodeVM::EQ || sourceOp == BytecodeVM::NE)
@@ -599,7 +627,7 @@ OpcodeSequence CodeGenerator::compile(const AST::internalexpr &val)
 		{
 			OpcodeSequence rightPart =  this->compile(val._expr_list);
 			rightPart[0].values[3] = (ScriptVariant(true)); //TODO: wtf magic numbers...
-			ret << rightPart;
+			ret << std::move(rightPart);
 			int pointedSize = typeRef._type->_child[0]->getByteSize();
 			if (val._type == AST::internalexpr::tDec)
 				pointedSize = -pointedSize;
@@ -723,8 +751,8 @@ OpcodeSequence CodeGenerator::compile(const AST::assignmentst &val)
 		return ret;
 	}
 
-	ret << left;
-	ret << right;
+	ret << std::move(left);
+	ret << std::move(right);
 
 	int flags = BytecodeVM::mNo;
 	if (typeLeft._isRef)  flags |= BytecodeVM::mLeftIsRef;
@@ -752,75 +780,71 @@ OpcodeSequence CodeGenerator::compile(const AST::switchst &val)
 
 	OpcodeSequence elsePart = this->compile(val._else);
 
-	QList<OpcodeSequence> caseBlocks;
-	int totalSize = 0;
-
+	std::vector<size_t> jumpsToEnd;
 	foreach (const AST::case_list_elem& case_list_elem, val._case_list)
 	{
-		OpcodeSequence cmpAndBody;
-		cmpAndBody.setLocVal(case_list_elem);
-		cmpAndBody.setScope(_tab->getCurrentScope());
 		OpcodeSequence body =this->compile(case_list_elem._statement);
 
+		ret.setLocVal(case_list_elem);
 		bool isFirst = true;
 		foreach (const AST::expr& expr, case_list_elem._expr_list._exprs)
 		{
-			OpcodeSequence cmp = this->compile(expr);
-			cmpAndBody << swVariable;
-			cmpAndBody << cmp;
-			cmpAndBody.Emit(BytecodeVM::CMPS,
+			ret << swVariable;
+			ret << this->compile(expr);
+			ret.Emit(BytecodeVM::CMPS,
 							(int)0/* TODO: variable in switch could be REF.*/,
 							(int)varType._type->getByteSize());
 			if (!isFirst)
-				cmpAndBody.Emit(BytecodeVM::BINOP, (int)BytecodeVM::OR, (int)varType._type->_opcodeType, (int)0);
+				ret.Emit(BytecodeVM::BINOP, (int)BytecodeVM::OR, (int)varType._type->_opcodeType, (int)0);
 
 			isFirst = false;
 		}
-		cmpAndBody.Emit(BytecodeVM::FJMP, (int)(body.size() + 2));
-		cmpAndBody << body;
-		totalSize += cmpAndBody.size() + 1;//JMP to end;
-
-		caseBlocks << cmpAndBody;
+		const size_t skipBody = ret.EmitForwardJump(BytecodeVM::FJMP);
+		ret << std::move(body);
+		ret.setLocVal(val);
+		jumpsToEnd.push_back(ret.EmitForwardJump(BytecodeVM::JMP));
+		ret.PatchJump(skipBody);
 	}
-	totalSize += elsePart.size();
-	foreach (const OpcodeSequence& info, caseBlocks)
-	{
-		ret << info;
-		ret.Emit(BytecodeVM::JMP, (int)(totalSize - ret.size()));
-	}
-	ret << elsePart;
+	ret << std::move(elsePart);
+	for (size_t jump : jumpsToEnd)
+		ret.PatchJump(jump);
 	return ret;
 }
 
 OpcodeSequence CodeGenerator::compile(const AST::ifst &val)
 {
 	OpcodeSequence ret;
-	RefType exprType = _types->typeInference(val._expr);
-	if (!exprType._type->isScalar())
+	// "else if" chain is emitted into one sequence, so code of nested branches is not moved at every level.
+	std::vector<size_t> jumpsToEnd;
+	for (const AST::ifst* branch = &val; branch; )
 	{
-		Error(val, "condition should be scalar.");
-		return ret;
-	}
-
-	OpcodeSequence ifbranch = this->compile(val._if);
-	OpcodeSequence elsebranch;
-	bool hasElse = val._else._statement.which();
-	if (hasElse)
-		elsebranch = this->compile(val._else);
-
-	ifbranch.setLocVal(val._if);
-	ifbranch.setScope(_tab->getCurrentScope());
-	elsebranch.setLocVal(val._else);
-	elsebranch.setScope(_tab->getCurrentScope());
-
-	ifbranch.Prepend(BytecodeVM::FJMP, ifbranch.size() + 1 + hasElse);
-	if (hasElse)
-		elsebranch.Prepend(BytecodeVM::JMP, elsebranch.size() + 1);
+		RefType exprType = _types->typeInference(branch->_expr);
+		if (!exprType._type->isScalar())
+		{
+			Error(*branch, "condition should be scalar.");
+			break;
+		}
 
-	ret << this->compile(val._expr);
-	ret << ifbranch;
-	if (hasElse)
-		ret << elsebranch;
+		ret << this->compile(branch->_expr);
+		ret.setScope(_tab->getCurrentScope());
+		ret.setLocVal(branch->_if);
+		const size_t skipIf = ret.EmitForwardJump(BytecodeVM::FJMP);
+		ret << this->compile(branch->_if);
+		if (!branch->_else._statement.which())
+		{
+			ret.PatchJump(skipIf);
+			break;
+		}
+		ret.setLocVal(branch->_else);
+		jumpsToEnd.push_back(ret.EmitForwardJump(BytecodeVM::JMP));
+		ret.PatchJump(skipIf);
+		const AST::ifst* elseIf = boost::get<AST::ifst>(&branch->_else._statement);
+		if (!elseIf)
+			ret << this->compile(branch->_else);
+		branch = elseIf;
+	}
+	for (size_t jump : jumpsToEnd)
+		ret.PatchJump(jump);
 	return ret;
 }
 
@@ -873,23 +897,25 @@ OpcodeSequence CodeGenerator::compile(const AST::forst &val)
 	OpcodeSequence checkCondition = this->compile(compare);
 
 	OpcodeSequence modifier;
-	modifier << getIdentVal;
+	modifier << std::move(getIdentVal);
 	modifier.Emit(BytecodeVM::UNOP, int(val._downto ? BytecodeVM::UDEC : BytecodeVM::UINC), int(ScriptVariant::T_int32_t) );
 
 	ret << this->compile(ass);// for i := 0
-	ret << checkCondition;
+	const size_t loopStart = ret.size();
+	ret << std::move(checkCondition);
 
 	OpcodeSequence body = this->compile(val._statement);
-	body << modifier;
+	const size_t continueOffset = body.size();
+	body << std::move(modifier);
 	body.ReplaceBreak(body.size() + 2);
-	body.ReplaceContinue(body.size() - modifier.size());
-
-	ret.Emit(BytecodeVM::FJMP, body.size() + 3);
+	body.ReplaceContinue(continueOffset);
 
-	ret << body;
+	const size_t exitLoop = ret.EmitForwardJump(BytecodeVM::FJMP);
+	ret << std::move(body);
 
 	ret.Emit(BytecodeVM::POP, int(1)); //TODO: expr could be more than sizeof==1 !
-	ret.Emit(BytecodeVM::JMP, -int(body.size() + checkCondition.size() + 2));
+	ret.EmitJumpTo(BytecodeVM::JMP, loopStart);
+	ret.PatchJump(exitLoop);
 
 	return ret;
 }
@@ -906,13 +932,14 @@ OpcodeSequence CodeGenerator::compile(const AST::whilest &val)
 	 OpcodeSequence ret;
 	 ret.setLocVal(val);
 	 ret.setScope(_tab->getCurrentScope());
-	 ret << checkCondition;
+	 ret << std::move(checkCondition);
 
-	 ret.Emit(BytecodeVM::FJMP, body.size() + 2);
+	 const size_t exitLoop = ret.EmitForwardJump(BytecodeVM::FJMP);
 
-	 ret << body;
+	 ret << std::move(body);
 
-	 ret.Emit(BytecodeVM::JMP, -int(body.size() + checkCondition.size() + 1));
+	 ret.EmitJumpTo(BytecodeVM::JMP, 0);
+	 ret.PatchJump(exitLoop);
 
 	 return ret;
 }
@@ -930,16 +957,63 @@ OpcodeSequence CodeGenerator::compile(const AST::repeatst &val)
 	ret.setLocVal(val);
 	ret.setScope(_tab->getCurrentScope());
 
-	ret << body;
-	ret << checkCondition;
+	ret << std::move(body);
+	ret << std::move(checkCondition);
 
-	ret.Emit(BytecodeVM::FJMP, -int(body.size() + checkCondition.size() ));
+	ret.EmitJumpTo(BytecodeVM::FJMP, 0);
 
 	return ret;
 }
 
+// New(p) and Dispose(p), unless script declares functions with these names.
+bool CodeGenerator::compileHeapCall(const AST::primary &val, OpcodeSequence &ret)
+{
+	const AST::ident * ident = boost::get<AST::ident>(&val._expr);
+	if (!ident || val._accessors.size() != 1) return false;
+	const AST::call_expr * call_expr = boost::get<AST::call_expr>(&val._accessors[0]._primary_accessor);
+	const QString name = ident->_ident.toLower();
+	if (!call_expr || (name != "new" && name != "dispose")) return false;
+
+	MetaObj current(_tab);
+	current.setClassObj(_types->_currentClass);
+	current.funcObj = _currentFunc;
+	if (current.findAny(name, MetaObj::ffAllGlobal)) return false;
+
+	ret.setLocVal(val);
+	ret.setScope(_tab->getCurrentScope());
+	if (call_expr->_args._exprs.size() != 1)
+	{
+		Error(*ident, QString("%1 expects one pointer variable.").arg(ident->_ident));
+		return true;
+	}
+	const AST::expr& arg = call_expr->_args._exprs[0];
+	RefType typeRef = _types->typeInference(arg);
+	if (!typeRef._type->isPointer() || !typeRef._isRef)
+	{
+		Error(arg, QString("%1 expects one pointer variable.").arg(ident->_ident));
+		return true;
+	}
+	ret << this->compile(arg);
+	if (name == "new")
+	{
+		PTypeDef pointed = typeRef._type->_child[0];
+		foreach (auto typeCnt, pointed->getSignature())
+			ret.EmitPush(typeCnt.first, typeCnt.second);
+		ret.Emit(BytecodeVM::ALLOC, pointed->getByteSize());
+	}
+	else
+	{
+		ret.Emit(BytecodeVM::FREE);
+	}
+	return true;
+}
+
 OpcodeSequence CodeGenerator::compile(const AST::procst &val)
 {
+	OpcodeSequence heapCall;
+	if (compileHeapCall(val._primary, heapCall))
+		return heapCall;
+
 	CodeBlockInfo info = processBlock(val._primary);
 	int size = 0;
 	if (info.type.isValid())
@@ -1024,8 +1098,8 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::decl_part_list &val)
 	foreach (const AST::decl_part &d, val._parts)
 	{
 		DeclarationAndInit part = this->compileDecl(d);
-		ret.decl << part.decl;
-		ret.init << part.init;
+		ret.decl << std::move(part.decl);
+		ret.init << std::move(part.init);
 	}
 	return ret;
 }
@@ -1052,7 +1126,7 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::const_def_part &val)
 			type = _types->typeInference(const_def._initializer);// try to inference type from expr.
 
 		OpcodeSequence ini = this->compile(const_def._initializer);
-		ret.init << ini;
+		ret.init << std::move(ini);
 		VarObj* varObj = _tab->createNewRegularVarObj(const_def._ident._ident, type._type, true);
 
 		if (!varObj)
@@ -1073,7 +1147,7 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::type_def_part &val)
 		_types->_typeNamesStack.push_back(typeName);
 		_types->_classBuffer.clear();
 		RefType t = _types->typeInference(type_def._type);
-		ret.decl << _types->_classBuffer;
+		ret.decl << std::move(_types->_classBuffer);
 		_types->_classBuffer.clear();
 		_types->_typeNamesStack.pop_back();
 		if (!_tab->setNameForType(t._type, typeName ))
@@ -1088,8 +1162,8 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::var_decl_part &val)
 	foreach (const AST::var_decl &decl,  val._var_decls)
 	{
 		 DeclarationAndInit part = this->compileDecl(decl);
-		 ret.decl << part.decl;
-		 ret.init << part.init;
+		 ret.decl << std::move(part.decl);
+		 ret.init << std::move(part.init);
 	}
 	return ret;
 }
@@ -1097,10 +1171,23 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::var_decl_part &val)
 DeclarationAndInit CodeGenerator::compileDecl(const AST::proc_def &val)
 {
 	DeclarationAndInit ret;
-	OpcodeSequence resultOpcodes;
-	resultOpcodes.setLocVal(val);
-	resultOpcodes.setScope(_tab->getCurrentScope());
-	SymTable::FunctionRec fun;
+	ProcDeclaration decl;
+	if (!declareProc(val, decl) || val._isForward)
+		return ret;
+	// body goes to own sequence; calls are resolved by labels at link, so it may be placed anywhere.
+	if (!(_parserOptions & poLazyBodies))
+		ret.decl = this->compileProcBody(decl);
+	else if (_calledFunctions.contains(decl.func))
+		_calledBodies << decl;
+	else
+		_lazyBodies[decl.func] = decl;
+	return ret;
+}
+
+bool CodeGenerator::declareProc(const AST::proc_def &val, ProcDeclaration &decl)
+{
+	decl.def = &val;
+	SymTable::FunctionRec &fun = decl.fun;
 	fun._name = val._proc_decl._ident._ident;
 	if (val._proc_decl._flags & AST::proc_decl::IsFunction)
 		fun._type = _types->typeInference( val._proc_decl._type )._type;
@@ -1112,7 +1199,7 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::proc_def &val)
 		arg._ref = true;
 		if (!val._proc_decl._class._ident.isEmpty())
 			arg._type = RefType(_tab->findType(val._proc_decl._class._ident));
-		else throw std::runtime_error("CodeGenerator::compileDecl(const AST::proc_def&): "
+		else throw std::runtime_error("CodeGenerator::declareProc(const AST::proc_def&): "
 									 "impossible state.");
 		arg._type._isRef = true;
 		fun._args << arg;
@@ -1137,57 +1224,66 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::proc_def &val)
 	}
 
 	QString ownerClassName = val._proc_decl._class._ident;
-	_types->_currentClass = nullptr;
 	if (!ownerClassName.isEmpty())
 	{
-		_types->_currentClass = _tab->findClass(ownerClassName);
-		if (!_types->_currentClass)
+		decl.ownerClass = _tab->findClass(ownerClassName);
+		if (!decl.ownerClass)
 			Error(val, "Class does not exist: " + ownerClassName);
 	}
 	// simple function, not a method:
 
-	FuncObj *funcObj = _tab->createNewMethodObj(_types->_currentClass,
-												fun,
-												val._isForward,
-												false,
-												false);
+	decl.func = _tab->createNewMethodObj(decl.ownerClass,
+										 fun,
+										 val._isForward,
+										 false,
+										 false);
 
-	if (!funcObj)
+	if (!decl.func)
 	{
 		Error(val, "Function exists:" + fun._name);
-		return ret;
+		return false;
 	}
-	_currentFunc = funcObj;
-	if (!val._isForward)
-	{
-		_tab->openScope(funcObj->getInternalScope());
-		resultOpcodes.setScope(_tab->getCurrentScope());
-		resultOpcodes.setLocVal(val._block._compoundst);
+	if (_parserOptions & poLazyBodies)
+		decl.visibility = _tab->getVisibility(decl.func->getInternalScope()->getParent());
+	return true;
+}
+
+OpcodeSequence CodeGenerator::compileProcBody(const ProcDeclaration &decl)
+{
+	const AST::proc_def &val = *decl.def;
+	ClassObj* outerClass = _types->_currentClass;
+	FuncObj* outerFunc = _currentFunc;
+	_types->_currentClass = decl.ownerClass;
+	_currentFunc = decl.func;
+	const SymTable::Visibility outerVisibility = _tab->setVisibility(decl.visibility);
 
-		if (val._proc_decl._flags & AST::proc_decl::IsFunction)
-			_tab->createNewRegularVarObj("Result", fun._type);
+	OpcodeSequence resultOpcodes;
+	_tab->openScope(decl.func->getInternalScope());
+	resultOpcodes.setScope(_tab->getCurrentScope());
+	resultOpcodes.setLocVal(val._block._compoundst);
 
-		foreach (const  FuncObj::FunctionArg& arg, fun._args)
-			_tab->createNewRegularVarObj(arg._name, arg._type);
+	if (val._proc_decl._flags & AST::proc_decl::IsFunction)
+		_tab->createNewRegularVarObj("Result", decl.fun._type);
 
-		DeclarationAndInit di = this->compileDecl(val._block._decl_part_list);
-		resultOpcodes << di.decl;
-		resultOpcodes << di.init;
+	foreach (const  FuncObj::FunctionArg& arg, decl.fun._args)
+		_tab->createNewRegularVarObj(arg._name, arg._type);
 
-		resultOpcodes << this->compile(val._block._compoundst);
+	DeclarationAndInit di = this->compileDecl(val._block._decl_part_list);
+	resultOpcodes << std::move(di.init);
 
-		_tab->closeScope();
+	resultOpcodes << this->compile(val._block._compoundst);
 
-		resultOpcodes.Emit(BytecodeVM::RET);
+	_tab->closeScope();
 
-	}
-	_types->_currentClass = nullptr;
-	_currentFunc = nullptr;
-	if (resultOpcodes.size())
-		 resultOpcodes[0].symbolLabel = funcObj->getFullName().toStdString();
+	resultOpcodes.Emit(BytecodeVM::RET);
 
-	ret.decl = resultOpcodes;
-	return ret;
+	_tab->setVisibility(outerVisibility);
+	_types->_currentClass = outerClass;
+	_currentFunc = outerFunc;
+	resultOpcodes[0].symbolLabel = decl.func->getFullName().toStdString();
+	// nested procedures are entered only by CALL, so they follow RET like procedures of program follow __start.
+	resultOpcodes << std::move(di.decl);
+	return resultOpcodes;
 }
 DeclarationAndInit CodeGenerator::compileDecl(const AST::unit_spec &val)
 {
@@ -1227,18 +1323,25 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::var_decl &val)
 		else
 		{
 			AST::expr_list flatList = this->flatExprList(val._initializer);
+			std::vector<ScriptVariant> constants; // compile-time values, pushed from constant pool by one PUSHC.
 			int i=-1;
 			foreach (ScriptVariant::Types t, type._type->getExpandedSignature())
 			{
 				i++;
+				ScriptVariant val1;
 				if ( i >= flatList._exprs.size())
 				{
-					ScriptVariant val1;
 					val1.setValue(0, t);
-					init.EmitPush(val1);
+					constants.push_back(val1);
+				}
+				else if (ExpressionEvaluator().getOpValue(flatList._exprs[i], val1))
+				{
+					val1.setType(t); // same as CVRT.
+					constants.push_back(val1);
 				}
 				else
 				{
+					emitConstants(init, constants);
 					const AST::expr& initExpr = flatList._exprs[i];
 					RefType type = _types->typeInference(initExpr) ;
 					init << this->compile(initExpr);
@@ -1247,6 +1350,7 @@ DeclarationAndInit CodeGenerator::compileDecl(const AST::var_decl &val)
 
 				}
 			}
+			emitConstants(init, constants);
 		}
 
 		if (_tab->findObj(ident._ident))
@@ -1326,22 +1430,22 @@ OpcodeSequence CodeGenerator::compile(const AST::stProgram &val)
 	OpcodeSequence ret;
 
 	DeclarationAndInit decls = this->compileDecl(val._decl_part_list);
-	ret << decls.decl;
+	ret << std::move(decls.decl);
 
 
 	if (val._hasProgram)
 	{
 		DeclarationAndInit declsBody =this->compileDecl(val._program);
 		OpcodeSequence body;
-		body << decls.init;
-		body << declsBody.decl;
-		body << declsBody.init;
+		body << std::move(decls.init);
+		body << std::move(declsBody.decl);
+		body << std::move(declsBody.init);
 		if (body.size() )
 		{
 			body[0].symbolLabel = "__start";
 			_startAddress = "__start";
 		}
-		ret << body;
+		ret << std::move(body);
 	}
 	return ret;
 }
@@ -1363,16 +1467,16 @@ OpcodeSequence CodeGenerator::compile(const AST::block &val)
 	OpcodeSequence ret;
 	_tab->openScope();
 	DeclarationAndInit decls =  this->compileDecl(val._decl_part_list);
-	ret << decls.decl;
+	ret << std::move(decls.decl);
 	OpcodeSequence body;
-	body << decls.init;
+	body << std::move(decls.init);
 	body << this->compile(val._compoundst);
 	if (body.size() && is_top)
 	{
 		body[0].symbolLabel = "__start";
 		_startAddress = "__start";
 	}
-	ret << body;
+	ret << std::move(body);
 
 	_tab->closeScope();
 	return ret;
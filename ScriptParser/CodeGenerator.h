@@ -21,6 +21,8 @@
 #include <BytecodeVM.h>
 #include <ScriptVM.h>
 
+#include <QHash>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 
@@ -53,13 +55,18 @@ public:
 	SymTable   *_tab;
 	AST::CodeMessages* _errors;
 	QString _startAddress;
-	enum ParserOptions {poNone = 0, poForbidExternal = 1 << 0 };
+	enum ParserOptions {poNone = 0, poForbidExternal = 1 << 0, poLazyBodies = 1 << 1 };
 	int _parserOptions;
+	/// Increment when generated bytecode changes for same source: compiled programs cached by CompilerFrontend are not reused.
+	static const int _version;
 
 	CodeGenerator(AST::CodeMessages* errors, ScriptVM* executor) ;
 	~CodeGenerator() ;
 
 	void clear();
+	/// With poLazyBodies: bodies of procedures called by compiled code, including calls from these bodies.
+	/// Other deferred bodies are dropped, their count is returned in skipped.
+	OpcodeSequence compileCalledBodies(int &skipped);
 
 	// Code generation
 
@@ -133,11 +140,32 @@ private:
 	OpcodeSequence mkLogicalSeq(const AST::internalexpr &val, const OpcodeSequence &opers);
 	OpcodeSequence mkLogicalSeq2(const AST::internalexpr &val, int op, int type);
 	bool emitCall(FuncObj *function,
-				  AST::expr_list &callArgs,
+				  const AST::expr_list &callArgs,
+				  const AST::CodeLocation &callLoc,
 				  QString &prim,
 				  OpcodeSequence &mainSequence, OpcodeSequence &resultSequence);
 
 	AST::expr_list flatExprList(const AST::expr &expr);
+	/// Pushes and clears collected initializer values; long runs go to constant pool.
+	void emitConstants(OpcodeSequence &sequence, std::vector<ScriptVariant> &constants);
+	bool compileHeapCall(const AST::primary &val, OpcodeSequence &ret);
+
+	/// Procedure registered in SymTable by declareProc, body is generated by compileProcBody.
+	struct ProcDeclaration {
+		const AST::proc_def* def = nullptr;
+		FuncObj* func = nullptr;
+		ClassObj* ownerClass = nullptr;
+		SymTable::FunctionRec fun;
+		SymTable::Visibility visibility; //!< poLazyBodies: names declared before procedure, body compiled later sees only them.
+	};
+	/// Resolves signature and owner class, creates FuncObj. Returns false on error.
+	bool declareProc(const AST::proc_def &val, ProcDeclaration &decl);
+	/// Code of declared procedure: local declarations, body and RET; first opcode is labeled with full name.
+	OpcodeSequence compileProcBody(const ProcDeclaration &decl);
+
+	QHash<FuncObj*, ProcDeclaration> _lazyBodies;  //!< poLazyBodies: declared, not called yet.
+	QSet<FuncObj*> _calledFunctions;
+	QList<ProcDeclaration> _calledBodies;          //!< called, waiting for compileCalledBodies().
 
 
 };
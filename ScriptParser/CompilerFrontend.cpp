@@ -23,13 +23,24 @@
 #include <ByteOrderStream.h>
 #include <StadardLibrary.h>
 #include <ScriptVM.h>
+#include <ExpressionProgram.h>
 
 #include <QString>
 #include <QDebug>
-
+#include <QDir>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QProcess>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 struct CompilerFrontendPrivate
 {
@@ -52,14 +63,117 @@ struct CompilerFrontendPrivate
 	ScriptVM* _vm;
 
 	QHash<QString, QString> _defines;
+	QString _cacheDirectory;
+
+	struct LibraryAst {
+		int file = 0;
+		AST::pascalSource ast;
+	};
+	QHash<QString, LibraryAst> _libraryAst; //!< parsed libraries of last call by preprocessed text.
 
 	AST::CodeMessages _messages;
+	CompilerFrontend::CompileStats _compileStats;
 	int _debugFlags;
 	int _executeLimit;
 	CompilerFrontend::Semantic _semantic;
 };
 
 using namespace PascalLike;
+
+namespace {
+
+struct ParsedSource
+{
+	AST::pascalSource ast;
+	AST::CodeMessages messages;
+};
+
+/// Parses parts of sources on worker threads, each part with own scanner and parser, results are in parsed[part].
+void parseSources(const QStringList& sources, const std::vector<int>& parts, bool stSemantic, std::vector<ParsedSource>& parsed)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t k = next++; k < parts.size(); k = next++)
+		{
+			const int part = parts[k];
+			ParsedSource& result = parsed[part];
+			result.messages.clear();
+			Scanner scanner;
+			Parser parser(&scanner, &result.messages);
+			parser._StSemantic = stSemantic;
+			parser._currentFile = part;
+			scanner._buf = sources.at(part).toStdWString();
+			scanner.ReInit();
+			parser.Parse();
+			result.ast = std::move(parser._pascal);
+		}
+	};
+	const size_t threads = std::min<size_t>(parts.size(), std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::future<void>> workers;
+	for (size_t i = 1; i < threads; i++)
+		workers.push_back(std::async(std::launch::async, worker));
+	worker();
+	for (std::future<void>& w : workers)
+		w.get();
+}
+
+/// C type of scalar passed through PascalNativeAbi, empty if type can not be passed to native module.
+QString nativeCType(const SymTable* tab, const QString& typeName)
+{
+	PTypeDef type = tab->findType(typeName);
+	if (type->_category != TypeDef::Scalar)
+		return QString();
+	switch (type->_opcodeType)
+	{
+		case ScriptVariant::T_bool:     return "bool";
+		case ScriptVariant::T_float32:  return "float";
+		case ScriptVariant::T_float64:  return "double";
+		case ScriptVariant::T_int8_t:   return "int8_t";
+		case ScriptVariant::T_uint8_t:  return "uint8_t";
+		case ScriptVariant::T_int16_t:  return "int16_t";
+		case ScriptVariant::T_uint16_t: return "uint16_t";
+		case ScriptVariant::T_int32_t:  return "int32_t";
+		case ScriptVariant::T_uint32_t: return "uint32_t";
+		case ScriptVariant::T_int64_t:  return "int64_t";
+		case ScriptVariant::T_uint64_t: return "uint64_t";
+		default:                        return QString();
+	}
+}
+
+/// Standard library functions implemented in native module: result type and expression of arguments a0..aN.
+/// Must give same values as ScriptRuntime/StadardLibrary.cpp, other standard functions are called through host.
+QMap<QString, QPair<QString, QString> > nativeBuiltins()
+{
+	QMap<QString, QPair<QString, QString> > r;
+	r["sin"]   = qMakePair(QString("double"), QString("std::sin(a0)"));
+	r["cos"]   = qMakePair(QString("double"), QString("std::cos(a0)"));
+	r["tan"]   = qMakePair(QString("double"), QString("std::tan(a0)"));
+	r["sqr"]   = qMakePair(QString("double"), QString("a0 * a0"));
+	r["sqrt"]  = qMakePair(QString("double"), QString("std::sqrt(a0)"));
+	r["abs"]   = qMakePair(QString("double"), QString("a0 < 0 ? -a0 : a0"));
+	r["pow"]   = qMakePair(QString("double"), QString("std::pow(a0, a1)"));
+	r["expt"]  = r["pow"];
+	r["xpy"]   = r["pow"];
+	r["asin"]  = qMakePair(QString("double"), QString("std::asin(a0)"));
+	r["asn"]   = r["asin"];
+	r["acos"]  = qMakePair(QString("double"), QString("std::acos(a0)"));
+	r["acs"]   = r["acos"];
+	r["atan"]  = qMakePair(QString("double"), QString("std::atan(a0)"));
+	r["atn"]   = r["atan"];
+	r["exp"]   = qMakePair(QString("double"), QString("std::exp(a0)"));
+	r["ln"]    = qMakePair(QString("double"), QString("std::log(a0)"));
+	r["log"]   = qMakePair(QString("double"), QString("std::log10(a0)"));
+	r["deg"]   = qMakePair(QString("double"), QString("a0 * 180 / 3.14159265358979323846"));
+	r["rad"]   = qMakePair(QString("double"), QString("a0 * 3.14159265358979323846 / 180"));
+	r["neg"]   = qMakePair(QString("double"), QString("-a0"));
+	r["trunc"] = qMakePair(QString("int"),    QString("(int) a0"));
+	r["sel"]   = qMakePair(QString("double"), QString("!a0 ? a1 : a2"));
+	r["limit"] = qMakePair(QString("bool"),   QString("a1 >= a0 && a1 <= a2"));
+	return r;
+}
+
+}
+
 QString CompilerFrontend::preprocess(const QString &data)
 {
 	QStringList dataLines = data.split(QRegExp("(\r\n|\r|\n)"));
@@ -132,7 +246,11 @@ bool CompilerFrontend::parseText(const QString &text, bool emptyTextIsValid)
 	TreeVariant dataObjects;
 
 	foreach (const TreeVariant &text, d->_librariesTexts.asList())
-		dataObjects.append(text);
+	{
+		TreeVariant library = text;
+		library["library"] = TreeVariant(true);
+		dataObjects.append(library);
+	}
 
 	TreeVariant data;
 	data["text"] = text;
@@ -143,65 +261,158 @@ bool CompilerFrontend::parseText(const QString &text, bool emptyTextIsValid)
 bool CompilerFrontend::parseDataObjectsList(const TreeVariant &data)
 {
 	d->_messages.clear();
+	d->_compileStats = CompileStats();
 	d->_gen->clear();
 	registerSymTable();
 	d->_vm->_startPC = 0;
 	QString processedData;
+	QStringList sources;
+	int librarySources = 0;
+	const AST::pascalSource* dumpAst = &d->_parser->_pascal;
+	QElapsedTimer timer;
+	OpcodeSequence code;
+	bool linkCode = true;
 	if (d->_semantic == smPascal){
-
-		OpcodeSequence code;
-		int i=0;
-		d->_messages.clear();
 		foreach (const TreeVariant &scriptPart, data.asList())
 		{
+			timer.start();
 			processedData = preprocess(scriptPart["text"].toString());
+			d->_compileStats.preprocessNs += timer.nsecsElapsed();
 			if (processedData.trimmed().isEmpty()) continue;
-
-			d->_parser->_currentFile = i++;
-			d->_scanner->_buf = processedData.toStdWString();
-			d->_scanner->ReInit();
-			d->_parser->Parse();
-			OpcodeSequence code1 = d->_gen->compile(d->_parser->_pascal );
-			if (d->_messages.errorsCount) continue;
-			code << code1;
-		}
-		if (!d->_messages.errorsCount) {
-			d->_vm->_code = code;
+			// only leading parts are libraries, so unused functions of them can be stripped.
+			if (scriptPart["library"].toBool() && librarySources == sources.size())
+				librarySources++;
+			sources << processedData;
 		}
 	}
 	else if (d->_semantic == smAssignment){
-
 		processedData = data.asList().first()["text"].toString();
 		processedData.replace('#', '_');
 		if (!processedData.contains('(')){
 			processedData.replace(',','.');
 		}
+		sources << processedData;
+	}
+
+	const QString cacheFile = compileCacheFile(sources, librarySources);
+	if (!cacheFile.isEmpty() && QFile::exists(cacheFile) && d->_vm->loadImageFile(cacheFile.toStdString())) {
+		d->_vm->_isRunnable = d->_semantic == smPascal;
+		d->_compileStats.objects = sources.size();
+		d->_compileStats.cacheHit = true;
+		return true;
+	}
+
+	if (d->_semantic == smPascal){
+
+		size_t libraryCodeSize = 0;
+		OpcodeSequence programCode;
+		d->_messages.clear();
+		auto isLibraryCached = [this, &sources, librarySources](int i) {
+			auto cached = d->_libraryAst.constFind(sources.at(i));
+			return i < librarySources && cached != d->_libraryAst.constEnd() && cached->file == i;
+		};
+		std::vector<int> parts;
+		for (int i = 0; i < sources.size(); i++)
+			if (!isLibraryCached(i))
+				parts.push_back(i);
+
+		timer.start();
+		std::vector<ParsedSource> parsed(sources.size());
+		parseSources(sources, parts, d->_parser->_StSemantic, parsed);
+		// messages and library cache are updated in order of parts, so result does not depend on threads.
+		for (int i : parts)
+		{
+			foreach (const AST::CodeMessage& msg, parsed[i].messages._messages)
+				d->_messages.Add(msg);
+			if (i < librarySources && !parsed[i].messages.errorsCount)
+			{
+				CompilerFrontendPrivate::LibraryAst& library = d->_libraryAst[sources.at(i)];
+				library.file = i;
+				library.ast = std::move(parsed[i].ast);
+			}
+		}
+		// only libraries of this call are kept, so texts of previous calls do not accumulate.
+		const QStringList librariesTexts = sources.mid(0, librarySources);
+		for (auto it = d->_libraryAst.begin(); it != d->_libraryAst.end(); )
+		{
+			if (librariesTexts.contains(it.key()))
+				++it;
+			else
+				it = d->_libraryAst.erase(it);
+		}
+		d->_compileStats.parseNs += timer.nsecsElapsed();
+
+		for (int i = 0; i < sources.size(); i++)
+		{
+			processedData = sources[i];
+			d->_compileStats.objects++;
+			d->_compileStats.sourceLines += processedData.count('\n');
+			const AST::pascalSource* ast = &parsed[i].ast;
+			if (isLibraryCached(i))
+			{
+				ast = &d->_libraryAst.constFind(processedData)->ast;
+				if (std::find(parts.cbegin(), parts.cend(), i) == parts.cend())
+					d->_compileStats.cachedLibraries++;
+			}
+			dumpAst = ast;
+
+			timer.start();
+			OpcodeSequence code1 = d->_gen->compile(*ast);
+			d->_compileStats.codegenNs += timer.nsecsElapsed();
+			if (d->_messages.errorsCount) continue;
+			if (i < librarySources)
+			{
+				code << std::move(code1);
+				libraryCodeSize = code.size();
+			}
+			else
+				programCode << std::move(code1);
+		}
+		timer.start();
+		OpcodeSequence calledBodies = d->_gen->compileCalledBodies(d->_compileStats.skippedBodies);
+		d->_compileStats.codegenNs += timer.nsecsElapsed();
+		// program runs until end of code, so called bodies go before it, like procedures before __start.
+		code << std::move(calledBodies);
+		code << std::move(programCode);
+		linkCode = !d->_messages.errorsCount;
+		if (linkCode && libraryCodeSize)
+			d->_compileStats.strippedFunctions = code.stripUnusedFunctions(libraryCodeSize);
+	}
+	else if (d->_semantic == smAssignment){
+
+		d->_compileStats.objects = 1;
+		timer.start();
 		d->_scanner->_buf = processedData.toStdWString();
 		d->_scanner->ReInit();
 		AST::assignmentst assignmentst;
 		d->_parser->_currentFile = 0;
 		d->_parser->ParseAssignment(assignmentst);
-		d->_vm->_code = d->_gen->compile(assignmentst );
+		d->_compileStats.parseNs += timer.nsecsElapsed();
+
+		timer.start();
+		code = d->_gen->compile(assignmentst );
+		d->_compileStats.codegenNs += timer.nsecsElapsed();
 	}
 	if (d->_debugFlags & dAstDump){
 		QString yaml;
-		d->_parser->_pascal.save().toYamlString(yaml);
+		AST::pascalSource(*dumpAst).save().toYamlString(yaml);
 		qDebug() << "ast=\n" << yaml.replace("\r", "");
 	}
 
 	if (d->_debugFlags & dNameTable)
 		d->_gen->_tab->debug();
+	timer.start();
 	QMap<std::string, int> externalAddresses;
 	QMap<std::string, int> internalAddresses;
 
-	for (size_t i=0; i< d->_vm->_code.size();i++){
-		BytecodeVM &o = d->_vm->_code[i];
+	for (size_t i=0; i< code.size();i++){
+		CompilerOpcode &o = code[i];
 		if (o.symbolLabel.size())
 			internalAddresses[o.symbolLabel]  = i;
 	}
 
-	for (size_t i=0; i< d->_vm->_code.size();i++){
-		BytecodeVM &o = d->_vm->_code[i];
+	for (size_t i=0; i< code.size();i++){
+		CompilerOpcode &o = code[i];
 		if (o.gotoLabel.size()){
 			if (o.op == BytecodeVM::CALL) {
 				int address = internalAddresses.value(o.gotoLabel, -1);
@@ -221,8 +432,14 @@ bool CompilerFrontend::parseDataObjectsList(const TreeVariant &data)
 		}
 	}
 
+	if (linkCode)
+	{
+		d->_vm->resetCompiled();
+		code.link(d->_vm->_code, d->_vm->_debugInfo);
+	}
 	d->_vm->_startPC = internalAddresses.value( d->_gen->_startAddress.toStdString() );
 	d->_vm->_isRunnable =  !d->_gen->_startAddress.isEmpty() && internalAddresses.contains(d->_gen->_startAddress.toStdString());
+	d->_compileStats.linkNs = timer.nsecsElapsed();
 
 	QStringList dataLines = processedData.split(QRegExp("(\r\n|\r|\n)"));
 	int last_line = -2;
@@ -231,14 +448,14 @@ bool CompilerFrontend::parseDataObjectsList(const TreeVariant &data)
 		qDebug() << "start: [" << d->_vm->_startPC << "], " << d->_gen->_startAddress;
 		for (size_t i=0;i<d->_vm->_code.size();i++)
 		{
-			int l = d->_vm->_code[i].line;
+			int l = d->_vm->_debugInfo.location(i).line;
 			//int c = _vm->_code[i].col;
 			if (last_line != l && l >=0){
 				last_line = l;
 				qDebug() << "";
 				qDebug() << QString(">> ") +dataLines.value(last_line -1).trimmed() ;
 			}
-			qDebug() /*<< qPrintable(lc)*/ << i << ":" << d->_vm->_code[i].ConvertToString().c_str();
+			qDebug() /*<< qPrintable(lc)*/ << i << ":" << d->_vm->_code[i].ConvertToString().c_str() << d->_vm->_debugInfo.symbol(i).c_str();
 		}
 	}
 
@@ -246,6 +463,15 @@ bool CompilerFrontend::parseDataObjectsList(const TreeVariant &data)
 	if (!res) {
 		d->_vm->_isRunnable = false;
 	}
+	// program without start address is not cached: cache hit could not restore _isRunnable of it.
+	if (res && !cacheFile.isEmpty() && d->_vm->_isRunnable == (d->_semantic == smPascal)) {
+		std::vector<uint8_t> image;
+		QSaveFile file(cacheFile);
+		if (d->_vm->saveImage(image) && file.open(QIODevice::WriteOnly)) {
+			file.write(reinterpret_cast<const char*>(image.data()), image.size());
+			file.commit();
+		}
+	}
 	if (d->_debugFlags & dCompileMessages){
 		foreach (const AST::CodeMessage& msg, d->_messages._messages)
 			qWarning() << msg.toString();
@@ -253,7 +479,7 @@ bool CompilerFrontend::parseDataObjectsList(const TreeVariant &data)
 	return res;
 }
 
-bool CompilerFrontend::pascal2c(const QString &pascalText, QString &ctext)
+bool CompilerFrontend::pascal2c(const QString &pascalText, QString &ctext, int visitorFlags)
 {
 	d->_gen->clear();
 	registerSymTable();
@@ -265,16 +491,138 @@ bool CompilerFrontend::pascal2c(const QString &pascalText, QString &ctext)
 	d->_parser->Parse();
 
 	auto mes = d->_messages;
+	// visitor prints every body, so all of them must register their types in _codeTypes.
+	const int parserOptions = d->_gen->_parserOptions;
+	d->_gen->_parserOptions &= ~CodeGenerator::poLazyBodies;
 	d->_gen->compile( d->_parser->_pascal );
+	d->_gen->_parserOptions = parserOptions;
 	d->_messages = mes;
 
-	StringVisitor visitor(StringVisitor::otC);
+	StringVisitor visitor(StringVisitor::otC, visitorFlags);
 	visitor._codeTypes = d->_gen->_codeTypes;
+	if (visitorFlags & StringVisitor::fNativeModule)
+	{
+		static const QMap<QString, QPair<QString, QString> > builtins = nativeBuiltins();
+		const SymTable* tab = d->_gen->_tab;
+
+		foreach (QString varName, d->_vars.keys())
+		{
+			const QString typeName = d->_vars[varName].toString();
+			const QString cType = nativeCType(tab, typeName);
+			if (cType.isEmpty())
+				visitor._nativeUnsupported[varName.toLower()] = "variable of type " + typeName;
+			else
+				visitor._nativeVars[varName.toLower()] = cType;
+		}
+
+		foreach (const TreeVariant &f, d->_functions.asList())
+		{
+			const QString name = f["name"].toString().toLower();
+			if (f["className"].toString().size())
+				continue; // methods are called on objects, which are not passed to module.
+
+			StringVisitor::NativeFunction nf;
+			QString reason;
+			foreach (const TreeVariant& fa, f["args"].asList())
+			{
+				const QString cType = nativeCType(tab, fa["typeName"].toString());
+				if (fa["ref"].toBool())
+					reason = "var argument " + fa["name"].toString();
+				else if (fa["arraySize"].toInt())
+					reason = "array argument " + fa["name"].toString();
+				else if (cType.isEmpty())
+					reason = "argument " + fa["name"].toString() + " of type " + fa["typeName"].toString();
+				nf.argTypes << cType;
+			}
+			const QString resultTypeName = f["typeName"].toString();
+			if (resultTypeName.size())
+			{
+				nf.resultType = nativeCType(tab, resultTypeName);
+				if (nf.resultType.isEmpty())
+					reason = "result of type " + resultTypeName;
+			}
+			if (builtins.contains(name) && reason.isEmpty())
+			{
+				nf.resultType = builtins[name].first;
+				nf.body = builtins[name].second;
+			}
+			if (reason.isEmpty())
+				visitor._nativeFunctions[name] = nf;
+			else
+				visitor._nativeUnsupported[name] = "function with " + reason;
+		}
+	}
 	ctext = boost::apply_visitor(visitor, d->_parser->_pascal._pascal);
 
+	QSet<QString> rejected;
+	foreach (const AST::ident& ident, visitor._nativeRejected)
+	{
+		const QString name = ident._ident.toLower();
+		if (rejected.contains(name))
+			continue;
+		rejected << name;
+		d->_messages.Error(ident._loc, QString("%1 can not be used in native module: %2 is not passed through PascalNativeAbi")
+						   .arg(ident._ident).arg(visitor._nativeUnsupported[name]));
+	}
+
 	return !d->_messages.errorsCount;
 }
 
+bool CompilerFrontend::buildNativeModule(const QString &pascalText, const QString &modulePath, const QString &compiler)
+{
+	QString ctext;
+	if (!pascal2c(pascalText, ctext, StringVisitor::fNativeModule))
+		return false;
+
+	const QString sourcePath = modulePath + ".cpp";
+	QFile source(sourcePath);
+	if (!source.open(QIODevice::WriteOnly))
+	{
+		d->_messages.Error(0, 0, "Failed to write " + sourcePath);
+		return false;
+	}
+	source.write(ctext.toUtf8());
+	source.close();
+
+	QStringList args;
+	const QString compilerName = QFileInfo(compiler).baseName().toLower();
+	if (compilerName == "cl" || compilerName == "clang-cl")
+		args << "/nologo" << "/std:c++17" << "/O2" << "/EHsc" << "/LD" << "/Fe" + modulePath << sourcePath;
+	else // GCC and Clang drivers.
+		args << "-std=c++17" << "-O2" << "-shared" << "-fPIC" << "-o" << modulePath << sourcePath;
+
+	QProcess process;
+	process.start(compiler, args);
+	if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+	{
+		d->_messages.Error(0, 0, "Native module build failed: " + QString::fromLocal8Bit(process.readAllStandardError()));
+		return false;
+	}
+	return loadNativeModule(modulePath);
+}
+
+bool CompilerFrontend::loadNativeModule(const QString &modulePath)
+{
+	std::ostringstream virtErr;
+	d->_vm->_errout = &virtErr;
+	const bool result = d->_vm->loadNativeModule(modulePath.toStdString());
+	d->_vm->_errout = nullptr;
+	if (!result)
+		d->_messages.Error(0, 0, QString::fromStdString(virtErr.str()));
+	return result;
+}
+
+bool CompilerFrontend::compileExpression(ExpressionProgram &program)
+{
+	program.clear();
+	if (d->_semantic != smAssignment || d->_messages.errorsCount)
+		return false;
+	SciptRuntimeLibrary::bindAllStandard(d->_vm);
+	if (!d->_vm->checkExternalReferences())
+		return false;
+	return program.compile(*d->_vm);
+}
+
 bool CompilerFrontend::run(bool firstRun)
 {
 	std::ostringstream virtDebug;
@@ -310,6 +658,7 @@ SymTable* CompilerFrontend::getSymTable()
 void CompilerFrontend::clearBindings()
 {
 	d->_librariesTexts.clear();
+	d->_libraryAst.clear();
 	d->_functions.clear();
 	d->_functionsDescr.clear();
 	d->_vars.clear();
@@ -318,8 +667,9 @@ void CompilerFrontend::clearBindings()
 
 void CompilerFrontend::addFuncs(QStringList protos, QString classname)
 {
-	static QRegExp main("((\\w+)\\.)?(\\w+)\\s*\\(([^)]*)\\)(:(\\w+))?");
-	static QRegExp arrs("(\\w+)\\s*\\[(\\d+)\\]");
+	// QRegExp keeps captures of last match, so it is not shared between calls and threads.
+	QRegExp main("((\\w+)\\.)?(\\w+)\\s*\\(([^)]*)\\)(:(\\w+))?");
+	QRegExp arrs("(\\w+)\\s*\\[(\\d+)\\]");
 
 	foreach (QString prototype, protos)
 	{
@@ -405,6 +755,7 @@ void CompilerFrontend::addClasses(const TreeVariant &classesMap)
 void CompilerFrontend::setLibraries(const TreeVariant &libraries)
 {
 	d->_librariesTexts = libraries;
+	d->_libraryAst.clear();
 }
 
 void CompilerFrontend::bindFuncs(QMap<QString, funCallbackWrapper> funcs)
@@ -506,6 +857,18 @@ void CompilerFrontend::setExecuteLimit(int limit)
 	d->_executeLimit = limit;
 }
 
+void CompilerFrontend::setCacheDirectory(const QString &path)
+{
+	d->_cacheDirectory = path;
+	if (!path.isEmpty())
+		QDir().mkpath(path);
+}
+
+QString CompilerFrontend::cacheDirectory() const
+{
+	return d->_cacheDirectory;
+}
+
 QByteArray CompilerFrontend::getOutput(CompilerFrontend::OutChannel channel) const
 {
 	switch (channel)
@@ -549,6 +912,11 @@ const AST::CodeMessages &CompilerFrontend::messages() const
 	return d->_messages;
 }
 
+const CompilerFrontend::CompileStats &CompilerFrontend::compileStats() const
+{
+	return d->_compileStats;
+}
+
 void CompilerFrontend::makeTokenList(const QString &text, QList<AST::TToken> &list)
 {
 	QString processedData = preprocess(text.toUtf8());
@@ -627,6 +995,41 @@ void CompilerFrontend::registerSymTable()
 	}
 }
 
+QString CompilerFrontend::compileCacheFile(const QStringList &sources, int librarySources) const
+{
+	// dumps are made by parser and code generator, so they need compilation.
+	if (d->_cacheDirectory.isEmpty() || (d->_debugFlags & (dAstDump | dNameTable | dBytecode)))
+		return QString();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	auto addData = [&hash](const QString& str) {
+		hash.addData(str.toUtf8());
+		hash.addData("\0", 1);
+	};
+	// image of older compiler is not loaded after change of image layout, instruction set or code generator.
+	addData(QString("%1 %2 %3 %4 %5 %6").arg(ScriptVM::_formatVersion).arg(ScriptVM::_imageVersion).arg(CodeGenerator::_version)
+			.arg(d->_semantic).arg(d->_gen->_parserOptions).arg(librarySources));
+	for (int op = 0; op < BytecodeVM::OPCODE_COUNT; op++)
+		addData(QString::fromStdString(BytecodeVM::opcodes[op]));
+	for (int op = 0; op < BytecodeVM::BinOp_COUNT; op++)
+		addData(QString::fromStdString(BytecodeVM::binopStr[op]));
+	for (int op = 0; op < BytecodeVM::UnOp_COUNT; op++)
+		addData(QString::fromStdString(BytecodeVM::unopStr[op]));
+	QStringList defines = d->_defines.keys();
+	defines.sort();
+	foreach (const QString& define, defines)
+		addData(define + "=" + d->_defines[define]);
+	foreach (const TreeVariant* bindings, QList<const TreeVariant*>() << &d->_classes << &d->_functions << &d->_vars)
+	{
+		QString json;
+		bindings->toYamlString(json, true);
+		addData(json);
+	}
+	foreach (const QString& source, sources)
+		addData(source);
+	return QDir(d->_cacheDirectory).filePath(QString::fromLatin1(hash.result().toHex()) + ".img");
+}
+
 bool CompilerFrontend::prepareVM(bool firstRun,
 								  std::ostringstream &virtDebug,
 								  std::ostringstream &virtStd,
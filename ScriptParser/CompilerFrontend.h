@@ -33,6 +33,7 @@ struct TToken;
 class TreeVariant;
 class CodeGenerator;
 class ScriptVM;
+class ExpressionProgram;
 struct CompilerFrontendPrivate;
 class ScriptVariant;
 class SymTable;
@@ -74,17 +75,42 @@ public:
 
 	enum OutChannel { ocError, ocStd, ocDebug };
 
-	enum ParserOptions {poNone = 0, poForbidExternal = 1 << 0 };
+	/// poLazyBodies: procedure body is compiled only when some compiled code calls it; bodies which are never called
+	/// are not checked, so their errors are not reported.
+	enum ParserOptions {poNone = 0, poForbidExternal = 1 << 0, poLazyBodies = 1 << 1 };
 
 	using funCallbackWrapper = std::function< void(std::vector<ScriptVariant*>  &, std::vector<ScriptVariant*>  & )>;
 
+	/// Phase timings of last parseDataObjectsList() call, nanoseconds. Scanning is done lazily by parser, so it is part of parseNs.
+	/// Objects are parsed in parallel, parseNs is wall time of all of them.
+	struct CompileStats {
+		qint64 preprocessNs = 0;
+		qint64 parseNs = 0;
+		qint64 codegenNs = 0;
+		qint64 linkNs = 0;
+		int objects = 0;
+		int sourceLines = 0;
+		int cachedLibraries = 0;   //!< libraries compiled from AST of previous call, without parsing.
+		int strippedFunctions = 0; //!< library functions not called by program, removed by linker.
+		int skippedBodies = 0;     //!< procedures not called by program, not compiled with poLazyBodies.
+		bool cacheHit = false;     //!< program was loaded from cache directory, other phases were skipped.
+	};
+
 
 	CompilerFrontend();
 	~CompilerFrontend();
 	bool parseText(const QString &text, bool emptyTextIsValid = true);
 
 	bool parseDataObjectsList(const TreeVariant &data);
-	bool pascal2c(const QString &pascalText, QString & ctext);
+	bool pascal2c(const QString &pascalText, QString & ctext, int visitorFlags = 0);
+	/// Translates program with pascal2c, builds shared library with system compiler and loads it into vm().
+	/// compiler is GCC or Clang driver (c++, g++, clang++), or MSVC cl/clang-cl; other compilers get GCC options.
+	/// Bind variables and call run() as for bytecode; only scalar external variables and functions are passed,
+	/// program that uses other bindings fails with error naming them.
+	bool buildNativeModule(const QString &pascalText, const QString &modulePath, const QString &compiler = "c++");
+	bool loadNativeModule(const QString &modulePath);
+	/// Compiles parsed smAssignment expression into evaluator bound to current variables; false if expression needs run().
+	bool compileExpression(ExpressionProgram &program);
 	bool run(bool firstRun = true);
 	bool isFinished();
 	SymTable* getSymTable();
@@ -96,6 +122,7 @@ public:
 	void addVars(const TreeVariant& vars);
 	void addClass(QString name, const TreeVariant& fields, const QStringList &methods = QStringList());
 	void addClasses(const TreeVariant& classesMap);
+	/// Library texts compiled before every parseText() text; parsed once, functions not used by text are not linked.
 	void setLibraries(const TreeVariant &libraries);
 
 	void bindFuncs(QMap<QString, funCallbackWrapper> funcs);
@@ -122,6 +149,11 @@ public:
 
 	void setExecuteLimit(int limit);
 
+	/// Directory of compiled programs, keyed by hash of preprocessed sources, bindings and compiler versions; empty (default) disables cache.
+	/// On cache hit parse and code generation are skipped, so compile warnings and debug info are not available.
+	void setCacheDirectory(const QString &path);
+	QString cacheDirectory() const;
+
 	QByteArray getOutput(OutChannel channel = ocStd) const;
 	inline QByteArray getOutputError() const { return getOutput(ocError); }
 
@@ -129,12 +161,14 @@ public:
 	TreeVariant classesDescr() const;
 	TreeVariant variables() const;
 	const AST::CodeMessages &messages() const;
+	const CompileStats &compileStats() const;
 
 	void makeTokenList(const QString& text,  QList<AST::TToken> &list);
 
 private:
 	void registerSymTable();
 	QString preprocess(const QString &data);
+	QString compileCacheFile(const QStringList &sources, int librarySources) const;
 	bool prepareVM(bool firstRun,
 				   std::ostringstream &virtDebug,
 				   std::ostringstream &virtStd,
@@ -78,6 +78,8 @@ bool ExpressionEvaluator::evaluate(EvaluationList &result,const AST::primary &va
 	if (ident) { //TODO: check for const table?
 
 	}
+	if (!val._accessors.isEmpty())
+		return false;
 	if (constant) return this->evaluate(result, *constant);
 	if (expr_list){
 		foreach (const AST::expr& expr, expr_list->_exprs){
@@ -91,10 +93,16 @@ bool ExpressionEvaluator::evaluate(EvaluationList &result,const AST::primary &va
 
 bool ExpressionEvaluator::evaluate(EvaluationList &result,const AST::unary &val) const
 {
+	if (val._op != BytecodeVM::UPLUS && val._op != BytecodeVM::UMINUS)
+		return false;
 	bool ret = this->evaluate(result, val._expr);
 	if (ret && val._op == BytecodeVM::UMINUS) {
-		result.last().setValue( - result.last().getValue<double>() );
-
+		if (ScriptVariant::isTypeInt(result.last().getType()))
+			result.last().setValue( - result.last().getValue<int64_t>() );
+		else if (ScriptVariant::isTypeFloat(result.last().getType()))
+			result.last().setValue( - result.last().getValue<double>() );
+		else
+			return false;
 	}
 	return ret;
 }
@@ -102,18 +110,35 @@ bool ExpressionEvaluator::evaluate(EvaluationList &result,const AST::unary &val)
 bool ExpressionEvaluator::evaluate(EvaluationList &result,const AST::binary &val) const
 {
 	EvaluationList left, right;
-	if (!this->evaluate(result, val._left))  return false;
+	if (!this->evaluate(left, val._left))  return false;
 	if (!this->evaluate(right,  val._right)) return false;
-	ScriptVariant result_v = left.last();
-	double left_v = left.last().getValue<double>();
-	double right_v = right.last().getValue<double>();
-	switch (val._op) {
-		case BytecodeVM::PLUS:  result_v.setValue( left_v + right_v ); break;
-		case BytecodeVM::MINUS: result_v.setValue( left_v - right_v ); break;
-		case BytecodeVM::DIV:   result_v.setValue( left_v / right_v ); break;
-		case BytecodeVM::MUL:   result_v.setValue( left_v * right_v ); break;
-	default:
+	if (left.size() != 1 || right.size() != 1) return false;
+	const ScriptVariant::Types leftType = left.last().getType(), rightType = right.last().getType();
+	if (!(ScriptVariant::isTypeInt(leftType) || ScriptVariant::isTypeFloat(leftType))
+		|| !(ScriptVariant::isTypeInt(rightType) || ScriptVariant::isTypeFloat(rightType)))
 		return false;
+	ScriptVariant result_v;
+	if (ScriptVariant::isTypeInt(leftType) && ScriptVariant::isTypeInt(rightType)) {
+		int64_t left_v = left.last().getValue<int64_t>();
+		int64_t right_v = right.last().getValue<int64_t>();
+		switch (val._op) {
+			case BytecodeVM::PLUS:  result_v.setValue( left_v + right_v ); break;
+			case BytecodeVM::MINUS: result_v.setValue( left_v - right_v ); break;
+			case BytecodeVM::MUL:   result_v.setValue( left_v * right_v ); break;
+		default:
+			return false;
+		}
+	} else {
+		double left_v = left.last().getValue<double>();
+		double right_v = right.last().getValue<double>();
+		switch (val._op) {
+			case BytecodeVM::PLUS:  result_v.setValue( left_v + right_v ); break;
+			case BytecodeVM::MINUS: result_v.setValue( left_v - right_v ); break;
+			case BytecodeVM::DIVR:  result_v.setValue( left_v / right_v ); break;
+			case BytecodeVM::MUL:   result_v.setValue( left_v * right_v ); break;
+		default:
+			return false;
+		}
 	}
 	result << result_v;
 
@@ -13,6 +13,9 @@
 
 #include "OpcodeSequence.h"
 
+#include <iterator>
+#include <map>
+
 OpcodeSequence::OpcodeSequence()
 {
 	setLoc(-1,-1,-1);
@@ -31,30 +34,36 @@ void OpcodeSequence::setScope(BlockScope *blockScope)
 	_blockScope =blockScope;
 }
 
-BytecodeVM &OpcodeSequence::Emit( BytecodeVM::OpCodeType op){
-	BytecodeVM opc =  cur_op();
+CompilerOpcode &OpcodeSequence::Emit( BytecodeVM::OpCodeType op){
+	CompilerOpcode opc =  cur_op();
 	opc.op = op;
-	this->push_back(opc);
+	this->push_back(std::move(opc));
 	return (*this)[size()-1];
 }
 
-BytecodeVM &OpcodeSequence::Prepend(BytecodeVM::OpCodeType op, int size)
+size_t OpcodeSequence::EmitForwardJump(BytecodeVM::OpCodeType op)
 {
-	BytecodeVM opc =  cur_op();
-	opc.op = op;
-	opc.values.resize(1);
-	opc.values[0].setValue(size, ScriptVariant::T_AUTO);
-	this->insert(begin(), opc);
-	return (*this)[0];
+	this->Emit(op, int(0));
+	return size() - 1;
+}
+
+void OpcodeSequence::PatchJump(size_t index)
+{
+	(*this)[index].values[0].setValue(int(size() - index), ScriptVariant::T_AUTO);
 }
 
-BytecodeVM &OpcodeSequence::EmitInit(BytecodeVM::OpCodeType op, ScriptVariant::Types t){
-	BytecodeVM opc =  cur_op();
+void OpcodeSequence::EmitJumpTo(BytecodeVM::OpCodeType op, size_t index)
+{
+	this->Emit(op, int(index) - int(size()));
+}
+
+CompilerOpcode &OpcodeSequence::EmitInit(BytecodeVM::OpCodeType op, ScriptVariant::Types t){
+	CompilerOpcode opc =  cur_op();
 	opc.op = op;
 	opc.values.resize(2);
 	opc.values[0].setValue(1, ScriptVariant::T_int32_t);
 	opc.values[1].setValue(0, t);
-	this->push_back(opc);
+	this->push_back(std::move(opc));
 	return (*this)[size()-1];
 }
 
@@ -62,7 +71,7 @@ void OpcodeSequence::EmitAddref(int size)
 {
 	if (size < 0) return;
 	if (this->size() == 0) this->Emit(BytecodeVM::ADDREF, size);
-	BytecodeVM &last = (*this)[this->size()-1];
+	CompilerOpcode &last = (*this)[this->size()-1];
 	if (last.op == BytecodeVM::ADDREF) {
 		last.values[0].setValue(size + last.values[0].getValue<int>());
 	}else{
@@ -70,24 +79,24 @@ void OpcodeSequence::EmitAddref(int size)
 	}
 }
 
-BytecodeVM &OpcodeSequence::EmitPush(ScriptVariant::Types val, int size){
-	BytecodeVM opc =  cur_op();
+CompilerOpcode &OpcodeSequence::EmitPush(ScriptVariant::Types val, int size){
+	CompilerOpcode opc =  cur_op();
 	opc.op = BytecodeVM::PUSH;
 	opc.values.resize(2);
 	opc.values[0].setValue(0, val);
 	opc.values[1].setValue(size, ScriptVariant::T_AUTO);
-	this->push_back(opc);
+	this->push_back(std::move(opc));
 	return (*this)[this->size()-1];
 }
 
-BytecodeVM &OpcodeSequence::EmitPush(const ScriptVariant &val)
+CompilerOpcode &OpcodeSequence::EmitPush(const ScriptVariant &val)
 {
-	BytecodeVM opc =  cur_op();
+	CompilerOpcode opc =  cur_op();
 	opc.op = BytecodeVM::PUSH;
 	opc.values.resize(2);
 	opc.values[0] = val;
 	opc.values[1].setValue(int (1), ScriptVariant::T_AUTO);
-	this->push_back(opc);
+	this->push_back(std::move(opc));
 	return (*this)[size()-1];
 }
 
@@ -95,7 +104,7 @@ void OpcodeSequence::ReplaceBreak(int jmpOffset)
 {
 	for (size_t i=0; i < this->size();i++)
 	{
-		BytecodeVM &opc=(*this)[i];
+		CompilerOpcode &opc=(*this)[i];
 		if (opc.symbolLabel == "__break")
 		{
 			opc.symbolLabel.clear();
@@ -109,7 +118,7 @@ void OpcodeSequence::ReplaceContinue(int jmpOffset)
 {
 	for (size_t i=0; i < this->size();i++)
 	{
-		BytecodeVM &opc=(*this)[i];
+		CompilerOpcode &opc=(*this)[i];
 		if (opc.symbolLabel == "__continue")
 		{
 			opc.symbolLabel.clear();
@@ -125,12 +134,100 @@ OpcodeSequence &OpcodeSequence::operator <<(const OpcodeSequence &another)
 	return *this;
 }
 
-OpcodeSequence &OpcodeSequence::operator <<(const BytecodeVM &opc)
+OpcodeSequence &OpcodeSequence::operator <<(OpcodeSequence &&another)
 {
-	this->push_back(opc);
+	if (this->empty())
+		std::vector<CompilerOpcode>::operator =(std::move(another));
+	else
+		this->insert(this->end(), std::make_move_iterator(another.begin()), std::make_move_iterator(another.end()));
+	another.clear();
 	return *this;
 }
 
+OpcodeSequence &OpcodeSequence::operator <<(const CompilerOpcode &opc)
+{
+	this->push_back(std::move(opc));
+	return *this;
+}
+
+int OpcodeSequence::stripUnusedFunctions(size_t end)
+{
+	// Function is instructions from its label to next label. Calls are resolved by label and jumps are relative
+	// inside of function, so removing whole functions needs no relocation of remaining code.
+	struct Function {
+		size_t begin, end;
+		bool used;
+	};
+	std::vector<Function> functions;
+	std::map<std::string, size_t> byLabel;
+	for (size_t i=0; i < this->size();i++)
+	{
+		const std::string& label = (*this)[i].symbolLabel;
+		if (label.empty() && i > 0)
+			continue;
+		if (!functions.empty())
+			functions.back().end = i;
+		// unlabeled start, code after end and internal labels such as __start are kept.
+		const bool removable = i < end && !label.empty() && label.compare(0, 2, "__") != 0;
+		functions.push_back(Function{i, this->size(), !removable});
+		if (removable)
+			byLabel[label] = functions.size() - 1;
+	}
+
+	std::vector<size_t> queue;
+	for (size_t f = 0; f < functions.size(); f++)
+		if (functions[f].used)
+			queue.push_back(f);
+	while (!queue.empty())
+	{
+		const Function function = functions[queue.back()];
+		queue.pop_back();
+		for (size_t i = function.begin; i < function.end; i++)
+		{
+			const CompilerOpcode &opc=(*this)[i];
+			if (opc.op != BytecodeVM::CALL || opc.gotoLabel.empty())
+				continue;
+			auto callee = byLabel.find(opc.gotoLabel);
+			if (callee != byLabel.end() && !functions[callee->second].used)
+			{
+				functions[callee->second].used = true;
+				queue.push_back(callee->second);
+			}
+		}
+	}
+
+	int removed = 0;
+	size_t dst = 0;
+	for (const Function& function : functions)
+	{
+		if (!function.used)
+		{
+			removed++;
+			continue;
+		}
+		for (size_t i = function.begin; i < function.end; i++, dst++)
+			if (dst != i)
+				(*this)[dst] = std::move((*this)[i]);
+	}
+	this->resize(dst);
+	return removed;
+}
+
+void OpcodeSequence::link(std::vector<BytecodeVM> &code, BytecodeDebugInfo &debugInfo) const
+{
+	code.clear();
+	code.reserve(this->size());
+	debugInfo.clear();
+	for (size_t i=0; i < this->size();i++)
+	{
+		const CompilerOpcode &opc=(*this)[i];
+		code.push_back(opc);
+		debugInfo.addLocation(i, opc.loc);
+		if (opc.symbolLabel.size())
+			debugInfo.symbols[i] = opc.symbolLabel;
+	}
+}
+
 void OpcodeSequence::optimize()
 {
 	// TODO:?
@@ -14,16 +14,27 @@
 #pragma once
 
 #include <BytecodeVM.h>
+
+#include <utility>
+
 class BlockScope;
-class OpcodeSequence : public std::vector<BytecodeVM>
+/// Instruction with compile-time data; link() moves location and labels to BytecodeDebugInfo.
+struct CompilerOpcode : public BytecodeVM
+{
+	BytecodeDebugInfo::Location loc;
+	BlockScope* scope = nullptr;
+	std::string symbolLabel;
+	std::string gotoLabel;
+};
+class OpcodeSequence : public std::vector<CompilerOpcode>
 {
 	int file, col, line;
 	BlockScope* _blockScope;
-	BytecodeVM cur_op() {
-		BytecodeVM opc;
-		opc.file = file;
-		opc.col = col;
-		opc.line = line;
+	CompilerOpcode cur_op() {
+		CompilerOpcode opc;
+		opc.loc.file = file;
+		opc.loc.col = col;
+		opc.loc.line = line;
 		opc.scope = _blockScope;
 		return opc;
 	}
@@ -37,61 +48,75 @@ public:
 		return setLoc(val._loc._file, val._loc._line, val._loc._col);
 	}
 	template <class T >
-	BytecodeVM& Emit(BytecodeVM::OpCodeType op, T val){
-		BytecodeVM opc =  cur_op();
+	CompilerOpcode& Emit(BytecodeVM::OpCodeType op, T val){
+		CompilerOpcode opc =  cur_op();
 		opc.op = op;
 		opc.values.resize(1);
 		opc.values[0].setValue(val, ScriptVariant::T_AUTO);
-		this->push_back(opc);
+		this->push_back(std::move(opc));
 		return (*this)[size()-1];
 	}
 
 	template <class T, class T2 >
-	BytecodeVM& Emit(BytecodeVM::OpCodeType op, T val, T2 val2){
-		BytecodeVM opc =  cur_op();
+	CompilerOpcode& Emit(BytecodeVM::OpCodeType op, T val, T2 val2){
+		CompilerOpcode opc =  cur_op();
 		opc.op = op;
 		opc.values.resize(2);
 		opc.values[0].setValue(val, ScriptVariant::T_AUTO);
 		opc.values[1].setValue(val2, ScriptVariant::T_AUTO);
-		this->push_back(opc);
+		this->push_back(std::move(opc));
 		return (*this)[size()-1];
 	}
 	template <class T, class T2, class T3 >
-	BytecodeVM& Emit(BytecodeVM::OpCodeType op, T val, T2 val2, T3 val3){
-		BytecodeVM opc =  cur_op();
+	CompilerOpcode& Emit(BytecodeVM::OpCodeType op, T val, T2 val2, T3 val3){
+		CompilerOpcode opc =  cur_op();
 		opc.op = op;
 		opc.values.resize(3);
 		opc.values[0].setValue(val, ScriptVariant::T_AUTO);
 		opc.values[1].setValue(val2, ScriptVariant::T_AUTO);
 		opc.values[2].setValue(val3, ScriptVariant::T_AUTO);
-		this->push_back(opc);
+		this->push_back(std::move(opc));
 		return (*this)[size()-1];
 	}
 
-	BytecodeVM& Emit(BytecodeVM::OpCodeType op);
-	BytecodeVM& Prepend(BytecodeVM::OpCodeType op, int size);
+	CompilerOpcode& Emit(BytecodeVM::OpCodeType op);
+	/// Jump with unknown offset; returns its index for PatchJump().
+	size_t EmitForwardJump(BytecodeVM::OpCodeType op);
+	/// Sets offset of jump at index to end of sequence, where next instruction will be emitted.
+	void PatchJump(size_t index);
+	/// Jump to instruction at index emitted before, e.g. to condition of loop.
+	void EmitJumpTo(BytecodeVM::OpCodeType op, size_t index);
 
-	BytecodeVM& EmitInit(BytecodeVM::OpCodeType op, ScriptVariant::Types t);
+	CompilerOpcode& EmitInit(BytecodeVM::OpCodeType op, ScriptVariant::Types t);
 	void EmitAddref(int size);
 
 	template <class T>
-	BytecodeVM& EmitPush(T val, int size = 1){
-		BytecodeVM opc =  cur_op();
+	CompilerOpcode& EmitPush(T val, int size = 1){
+		CompilerOpcode opc =  cur_op();
 		opc.op = BytecodeVM::PUSH;
 		opc.values.resize(2);
 		opc.values[0].setValue(val, ScriptVariant::T_AUTO);
 		opc.values[1].setValue(size, ScriptVariant::T_AUTO);
-		this->push_back(opc);
+		this->push_back(std::move(opc));
 		return (*this)[this->size()-1];
 	}
 
 
-	BytecodeVM& EmitPush(ScriptVariant::Types val, int size = 1);
-	BytecodeVM& EmitPush(const ScriptVariant& val);
+	CompilerOpcode& EmitPush(ScriptVariant::Types val, int size = 1);
+	CompilerOpcode& EmitPush(const ScriptVariant& val);
 	void ReplaceBreak(int jmpOffset);
 	void ReplaceContinue(int jmpOffset);
 	OpcodeSequence& operator << (const OpcodeSequence& another);
-	OpcodeSequence& operator << (const BytecodeVM& opc);
+	/// Moves instructions; empty sequence takes storage of another, so nested results are not copied at every level.
+	OpcodeSequence& operator << (OpcodeSequence&& another);
+	OpcodeSequence& operator << (const CompilerOpcode& opc);
+
+	/// Removes functions starting before end which are not called from code after end, from labels like __start or
+	/// from other kept functions. Must be called before labels are resolved. Returns count of removed functions.
+	int stripUnusedFunctions(size_t end);
+
+	/// Labels must be resolved already; copies instructions to code and their locations and symbols to debugInfo.
+	void link(std::vector<BytecodeVM>& code, BytecodeDebugInfo& debugInfo) const;
 
 	void optimize();
 };
@@ -37,13 +37,13 @@ namespace PascalLike {
 
 
 void Parser::Err(const QString& msg) {
-    if (errDist >= minErrDist) errors->Error(la->line, la->col, msg);
+    if (errDist >= minErrDist) errors->Error(cur(), msg);
     errDist = 0;
 }
 
 
 void Parser::SemErr(const wchar_t* msg) {
-	if (errDist >= minErrDist) errors->Error(t->line, t->col, msg);
+	if (errDist >= minErrDist) errors->Error(AST::CodeLocation(_currentFile, t->line, t->col, t->charPos), QString::fromWCharArray(msg));
 	errDist = 0;
 }
 
@@ -227,7 +227,7 @@ void Parser::ExprList(AST::expr_list &expr_list) {
 			} else SynErr(175);
 		}
 		Expr(expr);
-		expr_list._exprs << expr; 
+		AST::moveAppend(expr_list._exprs, expr); 
 		while (la->kind == _semicol || la->kind == 169 /* "," */) {
 			if (la->kind == 169 /* "," */) {
 				Get();
@@ -244,7 +244,7 @@ void Parser::ExprList(AST::expr_list &expr_list) {
 				} else SynErr(176);
 			}
 			Expr(expr);
-			expr_list._exprs << expr; 
+			AST::moveAppend(expr_list._exprs, expr); 
 		}
 }
 
@@ -254,7 +254,7 @@ void Parser::Expr(AST::expr &expr) {
 		while (StartOf(2)) {
 			RelOp(binary._op);
 			SimExpr(right);
-			binary._left = expr; binary._right = right; expr._expr = binary; 
+			binary._left = std::move(expr); binary._right = std::move(right); expr._expr = std::move(binary); 
 		}
 }
 
@@ -264,7 +264,7 @@ void Parser::SimExpr(AST::expr &expr) {
 		while (StartOf(3)) {
 			AddOp(binary._op);
 			Term(right);
-			binary._left = expr; binary._right = right; expr._expr = binary; 
+			binary._left = std::move(expr); binary._right = std::move(right); expr._expr = std::move(binary); 
 		}
 }
 
@@ -320,7 +320,7 @@ void Parser::Term(AST::expr &expr) {
 		while (StartOf(4)) {
 			MulOp(binary._op);
 			Term2(right);
-			binary._left = expr; binary._right = right; expr._expr = binary; 
+			binary._left = std::move(expr); binary._right = std::move(right); expr._expr = std::move(binary); 
 		}
 }
 
@@ -366,7 +366,7 @@ void Parser::Term2(AST::expr &expr) {
 		while (StartOf(5)) {
 			BinaryOp(binary._op);
 			SimpleExpr(right);
-			binary._left = expr; binary._right = right; expr._expr = binary; 
+			binary._left = std::move(expr); binary._right = std::move(right); expr._expr = std::move(binary); 
 		}
 }
 
@@ -421,11 +421,11 @@ void Parser::SimpleExpr(AST::expr &expr) {
 		if (la->kind == _PLUS) {
 			Get();
 			PrimaryExprWrap(unary._expr);
-			unary._op = BytecodeVM::UPLUS; expr._expr = unary;  
+			unary._op = BytecodeVM::UPLUS; expr._expr = std::move(unary);  
 		} else if (la->kind == _MINUS) {
 			Get();
 			PrimaryExprWrap(unary._expr);
-			unary._op = BytecodeVM::UMINUS;expr._expr = unary;  
+			unary._op = BytecodeVM::UMINUS;expr._expr = std::move(unary);  
 		} else if (la->kind == _NOT || la->kind == _C_NOT) {
 			if (la->kind == _NOT) {
 				Get();
@@ -433,11 +433,11 @@ void Parser::SimpleExpr(AST::expr &expr) {
 				Get();
 			}
 			PrimaryExprWrap(unary._expr);
-			unary._op = BytecodeVM::UNOT;expr._expr = unary;  
+			unary._op = BytecodeVM::UNOT;expr._expr = std::move(unary);  
 		} else if (la->kind == 167 /* "~" */) {
 			Get();
 			PrimaryExprWrap(unary._expr);
-			unary._op = BytecodeVM::UINV;expr._expr = unary;  
+			unary._op = BytecodeVM::UINV;expr._expr = std::move(unary);  
 		} else if (StartOf(6)) {
 			PrimaryExprWrap(expr);
 		} else SynErr(180);
@@ -462,7 +462,7 @@ void Parser::BinaryOp(BytecodeVM::BinOp &op) {
 void Parser::PrimaryExprWrap(AST::expr &expr) {
 		AST::primary primary; 
 		PrimaryExpr(primary);
-		expr._expr = primary; 
+		expr._expr = std::move(primary); 
 }
 
 void Parser::PrimaryExpr(AST::primary &primary) {
@@ -474,28 +474,28 @@ void Parser::PrimaryExpr(AST::primary &primary) {
 			Get();
 			ExprList(expr_list);
 			Expect(_CLOSEPAR);
-			primary._expr=expr_list;   
+			primary._expr=std::move(expr_list);   
 		} else if (StartOf(7)) {
 			AST::internalexpr internalexpr(cur()); 
 			Internalexpr(internalexpr);
-			primary._expr=internalexpr; 
+			primary._expr=std::move(internalexpr); 
 		} else if (StartOf(8)) {
 			Constant(constant);
-			primary._expr=constant; 
+			primary._expr=std::move(constant); 
 		} else if (StartOf(1)) {
 			Ident(ident);
-			primary._expr=ident;  
+			primary._expr=std::move(ident);  
 			while (StartOf(9)) {
 				AST::primary_accessor primary_accessor(cur()); 
 				Primary_accessor(primary_accessor);
-				primary._accessors << primary_accessor; 
+				AST::moveAppend(primary._accessors, primary_accessor); 
 			}
 		} else if (la->kind == 168 /* "@" */) {
 			Get();
 			PrimaryExpr(primary);
 			AST::primary_accessor primary_accessor(cur());
 			primary_accessor._primary_accessor =  AST::address_expr();
-			primary._accessors << primary_accessor;
+			AST::moveAppend(primary._accessors, primary_accessor);
 			
 		} else SynErr(182);
 }
@@ -664,21 +664,21 @@ void Parser::Primary_accessor(AST::primary_accessor &primary_accessor) {
 			Get();
 			ExprList(idx_expr._indexes);
 			Expect(166 /* "]" */);
-			primary_accessor._primary_accessor = idx_expr; 
+			primary_accessor._primary_accessor = std::move(idx_expr); 
 		} else if (la->kind == _dot) {
 			Get();
 			IdentRW(access_expr._field);
-			primary_accessor._primary_accessor = access_expr; 
+			primary_accessor._primary_accessor = std::move(access_expr); 
 		} else if (la->kind == _CIRCUM) {
 			Get();
-			primary_accessor._primary_accessor = deref_expr; 
+			primary_accessor._primary_accessor = std::move(deref_expr); 
 		} else if (la->kind == _OPENPAR) {
 			Get();
 			if (StartOf(10)) {
 				ExprList(call_expr._args);
 			}
 			Expect(_CLOSEPAR);
-			primary_accessor._primary_accessor = call_expr; 
+			primary_accessor._primary_accessor = std::move(call_expr); 
 		} else SynErr(184);
 }
 
@@ -692,13 +692,13 @@ void Parser::Sequence(AST::sequence &sequence) {
 		AST::statement statement(cur());  
 		Statement(statement);
 		if (statement._statement.which()) // may be empty Statement.
-		   sequence._statements << statement;
+		   AST::moveAppend(sequence._statements, statement);
 		
 		while (la->kind == _semicol) {
 			Get();
 			Statement(statement);
 			if (statement._statement.which()) // may be empty Statement.
-			  sequence._statements << statement;  
+			  AST::moveAppend(sequence._statements, statement);  
 		}
 }
 
@@ -708,79 +708,80 @@ void Parser::Statement(AST::statement &statement) {
 			if (IsLabelSt()) {
 				AST::labelst labelst(cur());  
 				Labelst(labelst);
-				statement._statement = labelst; 
+				statement._statement = std::move(labelst); 
 			} else if (IsAssignment()) {
 				AST::assignmentst assignmentst(cur()); 
 				Assignmentst(assignmentst);
-				statement._statement = assignmentst; 
+				statement._statement = std::move(assignmentst); 
 			} else if (StartOf(6)) {
 				AST::procst procst(cur());  
 				Procst(procst);
-				statement._statement = procst; 
+				statement._statement = std::move(procst); 
 			} else if (la->kind == _BEGIN) {
 				AST::compoundst compoundst(cur());  
 				Compoundst(compoundst);
-				statement._statement = compoundst; 
+				statement._statement = std::move(compoundst); 
 			} else if (la->kind == _GOTO) {
 				AST::gotost gotost(cur());  
 				Gotost(gotost);
-				statement._statement = gotost; 
+				statement._statement = std::move(gotost); 
 			} else if (la->kind == _CASE) {
 				AST::switchst switchst(cur());  
 				Switchst(switchst);
-				statement._statement = switchst; 
+				statement._statement = std::move(switchst); 
 			} else if (la->kind == _IF_) {
-				AST::ifst ifst(cur());  
+				statement._statement = AST::ifst(cur());
+				// parsed in place: moving recursive_wrapper moves whole "else if" chain.
+				AST::ifst& ifst = boost::get<AST::ifst>(statement._statement);  
 				Ifst(ifst);
-				statement._statement = ifst; 
 			} else if (la->kind == _FOR) {
 				AST::forst forst(cur());  
 				Forst(forst);
-				statement._statement = forst; 
+				statement._statement = std::move(forst); 
 			} else if (la->kind == _WHILE) {
 				AST::whilest whilest(cur());  
 				Whilest(whilest);
-				statement._statement = whilest; 
+				statement._statement = std::move(whilest); 
 			} else if (la->kind == _REPEAT) {
 				AST::repeatst repeatst(cur());  
 				Repeatst(repeatst);
-				statement._statement = repeatst; 
+				statement._statement = std::move(repeatst); 
 			} else if (la->kind == _WITH) {
 				AST::withst withst(cur());  
 				Withst(withst);
-				statement._statement = withst; 
+				statement._statement = std::move(withst); 
 			} else if (la->kind == _TRY) {
 				AST::tryst tryst(cur());  
 				Tryst(tryst);
-				statement._statement = tryst; 
+				statement._statement = std::move(tryst); 
 			} else if (la->kind == _RAISE_) {
 				AST::raisest raisest(cur());  
 				Raisest(raisest);
-				statement._statement = raisest; 
+				statement._statement = std::move(raisest); 
 			} else if (la->kind == _INHERITED) {
 				AST::inheritedst inheritedst(cur());  
 				Inheritedst(inheritedst);
-				statement._statement = inheritedst; 
+				statement._statement = std::move(inheritedst); 
 			} else if (la->kind == _READ || la->kind == _READLN) {
 				AST::readst readst(cur());  
 				Readst(readst);
-				statement._statement = readst; 
+				statement._statement = std::move(readst); 
 			} else if (la->kind == _WRITE || la->kind == _WRITELN) {
 				AST::writest writest(cur());  
 				Writest(writest);
-				statement._statement = writest; 
+				statement._statement = std::move(writest); 
 			} else if (la->kind == _STR) {
 				AST::strst strst(cur());  
 				Strst(strst);
-				statement._statement = strst; 
+				statement._statement = std::move(strst); 
 			} else if (la->kind == _ON) {
 				AST::onst onst(cur());  
 				Onst(onst);
-				statement._statement = onst; 
+				statement._statement = std::move(onst); 
 			} else {
 				AST::internalfst internalfst(cur());  
 				Internalfst(internalfst);
-				statement._statement = internalfst; 
+				statement._statement = std::move(internalfst); 
 			}
 		}
 }
@@ -839,11 +840,11 @@ void Parser::Ifst(AST::ifst &ifst) {
 			Expr(ifst._expr);
 			Expect(_THEN);
 			Sequence(cif._sequence);
-			ifst._if._statement = cif;  
+			ifst._if._statement = std::move(cif);  
 			if (la->kind == _ELSE) {
 				Get();
 				Sequence(celse._sequence);
-				ifst._else._statement = celse;  
+				ifst._else._statement = std::move(celse);  
 			}
 			Expect(_END_IF);
 		} else if (la->kind == _IF_) {
@@ -874,7 +875,7 @@ void Parser::Forst(AST::forst &forst) {
 		Expect(_DO);
 		if (StSemantic()) {
 			Sequence(body._sequence);
-			forst._statement._statement = body;  
+			forst._statement._statement = std::move(body);  
 			Expect(_END_FOR);
 		} else if (StartOf(12)) {
 			Statement(forst._statement);
@@ -888,7 +889,7 @@ void Parser::Whilest(AST::whilest &whilest) {
 		Expect(_DO);
 		if (StSemantic()) {
 			Sequence(body._sequence);
-			whilest._statement._statement = body;  
+			whilest._statement._statement = std::move(body);  
 			Expect(_END_WHILE);
 		} else if (StartOf(12)) {
 			Statement(whilest._statement);
@@ -1016,12 +1017,12 @@ void Parser::Internalfst(AST::internalfst &internalfst) {
 void Parser::Case_list(AST::case_list &case_list) {
 		AST::case_list_elem case_list_elem(cur()); 
 		Case_list_elem(case_list_elem);
-		case_list << case_list_elem; 
+		AST::moveAppend(case_list, case_list_elem); 
 		while (la->kind == _semicol) {
 			Get();
 			if (StartOf(10)) {
 				Case_list_elem(case_list_elem);
-				case_list << case_list_elem; 
+				AST::moveAppend(case_list, case_list_elem); 
 			}
 		}
 }
@@ -1050,61 +1051,61 @@ void Parser::Type(AST::type &type) {
 		case _ident: case _DIV: case _IN: case _MOD: case _SHL: case _SHR: {
 			AST::simple_type simple_type(cur()); 
 			Simple_type(simple_type);
-			type._type = simple_type; 
+			type._type = std::move(simple_type); 
 			break;
 		}
 		case _ARRAY: {
 			AST::array_type array_type(cur()); 
 			Array_type(array_type);
-			type._type = array_type; 
+			type._type = std::move(array_type); 
 			break;
 		}
 		case _RECORD: {
 			AST::class_type class_type(cur()); 
 			Record_type(class_type);
-			type._type = class_type; 
+			type._type = std::move(class_type); 
 			break;
 		}
 		case _SET: {
 			AST::set_type set_type(cur()); 
 			Set_type(set_type);
-			type._type = set_type; 
+			type._type = std::move(set_type); 
 			break;
 		}
 		case _FILE: {
 			AST::file_type file_type(cur()); 
 			File_type(file_type);
-			type._type = file_type; 
+			type._type = std::move(file_type); 
 			break;
 		}
 		case _CIRCUM: {
 			AST::pointer_type pointer_type(cur()); 
 			Pointer_type(pointer_type);
-			type._type = pointer_type; 
+			type._type = std::move(pointer_type); 
 			break;
 		}
 		case 165 /* "[" */: {
 			AST::subrange_type subrange_type(cur()); 
 			Subrange_type(subrange_type);
-			type._type = subrange_type; 
+			type._type = std::move(subrange_type); 
 			break;
 		}
 		case _OPENPAR: {
 			AST::enum_type enum_type(cur()); 
 			Enum_type(enum_type);
-			type._type = enum_type; 
+			type._type = std::move(enum_type); 
 			break;
 		}
 		case _FUNCTION: case _PROCEDURE: {
 			AST::function_type function_type(cur()); 
 			Function_type(function_type);
-			type._type = function_type; 
+			type._type = std::move(function_type); 
 			break;
 		}
 		case _CLASS: {
 			AST::class_type class_type(cur()); 
 			Class_type(class_type);
-			type._type = class_type; 
+			type._type = std::move(class_type); 
 			break;
 		}
 		default: SynErr(193); break;
@@ -1278,7 +1279,7 @@ void Parser::Decl_part(AST::decl_part& decl_part) {
 		} else if (StartOf(13)) {
 			AST::proc_def proc_def(cur()); 
 			Proc_def(proc_def);
-			decl_part._decl_part = proc_def; 
+			decl_part._decl_part = std::move(proc_def); 
 		} else SynErr(195);
 }
 
@@ -1287,23 +1288,23 @@ void Parser::Decl_part_common(AST::decl_part& decl_part) {
 		if (la->kind == _LABEL) {
 			AST::label_decl_part label_decl_part(cur()); 
 			Label_decl_part(label_decl_part);
-			decl_part._decl_part = label_decl_part; 
+			decl_part._decl_part = std::move(label_decl_part); 
 		} else if (la->kind == _CONST) {
 			AST::const_def_part const_def_part(cur()); 
 			Const_def_part(const_def_part);
-			decl_part._decl_part = const_def_part; 
+			decl_part._decl_part = std::move(const_def_part); 
 		} else if (la->kind == _TYPE) {
 			AST::type_def_part type_def_part(cur()); 
 			Type_def_part(type_def_part);
-			decl_part._decl_part = type_def_part; 
+			decl_part._decl_part = std::move(type_def_part); 
 		} else if (la->kind == _VAR) {
 			AST::var_decl_part var_decl_part(cur()); 
 			Var_decl_part(var_decl_part);
-			decl_part._decl_part = var_decl_part; 
+			decl_part._decl_part = std::move(var_decl_part); 
 		} else if (la->kind == _USES) {
 			AST::uses_part uses_part(cur()); 
 			Uses_part(uses_part);
-			decl_part._decl_part = uses_part; 
+			decl_part._decl_part = std::move(uses_part); 
 		} else SynErr(196);
 }
 
@@ -1329,7 +1330,7 @@ void Parser::Decl_part_forward(AST::decl_part& decl_part) {
 		} else if (StartOf(13)) {
 			AST::proc_def proc_def(cur()); 
 			Proc_def_forward(proc_def);
-			decl_part._decl_part = proc_def; 
+			decl_part._decl_part = std::move(proc_def); 
 		} else SynErr(198);
 }
 
@@ -1407,20 +1408,20 @@ void Parser::Type_def(AST::type_def &type_def) {
 void Parser::Decl_part_list(AST::decl_part_list& decl_part_list) {
 		AST::decl_part decl_part(cur()); 
 		Decl_part(decl_part);
-		decl_part_list._parts << decl_part;  
+		AST::moveAppend(decl_part_list._parts, decl_part);  
 		while (StartOf(16)) {
 			Decl_part(decl_part);
-			decl_part_list._parts << decl_part;  
+			AST::moveAppend(decl_part_list._parts, decl_part);  
 		}
 }
 
 void Parser::Decl_part_list_forward(AST::decl_part_list& decl_part_list) {
 		AST::decl_part decl_part(cur()); 
 		Decl_part_forward(decl_part);
-		decl_part_list._parts << decl_part;  
+		AST::moveAppend(decl_part_list._parts, decl_part);  
 		while (StartOf(16)) {
 			Decl_part_forward(decl_part);
-			decl_part_list._parts << decl_part;  
+			AST::moveAppend(decl_part_list._parts, decl_part);  
 		}
 }
 
@@ -1532,11 +1533,11 @@ void Parser::Formal_param(AST::formal_param &formal_param) {
 			}
 			AST::var_decl var_decl(cur());  
 			Var_decl(var_decl);
-			formal_param._formal_param = var_decl; 
+			formal_param._formal_param = std::move(var_decl); 
 		} else if (StartOf(13)) {
 			AST::proc_decl proc_decl(cur()); 
 			Proc_decl(proc_decl);
-			formal_param._formal_param = proc_decl; 
+			formal_param._formal_param = std::move(proc_decl); 
 		} else SynErr(201);
 }
 
@@ -1544,17 +1545,17 @@ void Parser::Pascal() {
 		_pascal = AST::pascalSource();AST::stProgram stProgram(cur()); 
 		if (StSemantic()) {
 			StProgram(stProgram);
-			_pascal._pascal = stProgram; 
+			_pascal._pascal = std::move(stProgram); 
 		} else if (la->kind == _PROGRAM) {
 			AST::program program(cur()); 
 			Program(program);
 			Expect(_dot);
-			_pascal._pascal = program; 
+			_pascal._pascal = std::move(program); 
 		} else if (la->kind == _UNIT) {
 			AST::unit unit(cur()); 
 			Unit(unit);
 			Expect(_dot);
-			_pascal._pascal = unit; 
+			_pascal._pascal = std::move(unit); 
 		} else SynErr(202);
 }
 
@@ -1617,10 +1618,10 @@ void Parser::Unit(AST::unit& unit) {
 void Parser::StDecl_part_list(AST::decl_part_list& decl_part_list) {
 		AST::decl_part decl_part(cur()); 
 		StDecl_part(decl_part);
-		decl_part_list._parts << decl_part;  
+		AST::moveAppend(decl_part_list._parts, decl_part);  
 		while (la->kind == _FUNCTION || la->kind == _TYPE || la->kind == _FUNCTION_BLOCK) {
 			StDecl_part(decl_part);
-			decl_part_list._parts << decl_part;  
+			AST::moveAppend(decl_part_list._parts, decl_part);  
 		}
 }
 
@@ -1670,7 +1671,7 @@ void Parser::StVarDecl(AST::decl_parts& decl_parts) {
 		}
 		
 		Expect(_END_VAR);
-		decl_part._decl_part = var_decl_part;
+		decl_part._decl_part = std::move(var_decl_part);
 		decl_parts << decl_part;    
 }
 
@@ -1695,12 +1696,12 @@ void Parser::StParamDecl(AST::formal_params& formal_params) {
 		}
 		Var_decl(var_decl);
 		Expect(_semicol);
-		formal_param._formal_param = var_decl;
+		formal_param._formal_param = std::move(var_decl);
 		formal_params << formal_param;    
 		while (StartOf(1)) {
 			Var_decl(var_decl);
 			Expect(_semicol);
-			formal_param._formal_param = var_decl;
+			formal_param._formal_param = std::move(var_decl);
 			formal_params << formal_param;    
 		}
 		Expect(_END_VAR);
@@ -1711,19 +1712,19 @@ void Parser::StType(AST::type &type) {
 		if (StartOf(1)) {
 			AST::simple_type simple_type(cur()); 
 			Simple_type(simple_type);
-			type._type = simple_type; 
+			type._type = std::move(simple_type); 
 		} else if (la->kind == _ARRAY) {
 			AST::array_type array_type(cur()); 
 			Array_type(array_type);
-			type._type = array_type; 
+			type._type = std::move(array_type); 
 		} else if (la->kind == _RECORD) {
 			AST::class_type class_type(cur()); 
 			StRecord_type(class_type);
-			type._type = class_type; 
+			type._type = std::move(class_type); 
 		} else if (la->kind == _CLASS) {
 			AST::class_type class_type(cur()); 
 			StClass_type(class_type);
-			type._type = class_type; 
+			type._type = std::move(class_type); 
 		} else SynErr(205);
 }
 
@@ -1805,11 +1806,11 @@ void Parser::StDecl_part(AST::decl_part& decl_part) {
 		if (la->kind == _TYPE) {
 			AST::type_def_part type_def_part(cur()); 
 			StType_def_part(type_def_part);
-			decl_part._decl_part = type_def_part; 
+			decl_part._decl_part = std::move(type_def_part); 
 		} else if (la->kind == _FUNCTION || la->kind == _FUNCTION_BLOCK) {
 			AST::proc_def proc_def(cur()); 
 			StProc_def(proc_def);
-			decl_part._decl_part = proc_def; 
+			decl_part._decl_part = std::move(proc_def); 
 		} else SynErr(207);
 }
 
@@ -2194,7 +2195,7 @@ void Parser::SynErr(int n) {
             }
             break;
         }
-        errors->Error(la->line, la->col, s);
+        errors->Error(cur(), QString::fromWCharArray(s));
         coco_string_delete(s);
     }
     errDist = 0;
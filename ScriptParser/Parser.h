@@ -242,7 +242,7 @@ AST::pascalSource   _pascal;
     int _currentFile;
 
     void Err(wchar_t* msg) {
-        errors->Error(la->line, la->col, msg);
+        errors->Error(cur(), QString::fromWCharArray(msg));
     }
 
     bool IsLabelSt() {
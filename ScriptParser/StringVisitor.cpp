@@ -71,6 +71,14 @@ QString StringVisitor::operator()(const AST::ident &val) const
 		r["nil"]="NULL";
 		return r;
 	}();
+	if (_flags & fNativeModule){
+		// bindings are emitted in lowercase, Pascal identifiers are case insensitive.
+		const QString lowerIdent = val._ident.toLower();
+		if (_nativeVars.contains(lowerIdent) || _nativeFunctions.contains(lowerIdent))
+			return lowerIdent;
+		if (_nativeUnsupported.contains(lowerIdent))
+			_nativeRejected << val;
+	}
 	if (_type == otC){
 		QString lowerIdent = val._ident.toLower();
 		if (lowerToReal.contains(lowerIdent)){
@@ -668,7 +676,9 @@ QString StringVisitor::operator ()(const AST::const_def_part &val) const
 		QString typexpr;
 		if (i._type._type.which())
 			typexpr = ":" + (*this)(i._type) ;
-		parts << idn() + (_type == otC ? "const auto " : "") + (*this)(i._ident) + " = " + (*this)(i._initializer);
+		// native module declarations are members of program object, where only static constants may be deduced.
+		const QString cConst = _flags & fNativeModule ? "static constexpr auto " : "const auto ";
+		parts << idn() + (_type == otC ? cConst : "") + (*this)(i._ident) + " = " + (*this)(i._initializer);
 	}
 	_level--;
 	QString v = _type == otC ? "" : "CONST \r\n";
@@ -700,6 +710,8 @@ QString StringVisitor::operator ()(const AST::var_decl_part &val) const
 
 QString StringVisitor::operator ()(const AST::proc_def &val) const
 {
+	if (_type == otC && (_flags & fNativeModule) && val._isForward)
+		return QString(); // member functions see each other without prototypes.
 	QString ret=  idn() + (*this)(val._proc_decl) ;
 	if (!val._isForward){
 
@@ -818,13 +830,18 @@ QString StringVisitor::operator()(const AST::program &val) const
 				"#define Low(x) 0   \r\n"
 				"#define High(x) (sizeof(x)/sizeof(x[0])-1) \r\n"
 				"#define Inc(x) ++x \r\n"
+				"#define New(x) x = new std::remove_pointer<decltype(x)>::type() \r\n"
+				"#define Dispose(x) delete x \r\n"
 				"#define WRITELN(x) std::cout << x << std::endl \r\n"
 				"#define sqr(x) ((x) * (x)) \r\n"
 				"#include <cmath> \r\n"
 				"#include <iostream> \r\n"
+				"#include <type_traits> \r\n"
 				;
 		QString decls = (*this)(val._block._decl_part_list);
 		QString st = (*this)(val._block._compoundst);
+		if (_flags & fNativeModule)
+			return nativeModule(decls, st);
 
 		return QString("%1\r\n%2\r\n int main()\r\n%3\r\n").arg(commonDefines).arg(decls).arg(st);
 	}
@@ -833,6 +850,134 @@ QString StringVisitor::operator()(const AST::program &val) const
 			.arg((*this)(val._block));
 }
 
+// Shared library for ScriptVM::loadNativeModule. ABI declaration must match ScriptRuntime/NativeModule.h.
+// Program is member of PascalProgram, created by every call of entry: runs do not see globals of previous ones,
+// and VMs may run same module at once.
+QString StringVisitor::nativeModule(const QString &decls, const QString &body) const
+{
+	QStringList out;
+	out << "#define Low(x) 0"
+		<< "#define High(x) (sizeof(x)/sizeof(x[0])-1)"
+		<< "#define Inc(x) ++x"
+		<< "#define WRITELN(...) pascal_writeln(__VA_ARGS__)"
+		<< "#define WRITE(...) pascal_write(__VA_ARGS__)"
+		<< "#include <cmath>"
+		<< "#include <memory>"
+		<< "#include <sstream>"
+		<< "#include <stdint.h>"
+		<< "#include <type_traits>"
+		<< ""
+		<< "extern \"C\" {"
+		<< "struct PascalNativeValue"
+		<< "{"
+		<< "    int isFloat;"
+		<< "    int64_t i;"
+		<< "    double d;"
+		<< "};"
+		<< "struct PascalNativeAbi"
+		<< "{"
+		<< "    int version;"
+		<< "    void* vm;"
+		<< "    int  (*getVar)(void* vm, const char* name, PascalNativeValue* value);"
+		<< "    int  (*setVar)(void* vm, const char* name, const PascalNativeValue* value);"
+		<< "    int  (*call)(void* vm, const char* name, PascalNativeValue* results, int resultCount, const PascalNativeValue* args, int argCount);"
+		<< "    void (*write)(void* vm, const char* text);"
+		<< "};"
+		<< "}"
+		<< ""
+		<< "template<typename T>"
+		<< "PascalNativeValue pascal_value(T x)"
+		<< "{"
+		<< "    PascalNativeValue v;"
+		<< "    v.isFloat = std::is_floating_point<T>::value;"
+		<< "    v.i = v.isFloat ? 0 : int64_t(x);"
+		<< "    v.d = v.isFloat ? double(x) : 0.0;"
+		<< "    return v;"
+		<< "}"
+		<< "template<typename T>"
+		<< "T pascal_get(const PascalNativeValue& v)"
+		<< "{"
+		<< "    return v.isFloat ? T(v.d) : T(v.i);"
+		<< "}"
+		<< ""
+		<< "struct PascalProgram"
+		<< "{"
+		<< "PascalNativeAbi* pascal_abi = nullptr;"
+		<< ""
+		<< "template<typename... Args>"
+		<< "void pascal_write(const Args&... args)"
+		<< "{"
+		<< "    std::ostringstream os;"
+		<< "    os.precision(15);"
+		<< "    using expander = int[];"
+		<< "    (void)expander{0, (void(os << args << ' '), 0)...};"
+		<< "    pascal_abi->write(pascal_abi->vm, os.str().c_str());"
+		<< "}"
+		<< "template<typename... Args>"
+		<< "void pascal_writeln(const Args&... args)"
+		<< "{"
+		<< "    pascal_write(args...);"
+		<< "    pascal_abi->write(pascal_abi->vm, \"\\n\");"
+		<< "}"
+		<< "";
+
+	foreach (const QString& name, _nativeVars.keys())
+		out << QString("%1 %2 = 0;").arg(_nativeVars[name]).arg(name);
+
+	foreach (const QString& name, _nativeFunctions.keys())
+	{
+		const NativeFunction& f = _nativeFunctions[name];
+		const bool hasResult = !f.resultType.isEmpty();
+		QStringList params, args;
+		for (int i = 0; i < f.argTypes.size(); i++)
+		{
+			params << QString("%1 a%2").arg(f.argTypes[i]).arg(i);
+			args << QString("pascal_value(a%1)").arg(i);
+		}
+		args << "PascalNativeValue()";
+		out << QString("%1 %2(%3)").arg(hasResult ? f.resultType : "void").arg(name).arg(params.join(", "))
+			<< "{";
+		if (!f.body.isEmpty())
+		{
+			out << QString("    return %1;").arg(f.body)
+				<< "}";
+			continue;
+		}
+		out << QString("    const PascalNativeValue args[] = { %1 };").arg(args.join(", "))
+			<< "    PascalNativeValue result = PascalNativeValue();"
+			<< QString("    pascal_abi->call(pascal_abi->vm, \"%1\", &result, %2, args, %3);").arg(name).arg(hasResult ? 1 : 0).arg(f.argTypes.size())
+			<< (hasResult ? QString("    return pascal_get<%1>(result);").arg(f.resultType) : QString())
+			<< "}";
+	}
+
+	out << decls
+		<< "void pascal_program()"
+		<< body
+		<< "};"
+		<< ""
+		<< "extern \"C\""
+		<< "#ifdef _WIN32"
+		<< "__declspec(dllexport)"
+		<< "#endif"
+		<< "int pascal_native_main(PascalNativeAbi* abi)"
+		<< "{"
+		<< "    if (abi->version != 2)"
+		<< "        return -1;"
+		<< "    std::unique_ptr<PascalProgram> program(new PascalProgram());"
+		<< "    program->pascal_abi = abi;"
+		<< "    PascalNativeValue value;";
+	foreach (const QString& name, _nativeVars.keys())
+		out << QString("    if (abi->getVar(abi->vm, \"%1\", &value)) program->%1 = pascal_get<%2>(value);").arg(name).arg(_nativeVars[name]);
+	out << "    program->pascal_program();";
+	foreach (const QString& name, _nativeVars.keys())
+		out << QString("    value = pascal_value(program->%1);").arg(name)
+			<< QString("    abi->setVar(abi->vm, \"%1\", &value);").arg(name);
+	out << "    return 0;"
+		<< "}"
+		<< "";
+	return out.join("\r\n");
+}
+
 QString StringVisitor::operator ()(const AST::stProgram &val) const
 {
 	QStringList parts;
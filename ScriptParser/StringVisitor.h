@@ -29,6 +29,22 @@ class StringVisitor : public boost::static_visitor<QString>
 public:
 	QMap<AST::CodeLocation, RefType> _codeTypes;
 	enum OutType { otPascal, otC };
+	enum Flags { fNone = 0, fNativeModule = 1 << 0 };
+
+	/// Function callable from native module, types are C types of arguments and result.
+	struct NativeFunction {
+		QStringList argTypes;
+		QString resultType;    //!< empty for procedure.
+		QString body;          //!< expression of arguments a0..aN; empty: host function, called through PascalNativeAbi.
+	};
+	/// fNativeModule: external variables (name -> C type), copied in before program and out after it.
+	QMap<QString, QString> _nativeVars;
+	/// fNativeModule: host functions and standard library functions implemented in module, lowercase names.
+	QMap<QString, NativeFunction> _nativeFunctions;
+	/// fNativeModule: bindings that can not be passed to module (lowercase name -> reason).
+	QMap<QString, QString> _nativeUnsupported;
+	/// fNativeModule: references to _nativeUnsupported found in program.
+	mutable QList<AST::ident> _nativeRejected;
 	StringVisitor(OutType type = otPascal, int flags = 0)  : _level(0),_type(type),_flags(flags) {}
 
 	// primitives
@@ -128,6 +144,8 @@ private:
 	mutable QString _typeSuffix;
 	int _flags;
 
+	QString nativeModule(const QString &decls, const QString &body) const;
+
 	inline QString idn() const { return QString("    ").repeated(_level);}
 	inline QString kw(const QString & k) const { return _type == otC ? k.toLower() : k;}
 };
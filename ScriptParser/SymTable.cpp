@@ -24,6 +24,7 @@
 BlockScope::BlockScope()
 	: _parent(nullptr)
 	, _nextMemoryAddress(0)
+	, _visibleObjects(-1)
 {
 }
 
@@ -74,6 +75,8 @@ NamedObj *BlockScope::findObj(const QString &objName, NamedObj::ObjType objType)
 {
 	int varIndex = _objectsNames.value(objName.toLower(), -1);
 	NamedObj* obj = _objects.value(varIndex);
+	if (obj && _visibleObjects >= 0 && varIndex >= _visibleObjects)
+		return nullptr; // declared after procedure which body is compiled now.
 	if (objType != NamedObj::tNone) {
 		if (obj && obj->getObjType() != objType)
 			return nullptr;
@@ -93,6 +96,18 @@ void BlockScope::registerObject(NamedObj *obj)
 	_objects.append(obj);
 }
 
+int BlockScope::getVisibleObjects() const
+{
+	return _visibleObjects < 0 ? _objects.size() : _visibleObjects;
+}
+
+int BlockScope::setVisibleObjects(int count)
+{
+	int previous = _visibleObjects;
+	_visibleObjects = count;
+	return previous;
+}
+
 
 QStringList BlockScope::debug() const
 {
@@ -105,6 +120,7 @@ void BlockScope::clear()
 	_objects.clear();
 	_objectsNames.clear();
 	_nextMemoryAddress = 0;
+	_visibleObjects = -1;
 }
 
 int BlockScope::getNextMemoryAddress() const
@@ -182,6 +198,7 @@ QStringList BlockScope::getVariablesNames(NamedObj::AccessModifier am) const
 BlockScope::BlockScope(BlockScope *parent)
 	: _parent(parent)
 	, _nextMemoryAddress(0)
+	, _visibleObjects(-1)
 {
 	assert(parent);
 }
@@ -523,6 +540,22 @@ void SymTable::closeScope ()
 	_currentScope = _scopeStack.takeLast();
 }
 
+SymTable::Visibility SymTable::getVisibility(BlockScope *scope) const
+{
+	Visibility ret;
+	for (; scope; scope = scope->getParent())
+		ret << qMakePair(scope, scope->getVisibleObjects());
+	return ret;
+}
+
+SymTable::Visibility SymTable::setVisibility(const Visibility &visibility)
+{
+	Visibility previous;
+	for (int i = 0; i < visibility.size(); i++)
+		previous << qMakePair(visibility[i].first, visibility[i].first->setVisibleObjects(visibility[i].second));
+	return previous;
+}
+
 void SymTable::debug()
 {
 	QStringList d;
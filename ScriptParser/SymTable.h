@@ -47,6 +47,8 @@ public:
 	NamedObj*           findObj(const QString &objName, NamedObj::ObjType objType = NamedObj::tNone) const;
 	void                registerVariable(VarObj *varPtr);
 	void                registerObject(NamedObj *obj);
+	int                 getVisibleObjects() const;
+	int                 setVisibleObjects(int count);
 	QStringList         debug() const;
 	void                clear();
 
@@ -72,6 +74,7 @@ private:
 
 	QList<NamedObj*>    _objects;
 	QHash<QString, int> _objectsNames;
+	int                 _visibleObjects;    //!< objects from this index are not found; -1 - all.
 
 };
 
@@ -116,6 +119,12 @@ public:
 	NamedObj*           findObj(const QString &name, BlockScope *workingScope = nullptr);
 	void                openScope (BlockScope *forceScope = nullptr);
 	void                closeScope ();
+
+	/// Visible object count of scope and its parents; body compiled after its section sees only names declared before procedure.
+	typedef QList<QPair<BlockScope*, int> > Visibility;
+	Visibility          getVisibility(BlockScope *scope) const;
+	/// Returns previous visibility of same scopes, to be restored after body.
+	Visibility          setVisibility(const Visibility &visibility);
 	void                debug();
 	const ClassObj*     getVarClass(const QString &varName);
 
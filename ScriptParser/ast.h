@@ -16,6 +16,7 @@
 #include <QMap>
 #include <boost/variant.hpp>
 #include <boost/optional.hpp>
+#include <utility>
 #include <BytecodeVM.h>
 
 #define AST_CONSTRUCT(clas) clas():_node(CodeLocation()) {} \
@@ -103,6 +104,9 @@ struct _node {
 
 	virtual void serialize(TreeVariant& data, SerializationDirection direction);
 };
+/// Appends node to list without copying its subtree. Value is left empty; parser rules fill reused nodes anew.
+template<class T>
+inline void moveAppend(QList<T>& list, T& value) { list.append(T()); list.last() = std::move(value); }
 
 // Forward declarations.
 struct type;
@@ -56,9 +56,13 @@ std::string BytecodeVM::ConvertToString(bool useType) const
 		if (s > 1){
 			ret << " size " << s;
 		}
+	}else if (op == ALLOC) {
+		ret << " size:" << values[0].getValue<int>();
 	}else if (op == REFEXT || op == REFST) {
 		int t0 = values[0].getValue<int>();
 		ret << " ["<< t0<< "]";
+	}else if (op == PUSHC) {
+		ret << " [" << values[0].getValue<int>() << "] *" << values[1].getValue<int>();
 	}else if (op == PUSH) {
 		int t1 = values[1].getValue<int>();
 		ret << " (" << values[0].getString(useType) << ")";
@@ -117,12 +121,6 @@ std::string BytecodeVM::ConvertToString(bool useType) const
 		if (offset)
 			ret << ", low:" << offset;
 	}
-	if (useType){
-		if (gotoLabel.size())
-			ret << " GOTO " <<  gotoLabel << ";";
-		if (symbolLabel.size())
-			ret << " @<- " << symbolLabel << "; ";
-	}
 	return ret.str();
 }
 
@@ -153,6 +151,93 @@ ByteOrderDataStreamReader &operator >>(ByteOrderDataStreamReader &ifs, BytecodeV
 
 	return ifs;
 }
+
+void BytecodeDebugInfo::clear()
+{
+	lines.clear();
+	symbols.clear();
+}
+
+void BytecodeDebugInfo::addLocation(uint32_t pc, const Location &loc)
+{
+	if (!lines.empty() && lines.back().loc == loc)
+		return;
+	if (!lines.empty() && lines.back().pc == pc)
+	{
+		lines.back().loc = loc;
+		return;
+	}
+	lines.push_back(LineRow{pc, loc});
+}
+
+BytecodeDebugInfo::Location BytecodeDebugInfo::location(uint32_t pc) const
+{
+	auto it = std::upper_bound(lines.cbegin(), lines.cend(), pc, [](uint32_t p, const LineRow& row) { return p < row.pc; });
+	if (it == lines.cbegin())
+		return Location();
+	return (it - 1)->loc;
+}
+
+std::string BytecodeDebugInfo::symbol(uint32_t pc) const
+{
+	auto it = symbols.find(pc);
+	return it == symbols.cend() ? std::string() : it->second;
+}
+
+size_t BytecodeDebugInfo::memoryBytes() const
+{
+	size_t bytes = lines.capacity() * sizeof(LineRow);
+	for (const auto& s : symbols)
+		bytes += sizeof(s) + s.second.capacity();
+	return bytes;
+}
+
+ByteOrderDataStreamWriter &operator <<(ByteOrderDataStreamWriter &of, const BytecodeDebugInfo& info)
+{
+	of << uint32_t(info.lines.size());
+	BytecodeDebugInfo::LineRow prev{0, BytecodeDebugInfo::Location()};
+	for (const BytecodeDebugInfo::LineRow& row : info.lines)
+	{
+		of << uint32_t(row.pc - prev.pc) << int32_t(row.loc.line - prev.loc.line)
+		   << int32_t(row.loc.col) << int32_t(row.loc.file);
+		prev = row;
+	}
+	of << uint32_t(info.symbols.size());
+	for (const auto& s : info.symbols)
+	{
+		of << s.first;
+		of.WritePascalString(s.second);
+	}
+	return of;
+}
+
+ByteOrderDataStreamReader &operator >>(ByteOrderDataStreamReader &ifs, BytecodeDebugInfo& info)
+{
+	info.clear();
+	uint32_t size = 0;
+	ifs >> size;
+	info.lines.resize(size);
+	BytecodeDebugInfo::LineRow prev{0, BytecodeDebugInfo::Location()};
+	for (BytecodeDebugInfo::LineRow& row : info.lines)
+	{
+		uint32_t pcDelta = 0;
+		int32_t lineDelta = 0, col = 0, file = 0;
+		ifs >> pcDelta >> lineDelta >> col >> file;
+		row.pc = prev.pc + pcDelta;
+		row.loc.line = prev.loc.line + lineDelta;
+		row.loc.col = col;
+		row.loc.file = file;
+		prev = row;
+	}
+	ifs >> size;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		uint32_t pc = 0;
+		ifs >> pc;
+		ifs.ReadPascalString(info.symbols[pc]);
+	}
+	return ifs;
+}
 const std::string BytecodeVM::opcodes[BytecodeVM::OPCODE_COUNT] = {
 	"NOP   ",
 	"BINOP ",
@@ -180,7 +265,10 @@ const std::string BytecodeVM::opcodes[BytecodeVM::OPCODE_COUNT] = {
 	"WRITE ",
 	"EXIT  ",
 
-	"IDX_ST"
+	"IDX_ST",
+	"ALLOC ",
+	"FREE  ",
+	"PUSHC "
 };
 
 
@@ -14,11 +14,14 @@
 
 #include "ScriptVariant.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
 /**
  * \brief VirtualMachine opcodes, used by SciptVM.
+ *
+ * Instruction holds only what interpreter reads. Source locations and labels are kept in BytecodeDebugInfo.
  */
 struct BytecodeVM
 {
@@ -55,6 +58,9 @@ struct BytecodeVM
 		EXIT ,  // Terminate execution.
 
 		IDX_STR,    // [] stack(-2 +1) index string, put char to TOP.
+		ALLOC,  // [size] stack(-size-1 +0) copy [size] values from TOP to new heap block, point reference below them to it.
+		FREE,   // [] stack(-1 +0) release heap block, address of which is in reference on TOP.
+		PUSHC,  // [offset, count] push to TOP [count] values of constant pool, starting from [offset].
 		OPCODE_COUNT
 	};
 	static const std::string opcodes[OPCODE_COUNT];
@@ -109,14 +115,43 @@ struct BytecodeVM
 
 	OpCodeType op;
 	std::vector<ScriptVariant> values;
-	int col, line, file;
-	void *scope;
-	std::string symbolLabel;
-	std::string gotoLabel;
-	BytecodeVM() : op(NOP),col(-1), line(-1), file(-1),scope(0) {}
+	BytecodeVM() : op(NOP) {}
 	std::string ConvertToString(bool useType = true) const;
 
 };
 
+/**
+ * \brief Debug side table of VM code: source locations and symbols by instruction address.
+ *
+ * Line table has a row only where location changes, location of instruction is the last row at or before it.
+ * Rows are serialized as deltas from previous row. Symbols are labels of function entries and program start;
+ * names of call targets are not stored, they are symbols at CALL address.
+ */
+struct BytecodeDebugInfo
+{
+	struct Location {
+		int file = -1, line = -1, col = -1;
+		bool operator ==(const Location& another) const { return file == another.file && line == another.line && col == another.col; }
+		bool operator !=(const Location& another) const { return !(*this == another); }
+	};
+	struct LineRow {
+		uint32_t pc;
+		Location loc;
+	};
+
+	std::vector<LineRow> lines;                 //!< ordered by pc.
+	std::map<uint32_t, std::string> symbols;
+
+	void clear();
+	bool isEmpty() const { return lines.empty() && symbols.empty(); }
+	/// Rows must be added in order of pc.
+	void addLocation(uint32_t pc, const Location& loc);
+	Location location(uint32_t pc) const;
+	std::string symbol(uint32_t pc) const;
+	size_t memoryBytes() const;
+};
+
 ByteOrderDataStreamWriter&  operator <<(ByteOrderDataStreamWriter&  of,const BytecodeVM& opc);
 ByteOrderDataStreamReader&  operator >>(ByteOrderDataStreamReader&  ifs,BytecodeVM& opc);
+ByteOrderDataStreamWriter&  operator <<(ByteOrderDataStreamWriter&  of,const BytecodeDebugInfo& info);
+ByteOrderDataStreamReader&  operator >>(ByteOrderDataStreamReader&  ifs,BytecodeDebugInfo& info);
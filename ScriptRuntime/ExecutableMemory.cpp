@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ExecutableMemory.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+ExecutableMemory::~ExecutableMemory()
+{
+	release();
+}
+
+bool ExecutableMemory::assign(const uint8_t *code, size_t size)
+{
+	release();
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const size_t page = info.dwPageSize;
+#else
+	const size_t page = sysconf(_SC_PAGESIZE);
+#endif
+	const size_t mapped = (size + page - 1) / page * page;
+	if (!mapped)
+		return false;
+#ifdef _WIN32
+	void* pages = VirtualAlloc(nullptr, mapped, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!pages)
+		return false;
+	memcpy(pages, code, size);
+	DWORD oldProtect;
+	if (!VirtualProtect(pages, mapped, PAGE_EXECUTE_READ, &oldProtect))
+	{
+		VirtualFree(pages, 0, MEM_RELEASE);
+		return false;
+	}
+	FlushInstructionCache(GetCurrentProcess(), pages, mapped);
+#else
+	void* pages = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pages == MAP_FAILED)
+		return false;
+	memcpy(pages, code, size);
+	if (mprotect(pages, mapped, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(pages, mapped);
+		return false;
+	}
+#endif
+	_data = static_cast<uint8_t*>(pages);
+	_size = mapped;
+	return true;
+}
+
+void ExecutableMemory::release()
+{
+	if (!_data)
+		return;
+#ifdef _WIN32
+	VirtualFree(_data, 0, MEM_RELEASE);
+#else
+	munmap(_data, _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
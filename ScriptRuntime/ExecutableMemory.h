@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Pages with generated machine code, see ScriptVM_jit.cpp.
+ *
+ * Code is copied while pages are writable, then pages become read-only and executable.
+ */
+class ExecutableMemory
+{
+public:
+	ExecutableMemory() = default;
+	ExecutableMemory(const ExecutableMemory&) = delete;
+	ExecutableMemory& operator =(const ExecutableMemory&) = delete;
+	~ExecutableMemory();
+
+	bool assign(const uint8_t* code, size_t size);
+	void release();
+
+	const uint8_t* data() const { return _data; }
+	size_t size() const { return _size; }    //!< mapped bytes, rounded up to pages.
+
+private:
+	uint8_t* _data = nullptr;
+	size_t _size = 0;
+};
@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ExpressionProgram.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+int operand(const BytecodeVM& o, size_t index, int def = 0)
+{
+	return o.values.size() > index ? o.values[index].getValue<int>() : def;
+}
+
+/// Arithmetic on most used types without generic dispatch; false if operand types differ from operation type.
+template<typename T>
+bool binopTyped(BytecodeVM::BinOp op, ScriptVariant& t1, const ScriptVariant& t2, ScriptVariant::Types type)
+{
+	if (t1._Type != type || t2._Type != type)
+		return false;
+	const T a = t1.getValue<T>(), b = t2.getValue<T>();
+	switch (op)
+	{
+		case BytecodeVM::PLUS:  t1.setValue(T(a + b), ScriptVariant::T_AUTO); return true;
+		case BytecodeVM::MINUS: t1.setValue(T(a - b), ScriptVariant::T_AUTO); return true;
+		case BytecodeVM::MUL:   t1.setValue(T(a * b), ScriptVariant::T_AUTO); return true;
+		case BytecodeVM::DIVR:  t1.setValue(T(a / b), ScriptVariant::T_AUTO); return true;
+		case BytecodeVM::LT:    t1.setValue(a <  b, ScriptVariant::T_bool); return true;
+		case BytecodeVM::GT:    t1.setValue(a >  b, ScriptVariant::T_bool); return true;
+		case BytecodeVM::LE:    t1.setValue(a <= b, ScriptVariant::T_bool); return true;
+		case BytecodeVM::GE:    t1.setValue(a >= b, ScriptVariant::T_bool); return true;
+		default:
+			return false;
+	}
+}
+
+/// Dense lanes are double: 64-bit integers above 2^53 would be rounded, so they go to ScriptVariant lanes.
+inline bool isDenseNumber(const ScriptVariant& v)
+{
+	return v._Type <= ScriptVariant::T_uint32_t;
+}
+
+/// Result replaces left operand: operations read both operands before result is written.
+inline void binaryOperation(BytecodeVM::BinOp op, ScriptVariant::Types type, ScriptVariant& t1, const ScriptVariant& t2)
+{
+	bool done = false;
+	switch (type)
+	{
+		case ScriptVariant::T_float64: done = binopTyped<double> (op, t1, t2, type); break;
+		case ScriptVariant::T_int32_t: done = binopTyped<int32_t>(op, t1, t2, type); break;
+		case ScriptVariant::T_int64_t: done = binopTyped<int64_t>(op, t1, t2, type); break;
+		default: break;
+	}
+	if (!done)
+		ScriptVM::applyBinaryOperation(op, type, t1, t1, t2);
+}
+}
+
+bool ExpressionProgram::compile(ScriptVM &vm)
+{
+	clear();
+	const std::vector<BytecodeVM>& code = vm._code;
+
+	// every instruction pushes at most one value, except PUSH with count; slots never move after this.
+	size_t stackBound = 0;
+	for (const BytecodeVM& o : code)
+		stackBound += o.op == BytecodeVM::PUSH ? std::max(1, operand(o, 1, 1)) : 1;
+	_stack.resize(stackBound);
+
+	// compile-time stack: references to external variables are kept here and never materialized.
+	struct Entry {
+		bool isRef;
+		ScriptVariant::AddressPtr ptr;
+		int nameIndex;
+	};
+	std::vector<Entry> entries;
+	auto slot = [this, &entries](size_t offset) { return &_stack[entries.size() - 1 - offset]; };
+	auto valuesOnTop = [&entries](size_t count) {
+		if (entries.size() < count)
+			return false;
+		for (size_t i = 0; i < count; i++)
+			if (entries[entries.size() - 1 - i].isRef)
+				return false;
+		return true;
+	};
+	auto variable = [&vm, this](const Entry& ref) {
+		const ScriptVM::NameRecord& nr = vm._nameTable[ref.nameIndex];
+		return addVariable(nr._name, ref.ptr.index - nr._ptr.index);
+	};
+	// interpreter operations dereference operands themselves, here references are loaded into their slots first.
+	auto loadOnTop = [&](size_t count) {
+		if (entries.size() < count)
+			return false;
+		for (size_t i = 0; i < count; i++)
+		{
+			Entry& entry = entries[entries.size() - 1 - i];
+			if (!entry.isRef)
+				continue;
+			Step load;
+			load.type = sLoad;
+			load.src = entry.ptr.getSafe(0);
+			load.srcVar = variable(entry);
+			load.dst = slot(i);
+			entry.isRef = false;
+			_steps.push_back(load);
+		}
+		return true;
+	};
+	Entry value;
+	value.isRef = false;
+	value.nameIndex = -1;
+
+	try {
+		for (size_t pc = vm._startPC; pc < code.size() && code[pc].op != BytecodeVM::EXIT; pc++)
+		{
+			const BytecodeVM& o = code[pc];
+			const int a = operand(o, 0), b = operand(o, 1), c = operand(o, 2);
+			Step step;
+			switch (o.op)
+			{
+				case BytecodeVM::REFEXT: {
+					if (a < 0 || size_t(a) >= vm._nameTable.size())
+						return fail("invalid external variable index");
+					const ScriptVM::NameRecord& nr = vm._nameTable[a];
+					if (!nr._ptr.container && !nr._ptr.container2)
+						return fail("variable " + nr._name + " is not bound");
+					if (nr._ptr.getSafe(0)->_Type == ScriptVariant::T_ptr)
+						return fail("variable " + nr._name + " is pointer");
+					Entry ref;
+					ref.isRef = true;
+					ref.ptr = nr._ptr;
+					ref.nameIndex = a;
+					entries.push_back(ref);
+				} continue;
+				case BytecodeVM::ADDREF: {
+					if (entries.empty() || !entries.back().isRef)
+						return fail("ADDREF of value");
+					ScriptVariant::AddressPtr& ptr = entries.back().ptr;
+					ptr.index += a;
+					if (ptr.index > ptr.maxIndex || ptr.getSafe(0)->_Type == ScriptVariant::T_ptr)
+						return fail("ADDREF out of variable");
+				} continue;
+				case BytecodeVM::DEREF:
+					if (entries.empty())
+						return fail("DEREF of empty stack");
+					if (!entries.back().isRef)
+						continue; // value is dereferenced to itself.
+					step.type = sLoad;
+					step.src = entries.back().ptr.getSafe(0);
+					step.srcVar = variable(entries.back());
+					step.dst = slot(0);
+					entries.back().isRef = false;
+					break;
+				case BytecodeVM::PUSH:
+					if (o.values[0]._Type == ScriptVariant::T_ptr)
+						return fail("pointer constant");
+					step.type = sConst;
+					step.value = o.values[0];
+					step.count = b;
+					step.dst = &_stack[entries.size()];
+					entries.insert(entries.end(), b, value);
+					break;
+				case BytecodeVM::POP:
+					if (entries.size() < size_t(a))
+						return fail("POP of empty stack");
+					entries.resize(entries.size() - a);
+					continue;
+				case BytecodeVM::BINOP:
+					if (!loadOnTop(2))
+						return fail("BINOP of empty stack");
+					step.type = sBinop;
+					step.op = a;
+					step.optype = ScriptVariant::Types(b);
+					step.dst = slot(1);
+					step.src = slot(0);
+					entries.pop_back();
+					break;
+				case BytecodeVM::UNOP:
+					if (!loadOnTop(1))
+						return fail("UNOP of empty stack");
+					step.type = sUnop;
+					step.op = a;
+					step.optype = ScriptVariant::Types(b);
+					step.dst = slot(0);
+					break;
+				case BytecodeVM::MULTOP:
+					if (!c)
+						continue;
+					if (!loadOnTop(c))
+						return fail("MULTOP of empty stack");
+					step.type = sMultop;
+					step.op = a;
+					step.optype = ScriptVariant::Types(b);
+					for (int i = 0; i < c; i++)
+						step.args.push_back(slot(c - 1 - i));
+					step.dst = step.args[0];
+					entries.resize(entries.size() - c + 1);
+					break;
+				case BytecodeVM::CVRT:
+					if (!loadOnTop(1))
+						return fail("CVRT of empty stack");
+					step.type = sCvrt;
+					step.optype = ScriptVariant::Types(a);
+					step.dst = slot(0);
+					break;
+				case BytecodeVM::CMPS:
+					if (b != 1)
+						return fail("CMPS of non-scalar");
+					if (!loadOnTop(2))
+						return fail("CMPS of empty stack");
+					step.type = sCmp;
+					step.op = a & BytecodeVM::cNot;
+					step.dst = slot(1);
+					step.src = slot(0);
+					entries.pop_back();
+					break;
+				case BytecodeVM::MOVS: {
+					const bool rightIsRef = a & BytecodeVM::mRightIsRef;
+					if (b != 1 || (a & BytecodeVM::mAddress) || !(a & BytecodeVM::mLeftIsRef))
+						return fail("MOVS of non-scalar");
+					if (entries.size() < 2 || !entries[entries.size() - 2].isRef || entries.back().isRef != rightIsRef)
+						return fail("MOVS operands");
+					step.type = sStore;
+					step.dst = entries[entries.size() - 2].ptr.getSafe(0);
+					step.dstVar = variable(entries[entries.size() - 2]);
+					step.src = rightIsRef ? entries.back().ptr.getSafe(0) : slot(0);
+					if (rightIsRef)
+						step.srcVar = variable(entries.back());
+					entries.resize(entries.size() - 2);
+				} break;
+				case BytecodeVM::CALLEXT:
+					if (a < 0 || size_t(a) >= vm._funcTable.size() || !vm._funcTable[a]._resolved)
+						return fail("unresolved call");
+					if (!valuesOnTop(b + c))
+						return fail("CALLEXT with reference argument");
+					step.type = sCallExt;
+					step.func = &vm._funcTable[a];
+					for (int i = 0; i < c; i++)
+						step.results.push_back(slot(b + c - 1 - i));
+					for (int i = 0; i < b; i++)
+						step.args.push_back(slot(b - 1 - i));
+					entries.resize(entries.size() - b);
+					break;
+				default:
+					return fail("unsupported instruction " + o.ConvertToString(false));
+			}
+			_steps.push_back(step);
+		}
+	} catch (std::exception& e) {
+		return fail(e.what());
+	}
+	if (_steps.empty())
+		return fail("empty code");
+	_dense = std::all_of(_steps.begin(), _steps.end(), [](const Step& step) { return isDenseStep(step); });
+	return true;
+}
+
+void ExpressionProgram::clear()
+{
+	_steps.clear();
+	_stack.clear();
+	_vars.clear();
+	_batchStack.clear();
+	_denseStack.clear();
+	_dense = false;
+	_error.clear();
+}
+
+void ExpressionProgram::run()
+{
+	for (Step& step : _steps)
+	{
+		switch (step.type)
+		{
+			case sLoad:
+				*step.dst = *step.src;
+				break;
+			case sConst:
+				for (int i = 0; i < step.count; i++)
+					step.dst[i] = step.value;
+				break;
+			case sBinop:
+				binaryOperation(BytecodeVM::BinOp(step.op), step.optype, *step.dst, *step.src);
+				break;
+			case sUnop:
+				ScriptVM::applyUnaryOperation(BytecodeVM::UnOp(step.op), step.optype, *step.dst);
+				break;
+			case sMultop:
+				ScriptVM::applyMultOperation(BytecodeVM::BinOp(step.op), step.optype, *step.dst, step.args);
+				break;
+			case sCvrt:
+				step.dst->setType(step.optype);
+				break;
+			case sCmp:
+				step.dst->setValue(ScriptVM::applyCmpOperation(*step.dst, *step.src) != bool(step.op), ScriptVariant::T_bool);
+				break;
+			case sStore:
+				step.dst->setOpValue(*step.src);
+				break;
+			case sCallExt:
+				if (step.func->_callback)
+					step.func->_callback(step.results, step.args);
+				else if (step.func->_callback2)
+					step.func->_callback2->call(step.results, step.args);
+				else
+					throw std::runtime_error("unresolved call!");
+				break;
+		}
+	}
+}
+
+bool ExpressionProgram::setColumn(const std::string &name, std::vector<ScriptVariant> *column)
+{
+	std::string index = name;
+	std::transform(index.begin(), index.end(), index.begin(), ::tolower);
+	bool found = false;
+	for (Variable& var : _vars)
+	{
+		if (var.name == index && var.offset == 0)
+		{
+			var.column = column;
+			found = true;
+		}
+	}
+	return found;
+}
+
+void ExpressionProgram::clearColumns()
+{
+	for (Variable& var : _vars)
+		var.column = nullptr;
+}
+
+void ExpressionProgram::runBatch(size_t count)
+{
+	for (const Variable& var : _vars)
+		if (var.column && var.column->size() < count)
+			throw std::runtime_error("column " + var.name + " is shorter than batch");
+
+	_batchStack.resize(_stack.size() * batchLanes);
+	if (_dense)
+		_denseStack.resize(_stack.size() * batchLanes);
+	for (size_t base = 0; base < count; base += batchLanes)
+	{
+		const size_t n = std::min(batchLanes, count - base);
+		if (_dense && denseInputs(base, n))
+			runDense(base, n);
+		else
+			runLanes(base, n);
+	}
+}
+
+bool ExpressionProgram::isDenseStep(const ExpressionProgram::Step &step)
+{
+	switch (step.type)
+	{
+		case sLoad:
+		case sStore:
+			return true;
+		case sConst:
+			return isDenseNumber(step.value);
+		case sBinop:
+			return step.optype == ScriptVariant::T_float64
+					&& (step.op == BytecodeVM::PLUS || step.op == BytecodeVM::MINUS || step.op == BytecodeVM::MUL || step.op == BytecodeVM::DIVR);
+		case sUnop:
+			return step.optype == ScriptVariant::T_float64 && (step.op == BytecodeVM::UPLUS || step.op == BytecodeVM::UMINUS);
+		case sCvrt:
+			return step.optype == ScriptVariant::T_float64;
+		default:
+			return false;
+	}
+}
+
+bool ExpressionProgram::denseInputs(size_t base, size_t n) const
+{
+	for (const Step& step : _steps)
+	{
+		if (step.type != sLoad)
+			continue;
+		const std::vector<ScriptVariant>* column = _vars[step.srcVar].column;
+		if (!column && !isDenseNumber(*step.src))
+			return false;
+		for (size_t l = 0; column && l < n; l++)
+			if (!isDenseNumber((*column)[base + l]))
+				return false;
+	}
+	return true;
+}
+
+void ExpressionProgram::runDense(size_t base, size_t n)
+{
+	for (const Step& step : _steps)
+	{
+		double* dst = step.type != sStore ? denseLanes(step.dst) : nullptr;
+		switch (step.type)
+		{
+			case sLoad: {
+				const std::vector<ScriptVariant>* column = _vars[step.srcVar].column;
+				for (size_t l = 0; l < n; l++)
+					dst[l] = (column ? (*column)[base + l] : *step.src).getValue<double>();
+			} break;
+			case sConst: {
+				const double value = step.value.getValue<double>();
+				for (int i = 0; i < step.count; i++)
+					std::fill(dst + i * batchLanes, dst + i * batchLanes + n, value);
+			} break;
+			case sBinop: {
+				const double* src = denseLanes(step.src);
+				switch (step.op)
+				{
+					case BytecodeVM::PLUS:  for (size_t l = 0; l < n; l++) dst[l] += src[l]; break;
+					case BytecodeVM::MINUS: for (size_t l = 0; l < n; l++) dst[l] -= src[l]; break;
+					case BytecodeVM::MUL:   for (size_t l = 0; l < n; l++) dst[l] *= src[l]; break;
+					case BytecodeVM::DIVR:  for (size_t l = 0; l < n; l++) dst[l] /= src[l]; break;
+					default: break;
+				}
+			} break;
+			case sUnop:
+				if (step.op == BytecodeVM::UMINUS)
+					for (size_t l = 0; l < n; l++)
+						dst[l] = -dst[l];
+				break;
+			case sCvrt:
+				break; // lanes already hold float64.
+			case sStore: {
+				std::vector<ScriptVariant>* dstColumn = _vars[step.dstVar].column;
+				const std::vector<ScriptVariant>* srcColumn = step.srcVar >= 0 ? _vars[step.srcVar].column : nullptr;
+				const double* src = step.srcVar < 0 ? denseLanes(step.src) : nullptr;
+				for (size_t l = 0; l < n; l++)
+				{
+					ScriptVariant* target = dstColumn ? &(*dstColumn)[base + l] : step.dst;
+					if (src)
+					{
+						_denseValue.setValue(src[l], ScriptVariant::T_float64);
+						target->setOpValue(_denseValue);
+					}
+					else
+						target->setOpValue(srcColumn ? (*srcColumn)[base + l] : *step.src);
+				}
+			} break;
+			default:
+				break;
+		}
+	}
+}
+
+void ExpressionProgram::runLanes(size_t base, size_t n)
+{
+	for (Step& step : _steps)
+	{
+		switch (step.type)
+		{
+			case sLoad: {
+				ScriptVariant* dst = lanes(step.dst);
+				const std::vector<ScriptVariant>* column = _vars[step.srcVar].column;
+				for (size_t l = 0; l < n; l++)
+					dst[l] = column ? (*column)[base + l] : *step.src;
+			} break;
+			case sConst:
+				for (int i = 0; i < step.count; i++)
+				{
+					ScriptVariant* dst = lanes(step.dst + i);
+					for (size_t l = 0; l < n; l++)
+						dst[l] = step.value;
+				}
+				break;
+			case sBinop: {
+				ScriptVariant* dst = lanes(step.dst);
+				const ScriptVariant* src = lanes(step.src);
+				const BytecodeVM::BinOp op = BytecodeVM::BinOp(step.op);
+				for (size_t l = 0; l < n; l++)
+					binaryOperation(op, step.optype, dst[l], src[l]);
+			} break;
+			case sUnop: {
+				ScriptVariant* dst = lanes(step.dst);
+				for (size_t l = 0; l < n; l++)
+					ScriptVM::applyUnaryOperation(BytecodeVM::UnOp(step.op), step.optype, dst[l]);
+			} break;
+			case sMultop: {
+				ScriptVariant* dst = lanes(step.dst);
+				_laneArgs.resize(step.args.size());
+				for (size_t l = 0; l < n; l++)
+				{
+					for (size_t i = 0; i < step.args.size(); i++)
+						_laneArgs[i] = lanes(step.args[i]) + l;
+					ScriptVM::applyMultOperation(BytecodeVM::BinOp(step.op), step.optype, dst[l], _laneArgs);
+				}
+			} break;
+			case sCvrt: {
+				ScriptVariant* dst = lanes(step.dst);
+				for (size_t l = 0; l < n; l++)
+					dst[l].setType(step.optype);
+			} break;
+			case sCmp: {
+				ScriptVariant* dst = lanes(step.dst);
+				ScriptVariant* src = lanes(step.src);
+				for (size_t l = 0; l < n; l++)
+					dst[l].setValue(ScriptVM::applyCmpOperation(dst[l], src[l]) != bool(step.op), ScriptVariant::T_bool);
+			} break;
+			case sStore: {
+				std::vector<ScriptVariant>* dstColumn = _vars[step.dstVar].column;
+				const std::vector<ScriptVariant>* srcColumn = step.srcVar >= 0 ? _vars[step.srcVar].column : nullptr;
+				for (size_t l = 0; l < n; l++)
+				{
+					ScriptVariant* dst = dstColumn ? &(*dstColumn)[base + l] : step.dst;
+					const ScriptVariant* src = step.srcVar < 0 ? lanes(step.src) + l
+															   : srcColumn ? &(*srcColumn)[base + l] : step.src;
+					dst->setOpValue(*src);
+				}
+			} break;
+			case sCallExt:
+				_laneResults.resize(step.results.size());
+				_laneArgs.resize(step.args.size());
+				for (size_t l = 0; l < n; l++)
+				{
+					for (size_t i = 0; i < step.results.size(); i++)
+						_laneResults[i] = lanes(step.results[i]) + l;
+					for (size_t i = 0; i < step.args.size(); i++)
+						_laneArgs[i] = lanes(step.args[i]) + l;
+					if (step.func->_callback)
+						step.func->_callback(_laneResults, _laneArgs);
+					else if (step.func->_callback2)
+						step.func->_callback2->call(_laneResults, _laneArgs);
+					else
+						throw std::runtime_error("unresolved call!");
+				}
+				break;
+		}
+	}
+}
+
+bool ExpressionProgram::fail(const std::string &reason)
+{
+	_steps.clear();
+	_error = reason;
+	return false;
+}
+
+int ExpressionProgram::addVariable(const std::string &name, size_t offset)
+{
+	for (size_t i = 0; i < _vars.size(); i++)
+		if (_vars[i].name == name && _vars[i].offset == offset)
+			return i;
+	Variable var;
+	var.name = name;
+	var.offset = offset;
+	_vars.push_back(var);
+	return _vars.size() - 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include "ScriptVM.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief Flat postfix evaluator for straight-line code, such as assignment compiled in smAssignment mode.
+ *
+ * compile() walks VM code once: external variables are resolved to direct pointers, every operand gets fixed
+ * slot in private stack, so run() is a loop over steps without stack frames, reference variants and dispatch checks.
+ * Operations are the same as interpreter ones, so result equals ScriptVM::run().
+ * Pointers are taken from current bindings: compile again after bindVariable() or resizing of bound containers.
+ *
+ * runBatch() evaluates program for many records: variables with column (setColumn()) take value of each record,
+ * other variables are shared by all records. Records are processed by batchLanes at once, each step is applied to
+ * all lanes before next one, so step dispatch is paid once per batch. Programs of float64 arithmetic only run on
+ * plain double lanes (loops are vectorized by compiler); batch with non-numeric input falls back to variant lanes.
+ * Values are not passed between records: variable written without column keeps result of last record.
+ */
+class ExpressionProgram
+{
+public:
+	ExpressionProgram() = default;
+	ExpressionProgram(const ExpressionProgram&) = delete;
+	ExpressionProgram& operator =(const ExpressionProgram&) = delete;
+
+	/// Returns false if code has jumps, calls of script functions, unbound or non-scalar variables; use vm.run() then.
+	bool compile(ScriptVM& vm);
+	void clear();
+	bool isValid() const { return !_steps.empty(); }
+	const std::string& error() const { return _error; }
+	size_t stepsCount() const { return _steps.size(); }
+
+	void run();
+
+	static const size_t batchLanes = 16;
+	/// Per-record values of variable for runBatch(); nullptr removes column. Column must outlive runBatch() calls, compile() resets columns.
+	bool setColumn(const std::string& name, std::vector<ScriptVariant>* column);
+	void clearColumns();
+	/// Evaluates first count records; throws std::runtime_error if column is shorter.
+	void runBatch(size_t count);
+
+private:
+	enum StepType { sLoad, sConst, sBinop, sUnop, sMultop, sCvrt, sCmp, sStore, sCallExt };
+	struct Step {
+		StepType type;
+		int op = 0;                             //!< sCmp: cNot flag.
+		ScriptVariant::Types optype = ScriptVariant::T_UNDEFINED;
+		ScriptVariant* dst = nullptr;           //!< stack slot or bound variable.
+		ScriptVariant* src = nullptr;           //!< stack slot or bound variable; right operand for sBinop.
+		ScriptVariant value;                    //!< sConst.
+		int count = 1;                          //!< sConst copies.
+		std::vector<ScriptVariant*> args;       //!< sMultop, sCallExt.
+		std::vector<ScriptVariant*> results;    //!< sCallExt.
+		ScriptVM::FuncNameRecord* func = nullptr;
+		int srcVar = -1;                        //!< index in _vars for sLoad and sStore sources.
+		int dstVar = -1;                        //!< index in _vars for sStore.
+	};
+	struct Variable {
+		std::string name;
+		size_t offset = 0;                      //!< element of bound block, columns are set for first one.
+		std::vector<ScriptVariant>* column = nullptr;
+	};
+	bool fail(const std::string& reason);
+	int addVariable(const std::string& name, size_t offset);
+	ScriptVariant* lanes(const ScriptVariant* slot) { return &_batchStack[(slot - _stack.data()) * batchLanes]; }
+	double* denseLanes(const ScriptVariant* slot) { return &_denseStack[(slot - _stack.data()) * batchLanes]; }
+	static bool isDenseStep(const Step& step);
+	bool denseInputs(size_t base, size_t n) const;
+	void runDense(size_t base, size_t n);
+	void runLanes(size_t base, size_t n);
+
+	std::vector<Step> _steps;
+	std::vector<ScriptVariant> _stack;
+	std::vector<Variable> _vars;
+	std::vector<ScriptVariant> _batchStack;     //!< slot-major: lanes of one slot are adjacent.
+	std::vector<ScriptVariant*> _laneResults, _laneArgs;
+	std::vector<double> _denseStack;            //!< same layout as _batchStack.
+	ScriptVariant _denseValue;
+	bool _dense = false;
+	std::string _error;
+};
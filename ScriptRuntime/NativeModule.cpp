@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "NativeModule.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+NativeModule::~NativeModule()
+{
+	unload();
+}
+
+bool NativeModule::load(const std::string &path, std::string &error)
+{
+	unload();
+#ifdef _WIN32
+	HMODULE handle = LoadLibraryA(path.c_str());
+	if (!handle)
+	{
+		error = "failed to load " + path;
+		return false;
+	}
+	_handle = handle;
+	_entry = reinterpret_cast<PascalNativeEntry>(GetProcAddress(handle, PASCAL_NATIVE_ENTRY));
+#else
+	_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!_handle)
+	{
+		error = dlerror();
+		return false;
+	}
+	_entry = reinterpret_cast<PascalNativeEntry>(dlsym(_handle, PASCAL_NATIVE_ENTRY));
+#endif
+	if (!_entry)
+	{
+		error = path + " has no " PASCAL_NATIVE_ENTRY " entry";
+		unload();
+		return false;
+	}
+	return true;
+}
+
+void NativeModule::unload()
+{
+	if (!_handle)
+		return;
+#ifdef _WIN32
+	FreeLibrary(static_cast<HMODULE>(_handle));
+#else
+	dlclose(_handle);
+#endif
+	_handle = nullptr;
+	_entry = nullptr;
+}
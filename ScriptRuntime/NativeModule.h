@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#define PASCAL_NATIVE_ABI_VERSION 2
+#define PASCAL_NATIVE_ENTRY "pascal_native_main"
+
+extern "C" {
+/// Scalar passed between host and module: integers and booleans in i, so 64-bit values are not rounded.
+struct PascalNativeValue
+{
+	int isFloat;   //!< 1: value is d, 0: value is i.
+	int64_t i;
+	double d;
+};
+
+/**
+ * \brief Host interface passed to entry of native module.
+ *
+ * Plain C, so module does not link with ScriptRuntime; StringVisitor emits same declaration into module source.
+ * Only scalar external variables and functions are supported, CompilerFrontend::pascal2c rejects other ones.
+ */
+struct PascalNativeAbi
+{
+	int version;
+	void* vm;
+	int  (*getVar)(void* vm, const char* name, PascalNativeValue* value);   //!< returns 0 if variable is not bound.
+	int  (*setVar)(void* vm, const char* name, const PascalNativeValue* value);
+	int  (*call)(void* vm, const char* name, PascalNativeValue* results, int resultCount, const PascalNativeValue* args, int argCount);
+	void (*write)(void* vm, const char* text);
+};
+typedef int (*PascalNativeEntry)(PascalNativeAbi* abi);
+}
+
+/**
+ * \brief Shared library built from Pascal2cpp output, see CompilerFrontend::buildNativeModule.
+ */
+class NativeModule
+{
+public:
+	NativeModule() = default;
+	NativeModule(const NativeModule&) = delete;
+	NativeModule& operator =(const NativeModule&) = delete;
+	~NativeModule();
+
+	bool load(const std::string& path, std::string& error);
+	void unload();
+	bool isLoaded() const { return _entry != nullptr; }
+
+	int run(PascalNativeAbi* abi) const { return _entry(abi); }
+
+private:
+	void* _handle = nullptr;
+	PascalNativeEntry _entry = nullptr;
+};
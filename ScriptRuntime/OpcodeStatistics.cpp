@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "OpcodeStatistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+const uint8_t noType = 0xFF;
+
+std::string trimmed(const std::string& s)
+{
+	size_t end = s.find_last_not_of(' ');
+	return end == std::string::npos ? s : s.substr(0, end + 1);
+}
+
+struct Candidate {
+	std::string name;
+	uint64_t count;
+	uint64_t staticCount;
+	int length;
+	uint64_t score() const { return count * (length - 1); }
+};
+}
+
+OpcodeStatistics::Key OpcodeStatistics::makeKey(const BytecodeVM &o, const ScriptVariant *top)
+{
+	uint32_t sub = 0, type = noType, flags = 0;
+	const uint8_t topType = top ? top->_Type : noType;
+	switch (o.op)
+	{
+		case BytecodeVM::BINOP:
+		case BytecodeVM::UNOP:
+		case BytecodeVM::MULTOP:
+			sub = o.values[0].getValue<int>();
+			type = o.values[1].getValue<int>();
+			break;
+		case BytecodeVM::MOVS:
+		case BytecodeVM::CMPS:
+			sub = o.values[0].getValue<int>();
+			type = topType;
+			flags = o.values[1].getValue<int>() > 1;
+			break;
+		case BytecodeVM::CVRT:
+			sub = topType;
+			type = o.values[0].getValue<int>();
+			break;
+		case BytecodeVM::PUSH:
+			type = o.values[0]._Type;
+			flags = o.values[1].getValue<int>() > 1;
+			break;
+		case BytecodeVM::DEREF:
+		case BytecodeVM::FJMP:
+		case BytecodeVM::TJMP:
+			type = topType;
+			break;
+		default:
+			break;
+	}
+	return Key(o.op) | (sub & 0xFF) << 8 | (type & 0xFF) << 16 | (flags & 0xFF) << 24;
+}
+
+std::string OpcodeStatistics::keyToString(OpcodeStatistics::Key key)
+{
+	const int op = key & 0xFF;
+	const int sub = (key >> 8) & 0xFF;
+	const int type = (key >> 16) & 0xFF;
+	const int flags = (key >> 24) & 0xFF;
+	std::ostringstream os;
+	os << (op < BytecodeVM::OPCODE_COUNT ? trimmed(BytecodeVM::opcodes[op]) : std::string("?"));
+	switch (op)
+	{
+		case BytecodeVM::BINOP:
+		case BytecodeVM::MULTOP:
+			if (sub < BytecodeVM::BinOp_COUNT) os << " " << BytecodeVM::binopStr[sub];
+			break;
+		case BytecodeVM::UNOP:
+			if (sub < BytecodeVM::UnOp_COUNT) os << " " << BytecodeVM::unopStr[sub];
+			break;
+		case BytecodeVM::MOVS:
+		case BytecodeVM::CMPS:
+			os << " f" << sub;
+			break;
+		case BytecodeVM::CVRT:
+			if (sub != noType) os << " " << ScriptVariant::type2string(ScriptVariant::Types(sub)) << "->";
+			break;
+		default:
+			break;
+	}
+	if (type != noType)
+		os << ":" << ScriptVariant::type2string(ScriptVariant::Types(type));
+	if (flags)
+		os << "*";
+	return os.str();
+}
+
+void OpcodeStatistics::clear()
+{
+	_single.clear();
+	_pairs.clear();
+	_triples.clear();
+	_staticPairs.clear();
+	_staticTriples.clear();
+	_jumpTargets.clear();
+	_seqLength = 0;
+	_total = 0;
+}
+
+void OpcodeStatistics::startRun(const std::vector<BytecodeVM> &code, const BytecodeDebugInfo *debugInfo)
+{
+	_seqLength = 0;
+	analyzeStatic(code, debugInfo);
+}
+
+void OpcodeStatistics::analyzeStatic(const std::vector<BytecodeVM> &code, const BytecodeDebugInfo *debugInfo)
+{
+	_staticPairs.clear();
+	_staticTriples.clear();
+	_jumpTargets.assign(code.size() + 1, false);
+	if (debugInfo)
+	{
+		for (const auto& s : debugInfo->symbols)
+			if (s.first < _jumpTargets.size())
+				_jumpTargets[s.first] = true;
+	}
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		const BytecodeVM& o = code[i];
+		if (o.op == BytecodeVM::JMP || o.op == BytecodeVM::FJMP || o.op == BytecodeVM::TJMP)
+		{
+			const int64_t target = int64_t(i) + o.values[0].getValue<int>();
+			if (target >= 0 && target < int64_t(_jumpTargets.size()))
+				_jumpTargets[target] = true;
+		}
+		if (o.op == BytecodeVM::CALL)
+		{
+			const int target = o.values[0].getValue<int>();
+			if (target >= 0 && target < int(_jumpTargets.size()))
+				_jumpTargets[target] = true;
+			if (i + 1 < _jumpTargets.size())
+				_jumpTargets[i + 1] = true; // return address.
+		}
+	}
+
+	int length = 0;
+	Key prev[2] = {0, 0};
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		const BytecodeVM& o = code[i];
+		const Key key = makeKey(o, nullptr);
+		if (_jumpTargets[i])
+			length = 0;
+		if (length >= 1)
+			_staticPairs[pairKey(prev[1], key)]++;
+		if (length >= 2)
+			_staticTriples[Triple{{prev[0], prev[1], key}}]++;
+		prev[0] = prev[1];
+		prev[1] = key;
+		if (length < 2)
+			length++;
+		if (o.op == BytecodeVM::JMP || o.op == BytecodeVM::FJMP || o.op == BytecodeVM::TJMP
+			|| o.op == BytecodeVM::CALL || o.op == BytecodeVM::RET)
+			length = 0;
+	}
+}
+
+std::string OpcodeStatistics::report(size_t limit) const
+{
+	// static sequences are counted without runtime operand types, so match them by opcode part of key.
+	auto staticKey = [](Key k) -> Key { return k & 0xFF; };
+	std::unordered_map<uint64_t, uint64_t> staticPairsByOp;
+	for (const auto& p : _staticPairs)
+		staticPairsByOp[pairKey(staticKey(Key(p.first >> 32)), staticKey(Key(p.first)))] += p.second;
+
+	std::vector<Candidate> candidates;
+	for (const auto& p : _pairs)
+	{
+		const Key a = Key(p.first >> 32), b = Key(p.first);
+		Candidate c;
+		c.name = keyToString(a) + " ; " + keyToString(b);
+		c.count = p.second;
+		auto st = staticPairsByOp.find(pairKey(staticKey(a), staticKey(b)));
+		c.staticCount = st == staticPairsByOp.end() ? 0 : st->second;
+		c.length = 2;
+		candidates.push_back(c);
+	}
+	for (const auto& t : _triples)
+	{
+		Candidate c;
+		c.name = keyToString(t.first.k[0]) + " ; " + keyToString(t.first.k[1]) + " ; " + keyToString(t.first.k[2]);
+		c.count = t.second;
+		c.staticCount = 0;
+		for (const auto& st : _staticTriples)
+			if (staticKey(st.first.k[0]) == staticKey(t.first.k[0])
+				&& staticKey(st.first.k[1]) == staticKey(t.first.k[1])
+				&& staticKey(st.first.k[2]) == staticKey(t.first.k[2]))
+				c.staticCount += st.second;
+		c.length = 3;
+		candidates.push_back(c);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& l, const Candidate& r) {
+		return l.score() > r.score() || (l.score() == r.score() && l.name < r.name);
+	});
+
+	std::vector<std::pair<Key, uint64_t>> singles(_single.begin(), _single.end());
+	std::sort(singles.begin(), singles.end(), [](const std::pair<Key, uint64_t>& l, const std::pair<Key, uint64_t>& r) {
+		return l.second > r.second;
+	});
+
+	std::ostringstream os;
+	const double total = _total ? double(_total) : 1.0;
+	os << "executed: " << _total << "\n";
+	os << "--- typed opcodes ---\n";
+	for (size_t i = 0; i < singles.size() && i < limit; i++)
+		os << std::setw(12) << singles[i].second << " " << std::fixed << std::setprecision(2) << std::setw(6)
+		   << (100.0 * singles[i].second / total) << "%  " << keyToString(singles[i].first) << "\n";
+
+	os << "--- fusion candidates (saved dispatches, count, static occurrences) ---\n";
+	for (size_t i = 0; i < candidates.size() && i < limit; i++)
+	{
+		const Candidate& c = candidates[i];
+		os << std::setw(12) << c.score() << " " << std::fixed << std::setprecision(2) << std::setw(6)
+		   << (100.0 * c.score() / total) << "%  x" << c.count << "  static:" << c.staticCount << "  " << c.name << "\n";
+	}
+	return os.str();
+}
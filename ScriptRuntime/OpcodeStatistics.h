@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include "BytecodeVM.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+/**
+ * \brief Opcode n-gram counters, used to choose superinstructions and typed opcodes.
+ *
+ * Attach to ScriptVM::_opcodeStatistics; VM calls record() for each executed instruction.
+ * Dynamic pairs and triples are counted only for straight-line sequences (no jump in between
+ * and no jump target inside), so every reported sequence could be fused.
+ * Static sequences are counted over whole code by analyzeStatic().
+ */
+class OpcodeStatistics
+{
+public:
+	/// op | sub-operation << 8 | operand type << 16 | flags << 24.
+	using Key = uint32_t;
+	static Key makeKey(const BytecodeVM& o, const ScriptVariant* top);
+	static std::string keyToString(Key key);
+
+	void clear();
+	void startRun(const std::vector<BytecodeVM>& code, const BytecodeDebugInfo* debugInfo = nullptr);   //!< called by VM on run start.
+	/// Symbols of debugInfo are sequence boundaries too, as entries reached not only by jumps.
+	void analyzeStatic(const std::vector<BytecodeVM>& code, const BytecodeDebugInfo* debugInfo = nullptr);
+	inline void record(const BytecodeVM& o, uint32_t pc, const ScriptVariant* top);
+
+	/// Ranked fusion candidates; score is dispatches saved = count * (length - 1).
+	std::string report(size_t limit = 20) const;
+
+	uint64_t total() const { return _total; }
+
+private:
+	struct Triple {
+		Key k[3];
+		bool operator ==(const Triple& another) const { return k[0] == another.k[0] && k[1] == another.k[1] && k[2] == another.k[2]; }
+	};
+	struct TripleHash {
+		size_t operator()(const Triple& t) const { return (size_t(t.k[0]) * 0x9E3779B1u) ^ (size_t(t.k[1]) * 0x85EBCA77u) ^ t.k[2]; }
+	};
+	using Counters = std::unordered_map<Key, uint64_t>;
+	using PairCounters = std::unordered_map<uint64_t, uint64_t>;
+	using TripleCounters = std::unordered_map<Triple, uint64_t, TripleHash>;
+
+	static uint64_t pairKey(Key a, Key b) { return (uint64_t(a) << 32) | b; }
+
+	Counters _single;
+	PairCounters _pairs;
+	TripleCounters _triples;
+	PairCounters _staticPairs;
+	TripleCounters _staticTriples;
+
+	std::vector<bool> _jumpTargets;
+	Key _prev[2] = {0, 0};
+	uint32_t _prevPc = 0;
+	int _seqLength = 0;
+	uint64_t _total = 0;
+};
+
+inline void OpcodeStatistics::record(const BytecodeVM& o, uint32_t pc, const ScriptVariant* top)
+{
+	const Key key = makeKey(o, top);
+	_total++;
+	_single[key]++;
+
+	const bool straight = _seqLength > 0 && pc == _prevPc + 1 && !(pc < _jumpTargets.size() && _jumpTargets[pc]);
+	if (!straight)
+		_seqLength = 0;
+
+	if (_seqLength >= 1)
+		_pairs[pairKey(_prev[1], key)]++;
+	if (_seqLength >= 2)
+		_triples[Triple{{_prev[0], _prev[1], key}}]++;
+
+	_prev[0] = _prev[1];
+	_prev[1] = key;
+	_prevPc = pc;
+	if (_seqLength < 2)
+		_seqLength++;
+
+	// control transfer may only end fused sequence.
+	if (o.op == BytecodeVM::JMP || o.op == BytecodeVM::FJMP || o.op == BytecodeVM::TJMP
+		|| o.op == BytecodeVM::CALL || o.op == BytecodeVM::RET)
+		_seqLength = 0;
+}
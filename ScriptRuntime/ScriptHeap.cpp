@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ScriptHeap.h"
+
+#include <stdexcept>
+
+size_t ScriptHeap::sizeClass(size_t size)
+{
+	size_t c = 0;
+	while ((size_t(1) << c) < size)
+		c++;
+	return c;
+}
+
+ScriptVariant::AddressPtr ScriptHeap::allocate(const ScriptVariant *values, size_t size)
+{
+	const size_t c = sizeClass(size ? size : 1);
+	Block* block = nullptr;
+	if (c < _free.size() && !_free[c].empty())
+	{
+		block = _free[c].back();
+		_free[c].pop_back();
+	}
+	else if (_top < _blocks.size())
+	{
+		block = &_blocks[_top++]; // left from previous run, class may differ.
+	}
+	else
+	{
+		_blocks.emplace_back();
+		block = &_blocks.back();
+		_owners[&block->data] = block;
+		_top++;
+		_stats.newBlocks++;
+	}
+	block->data.reserve(size_t(1) << c);
+	block->data.assign(values, values + size);
+	if (!size)
+		block->data.resize(1);
+	block->sizeClass = c;
+	block->generation = _generation;
+	block->live = true;
+	_stats.allocations++;
+	_stats.liveBlocks++;
+
+	ScriptVariant::AddressPtr ptr;
+	ptr.container = &block->data;
+	ptr.container2 = nullptr;
+	ptr.index = 0;
+	ptr.maxIndex = block->data.size() - 1;
+	return ptr;
+}
+
+void ScriptHeap::release(const ScriptVariant::AddressPtr &ptr)
+{
+	auto it = ptr.container2 ? _owners.end() : _owners.find(ptr.container);
+	if (it == _owners.end())
+		throw std::runtime_error("Dispose of pointer that was not allocated by New.");
+	Block* block = it->second;
+	if (!isLive(*block))
+		throw std::runtime_error("Dispose of already disposed pointer.");
+	if (ptr.index != 0)
+		throw std::runtime_error("Dispose of pointer that does not point to start of block.");
+
+	block->live = false;
+	_stats.liveBlocks--;
+	if (_quarantine)
+		return;
+	if (_free.size() <= block->sizeClass)
+		_free.resize(block->sizeClass + 1);
+	_free[block->sizeClass].push_back(block);
+}
+
+void ScriptHeap::reset()
+{
+	_generation++;
+	_top = 0;
+	for (std::vector<Block*>& list : _free)
+		list.clear();
+	_stats = Stats();
+}
+
+void ScriptHeap::clear()
+{
+	_owners.clear();
+	_free.clear();
+	_blocks.clear();
+	_top = 0;
+	_stats = Stats();
+}
+
+void ScriptHeap::collectHeapUsage(size_t &arenaBytes, ScriptVariant::HeapUsage &usage, std::set<const void *> &seenStrings) const
+{
+	for (const Block& block : _blocks)
+	{
+		arenaBytes += sizeof(Block) + block.data.capacity() * sizeof(ScriptVariant);
+		if (!isLive(block))
+			continue;
+		for (const ScriptVariant& v : block.data)
+			v.collectHeapUsage(usage, seenStrings);
+	}
+}
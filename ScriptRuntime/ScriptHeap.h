@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include "ScriptVariant.h"
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief Storage for New/Dispose blocks of ScriptVM.
+ *
+ * Block is a container of variants, so pointers to it are regular AddressPtr. Blocks are never returned to
+ * global allocator while heap lives: disposed block goes to free list of its size class (power of two), new block
+ * is taken from free list or from the end of arena. reset() makes all blocks free at once without touching them,
+ * so next run reuses arena from the beginning.
+ */
+class ScriptHeap
+{
+public:
+	struct Stats {
+		size_t allocations = 0;   //!< New calls since reset().
+		size_t newBlocks = 0;     //!< blocks appended to arena since reset(); other allocations reuse memory.
+		size_t liveBlocks = 0;    //!< allocated and not disposed.
+	};
+
+	ScriptHeap() = default;
+	ScriptHeap(const ScriptHeap&) = delete;
+	ScriptHeap& operator =(const ScriptHeap&) = delete;
+
+	/// Block of size slots initialized with values; returns pointer to first slot.
+	ScriptVariant::AddressPtr allocate(const ScriptVariant* values, size_t size);
+	/// Throws std::runtime_error if ptr is not first slot of live block.
+	void release(const ScriptVariant::AddressPtr& ptr);
+	/// Disposes all blocks; memory is kept for next allocations.
+	void reset();
+	/// Frees memory; pointers to blocks become invalid.
+	void clear();
+
+	/// Disposed blocks are not reused until reset(), so second Dispose through stale pointer is detected.
+	void setQuarantine(bool quarantine) { _quarantine = quarantine; }
+	const Stats& stats() const { return _stats; }
+	/// Arena storage and heap payload of live blocks.
+	void collectHeapUsage(size_t& arenaBytes, ScriptVariant::HeapUsage& usage, std::set<const void*>& seenStrings) const;
+
+private:
+	struct Block {
+		std::vector<ScriptVariant> data;
+		size_t sizeClass = 0;
+		uint32_t generation = 0;  //!< block is live only in generation it was allocated.
+		bool live = false;
+	};
+	static size_t sizeClass(size_t size);
+	bool isLive(const Block& block) const { return block.live && block.generation == _generation; }
+
+	std::deque<Block> _blocks;                  //!< deque keeps addresses of blocks when arena grows.
+	size_t _top = 0;                            //!< blocks before _top are allocated or in free lists.
+	std::vector<std::vector<Block*>> _free;     //!< per size class.
+	std::unordered_map<const std::vector<ScriptVariant>*, Block*> _owners;
+	uint32_t _generation = 0;
+	bool _quarantine = false;
+	Stats _stats;
+};
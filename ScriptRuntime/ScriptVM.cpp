@@ -19,7 +19,7 @@
 #include <algorithm>
 #include <string>
 
-const int ScriptVM::_formatVersion = 1;
+const int ScriptVM::_formatVersion = 3;
 
 ScriptVM::ScriptVM()
 {
@@ -27,7 +27,14 @@ ScriptVM::ScriptVM()
 	_errout =nullptr;
 	_stdout =nullptr;
 	_debugout =nullptr;
+	_opcodeStatistics = nullptr;
+	_compileThreshold = 8;
+	_optimizeThreshold = 1000;
+	_optimizeInBackground = true;
+	_useJit = true;
+	_resetHeapOnRun = true;
 	_stackSize = 0;
+	_maxStackSize = 0;
 	_startPC   = 0;
 	_debugFlags = 0;
 	_totalOPC = 0;
@@ -42,13 +49,20 @@ ScriptVM::ScriptVM()
 
 ScriptVM::~ScriptVM()
 {
+	resetCompiled(); // worker may still read _code.
 }
 
 void ScriptVM::clear()
 {
+	resetCompiled();
 	_nameTable.clear();
 	_funcTable.clear();
 	_code.clear();
+	_debugInfo.clear();
+	_constants.reset();
+	_maxCallDepth = 0;
+	unloadNativeModule();
+	_heap.clear();
 	initialState();
 	_runState = rsFinished;
 }
@@ -230,6 +244,129 @@ bool ScriptVM::hasFunction(std::string index)
 	return false;
 }
 
+namespace {
+ScriptVM::NameRecord* findBoundVariable(ScriptVM* vm, const char* name)
+{
+	std::string index(name);
+	std::transform(index.begin(), index.end(), index.begin(), ::tolower);
+	for (ScriptVM::NameRecord& nr : vm->_nameTable)
+		if (nr._resolved && nr._name == index)
+			return &nr;
+	return nullptr;
+}
+
+PascalNativeValue toNativeValue(const ScriptVariant& var)
+{
+	PascalNativeValue value;
+	value.isFloat = ScriptVariant::isTypeFloat(ScriptVariant::Types(var._Type));
+	value.i = value.isFloat ? 0 : var.getValue<int64_t>();
+	value.d = value.isFloat ? var.getValue<double>() : 0.0;
+	return value;
+}
+
+ScriptVariant fromNativeValue(const PascalNativeValue& value)
+{
+	return value.isFloat ? ScriptVariant(value.d) : ScriptVariant(value.i);
+}
+
+int nativeGetVar(void* vm, const char* name, PascalNativeValue* value)
+{
+	ScriptVM::NameRecord* nr = findBoundVariable(static_cast<ScriptVM*>(vm), name);
+	if (!nr)
+		return 0;
+	*value = toNativeValue(*nr->_ptr.get()->getReferenced());
+	return 1;
+}
+
+int nativeSetVar(void* vm, const char* name, const PascalNativeValue* value)
+{
+	ScriptVM::NameRecord* nr = findBoundVariable(static_cast<ScriptVM*>(vm), name);
+	if (!nr || !(nr->_flags & ScriptVM::NameRecord::bdOutput))
+		return 0;
+	nr->_ptr.get()->setOpValue(fromNativeValue(*value));
+	return 1;
+}
+
+int nativeCall(void* vm, const char* name, PascalNativeValue* results, int resultCount, const PascalNativeValue* args, int argCount)
+{
+	std::string index(name);
+	std::transform(index.begin(), index.end(), index.begin(), ::tolower);
+	for (ScriptVM::FuncNameRecord& f : static_cast<ScriptVM*>(vm)->_funcTable)
+	{
+		if (f._name != index)
+			continue;
+
+		std::vector<ScriptVariant> resultValues(resultCount, ScriptVariant(0.0)), argValues(argCount);
+		std::vector<ScriptVariant*> resultPtrs(resultCount), argPtrs(argCount);
+		for (int i = 0; i < resultCount; i++)
+			resultPtrs[i] = &resultValues[i];
+		for (int i = 0; i < argCount; i++)
+		{
+			argValues[i] = fromNativeValue(args[i]);
+			argPtrs[i] = &argValues[i];
+		}
+		if (f._callback)
+			f._callback(resultPtrs, argPtrs);
+		else if (f._callback2)
+			f._callback2->call(resultPtrs, argPtrs);
+		else
+			return 0;
+
+		for (int i = 0; i < resultCount; i++)
+			results[i] = toNativeValue(*resultValues[i].getReferenced());
+		return 1;
+	}
+	return 0;
+}
+
+void nativeWrite(void* vm, const char* text)
+{
+	std::ostream* out = static_cast<ScriptVM*>(vm)->_stdout;
+	if (out)
+		(*out) << text;
+}
+}
+
+bool ScriptVM::loadNativeModule(const std::string &path)
+{
+	std::unique_ptr<NativeModule> module(new NativeModule());
+	std::string error;
+	if (!module->load(path, error))
+	{
+		if (_errout)
+			(*_errout) << "Native module error:" << error << std::endl;
+		return false;
+	}
+	_nativeModule = std::move(module);
+	return true;
+}
+
+void ScriptVM::unloadNativeModule()
+{
+	_nativeModule.reset();
+}
+
+void ScriptVM::runNative()
+{
+	PascalNativeAbi abi;
+	abi.version = PASCAL_NATIVE_ABI_VERSION;
+	abi.vm = this;
+	abi.getVar = &nativeGetVar;
+	abi.setVar = &nativeSetVar;
+	abi.call = &nativeCall;
+	abi.write = &nativeWrite;
+
+	_opCnt = 0;
+	const int status = _nativeModule->run(&abi);
+	if (status != 0)
+	{
+		std::ostringstream os;
+		os << "native module returned " << status;
+		runtimeError(os.str());
+	}
+	_runState = rsFinished;
+}
+
 void ScriptVM::initialState()
 {
 	_pc = _startPC;
@@ -237,21 +374,44 @@ void ScriptVM::initialState()
 	_stackFrames[0] = CallStackFrame(0,0, _code.size(), 0, 0);
 	_opCnt = 0;
 	sClear();
+	_maxStackSize = 0;
+	if (_compiled.size() != _code.size()) // first run after resetCompiled().
+	{
+		_compiled.assign(_code.size(), CompiledOp());
+		_hotCounters.assign(_code.size(), HotCounter());
+	}
+	_heap.setQuarantine((_debugFlags & dHeap) != 0);
 	_runState = rsRunning;
 }
 
 void ScriptVM::run()
 {
+	if (hasNativeModule())
+	{
+		runNative();
+		return;
+	}
+
 	if (_runState != rsRunning)
+	{
 		initialState();
+		if (_opcodeStatistics)
+			_opcodeStatistics->startRun(_code, &_debugInfo);
+	}
 
 	size_t callLevelStart = _stackFrames.size();
+	const bool useCompiled = canRunCompiled();
 
 	ExecutionStatus status = Success;
 	try { //  DEREF can throw cyclic ref exception.
 
 		while (status == Success)
 		{
+			if (useCompiled && _pc < _compiled.size() && _compiled[_pc].handler)
+			{
+				status = runCompiled(); // returns on first instruction left to interpreter.
+				continue;
+			}
 
 			status = executeOneCommand();
 			_opCnt++;
@@ -276,7 +436,10 @@ void ScriptVM::run()
 		status = Error;
 	}
 	if (status == Error)
+	{
 		_runState = rsFinished;
+		finishHeap();
+	}
 }
 
 
@@ -301,6 +464,17 @@ int ScriptVM::addStaticVariable(std::string index, const std::vector<ScriptVaria
 	return this->_nameTable.size()-1;
 }
 
+int ScriptVM::addConstants(const std::vector<ScriptVariant> &values)
+{
+	if (!_constants)
+		_constants = std::make_shared<std::vector<ScriptVariant>>();
+	else if (_constants.use_count() > 1)
+		_constants = std::make_shared<std::vector<ScriptVariant>>(*_constants);
+	const int offset = _constants->size();
+	_constants->insert(_constants->end(), values.begin(), values.end());
+	return offset;
+}
+
 int ScriptVM::addFunction(std::string index)
 {
 	std::transform(index.begin(), index.end(), index.begin(), ::tolower);
@@ -312,6 +486,77 @@ int ScriptVM::addFunction(std::string index)
 
 //------------------ BC runtime implementation ---------------
 
+bool ScriptVM::pushReference(int offset, int scopeLevel, int size, bool autoDeref)
+{
+	int address = 0;
+	for(int i = _stackFrames.size() - 1; i>=0; i--)
+	{
+		if (_stackFrames[i].scopeLevel == scopeLevel || i == 0)
+		{
+			address =  _stackFrames[i].bottomAddress;
+			break;
+		}
+	}
+	address+= offset;
+	if ( address >= sSize())
+		return false;
+
+	ScriptVariant r;
+	r.setPointer(_stack, address, size,  autoDeref);
+	sPush(r);
+	return true;
+}
+
+void ScriptVM::callExternal(int index, int argSize, int retSize)
+{
+	std::vector<ScriptVariant*>  results(retSize);
+	std::vector<ScriptVariant*>  args(argSize);
+
+	for(int i = 0; i < retSize; i++) {
+		results[i]= (&(sList(argSize + retSize, i)));
+	}
+	for(int i = 0; i < argSize; i++) {
+		args[i]= (&(sList(argSize, i)));
+	}
+
+	if (_funcTable[index]._callback)
+		_funcTable[index]._callback(results, args);
+	else if (_funcTable[index]._callback2)
+		_funcTable[index]._callback2->call(results, args);
+	else
+		runtimeError("unresolved call!");
+
+	sPops(argSize);
+}
+
+void ScriptVM::heapAllocate(int size)
+{
+	ScriptVariant::AddressPtr block = _heap.allocate(size ? &sTop(size - 1) : nullptr, size);
+	ScriptVariant* pointer = sTop(size).getReferenced(0, 1);
+	pointer->setPointer(block, false);
+	sPops(size + 1);
+}
+
+void ScriptVM::heapRelease()
+{
+	ScriptVariant* pointer = sTop().getReferenced(0, 1);
+	const ScriptVariant::AddressPtr* block = pointer->getPointer();
+	if (!block)
+		throw std::runtime_error("Dispose of pointer that was not allocated by New.");
+	_heap.release(*block);
+	pointer->setValue(0, ScriptVariant::T_int32_t); // same as uninitialized pointer.
+	sPops();
+}
+
+void ScriptVM::finishHeap()
+{
+	const size_t leaked = _heap.stats().liveBlocks;
+	if (leaked && _debugout && (_debugFlags & dHeap))
+		(*_debugout) << "HEAP: " << leaked << " blocks were not disposed, " << _heap.stats().allocations << " allocated.\n";
+	if (_resetHeapOnRun)
+		_heap.reset();
+}
+
 ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 {
 	int opcode_n = -1;
@@ -321,6 +566,8 @@ ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 		const BytecodeVM &o = _code[_pc];
 		if (_debugout && (_debugFlags & dOpcode))
 			(*_debugout)<< "[" << std::setfill (' ') << std::setw(3) << _pc  << std::setw(3) << "]: "<<o.ConvertToString(false)<<"\n";
+		if (_opcodeStatistics)
+			_opcodeStatistics->record(o, _pc, sSize() ? &sTop() : nullptr);
 
 		bool incPC = true;
 		int opcValue =0;
@@ -346,30 +593,12 @@ ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 			multOperation(BytecodeVM::BinOp(opcValue), ScriptVariant::Types(opcValue2), o.values[2].getValue<int>());
 			break;
 		case BytecodeVM::REF:{
-			ScriptVariant r;
-			int address = 0;
-			int scopeLevel = opcValue2;
-			int size  = o.values[2].getValue<int>();
 			bool autoDeref = o.values.size() > 3 ? o.values[3].getValue<bool>() : true;
-			for(int i = _stackFrames.size() - 1; i>=0; i--)
-			{
-				if (_stackFrames[i].scopeLevel == scopeLevel || i == 0)
-				{
-					address =  _stackFrames[i].bottomAddress;
-					break;
-				}
-			}
-			address+= opcValue;
-			if ( address >= sSize())
+			if (!pushReference(opcValue, opcValue2, o.values[2].getValue<int>(), autoDeref))
 			{
 				runtimeError(std::string("Trying to reference address beyond stack size."));
 				return Error;
 			}
-			else
-			{
-				r.setPointer(_stack, address, size,  autoDeref);
-			}
-			sPush(r);
 		} break;
 
 		case BytecodeVM::REFEXT:{
@@ -386,6 +615,9 @@ ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 		case BytecodeVM::PUSH:
 			sPush(o.values[0], opcValue2);
 			break;
+		case BytecodeVM::PUSHC:
+			sPushRange(_constants->data() + opcValue, opcValue2);
+			break;
 
 		case BytecodeVM::CALL:{
 
@@ -395,34 +627,17 @@ ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 			int bottomAddress = sSize() - argSize - retSize;
 
 			_stackFrames.push_back(CallStackFrame(retSize, argSize, _pc + 1,bottomAddress, stackLevel)  );
+			if (_stackFrames.size() > _maxCallDepth)
+				_maxCallDepth = _stackFrames.size();
 
 			_pc = opcValue;
+			countCall(_pc);
 
 			incPC = false;
 			}break;
-		case BytecodeVM::CALLEXT:{
-			int index=opcValue;
-			int argSize = opcValue2;
-			int retSize = o.values[2].getValue<int>();
-			std::vector<ScriptVariant*>  results(retSize);
-			std::vector<ScriptVariant*>  args(argSize);
-
-			for(int i = 0; i < retSize; i++) {
-				results[i]= (&(sList(argSize + retSize, i)));
-			}
-			for(int i = 0; i < argSize; i++) {
-				args[i]= (&(sList(argSize, i)));
-			}
-
-			if (_funcTable[index]._callback)
-				_funcTable[index]._callback(results, args);
-			else if (_funcTable[index]._callback2)
-				_funcTable[index]._callback2->call(results, args);
-			else
-				runtimeError("unresolved call!");
-
-			sPops(argSize);
-		}break;
+		case BytecodeVM::CALLEXT:
+			callExternal(opcValue, opcValue2, o.values[2].getValue<int>());
+			break;
 		case BytecodeVM::RET:{
 
 			incPC = false;
@@ -478,6 +693,14 @@ ScriptVM::ExecutionStatus ScriptVM::executeOneCommand()
 			sPops(opcValue);
 			break;
 
+		case BytecodeVM::ALLOC:
+			heapAllocate(opcValue);
+			break;
+
+		case BytecodeVM::FREE:
+			heapRelease();
+			break;
+
 		case BytecodeVM::CVRT:
 			sTop(0).setType( ScriptVariant::Types(opcValue) );
 			break;
@@ -538,7 +761,18 @@ void ScriptVM::printOpcodes()
 	size_t size = _code.size();
 	for(size_t i = 0; i<size; i++)
 	{
-		(*_debugout)<< std::setfill (' ') << std::setw(3) <<  i  << std::setw(1) << ": " << _code[i].ConvertToString() << std::endl;
+		(*_debugout)<< std::setfill (' ') << std::setw(3) <<  i  << std::setw(1) << ": " << _code[i].ConvertToString();
+		std::string target;
+		if (_code[i].op == BytecodeVM::CALL)
+			target = _debugInfo.symbol(_code[i].values[0].getValue<int>());
+		else if (_code[i].op == BytecodeVM::CALLEXT && size_t(_code[i].values[0].getValue<int>()) < _funcTable.size())
+			target = _funcTable[_code[i].values[0].getValue<int>()]._name;
+		if (target.size())
+			(*_debugout)<< " GOTO " << target << ";";
+		std::string label = _debugInfo.symbol(i);
+		if (label.size())
+			(*_debugout)<< " @<- " << label << "; ";
+		(*_debugout)<< std::endl;
 	}
 }
 
@@ -631,6 +865,13 @@ ByteOrderDataStreamWriter &operator <<(ByteOrderDataStreamWriter &of, const Scri
 	{
 		of<<opc._funcTable[i];
 	}
+	size = opc._constants ? opc._constants->size() : 0;
+	of << size;
+	for(uint32_t i = 0; i<size; i++)
+	{
+		of<<(*opc._constants)[i];
+	}
+	of << opc._debugInfo;
 	return of;
 }
 ByteOrderDataStreamReader &operator >>(ByteOrderDataStreamReader &ifs, ScriptVM &opc)
@@ -643,6 +884,7 @@ ByteOrderDataStreamReader &operator >>(ByteOrderDataStreamReader &ifs, ScriptVM
 	ifs  >> opc._startPC;
 	uint32_t size=0;
 	ifs >> size;
+	opc.resetCompiled();
 	opc._code.resize(size);
 	for(uint32_t i = 0; i<size; i++)
 	{
@@ -660,6 +902,18 @@ ByteOrderDataStreamReader &operator >>(ByteOrderDataStreamReader &ifs, ScriptVM
 	{
 		ifs>>opc._funcTable[i];
 	}
+	ifs >> size;
+	opc._constants = std::make_shared<std::vector<ScriptVariant>>(size);
+	for(uint32_t i = 0; i<size; i++)
+	{
+		ifs>>(*opc._constants)[i];
+	}
+	for (const BytecodeVM& o : opc._code)
+	{
+		if (o.op == BytecodeVM::PUSHC && size_t(o.values[0].getValue<int>()) + o.values[1].getValue<int>() > size)
+			throw std::runtime_error("constant pool is smaller than code expects.");
+	}
+	ifs >> opc._debugInfo;
 	return ifs;
 }
 
@@ -772,6 +1026,52 @@ std::string ScriptVM::getProfilingData()
    return os.str();
 }
 
+ScriptVM::MemoryStats ScriptVM::getMemoryStats() const
+{
+	MemoryStats stats;
+	ScriptVariant::HeapUsage usage;
+	std::set<const void*> seenStrings; // string buffers are shared between copied slots.
+
+	stats.stackHighWater = _maxStackSize;
+	stats.stackBytes = _stack.capacity() * sizeof(ScriptVariant)
+			+ _stackFrames.capacity() * sizeof(CallStackFrame);
+	stats.maxCallDepth = getMaxCallDepth();
+	for (const ScriptVariant& v : _stack)
+		v.collectHeapUsage(usage, seenStrings);
+
+	stats.staticCount = _staticVars.size();
+	stats.staticBytes = _staticVars.capacity() * sizeof(ScriptVariant);
+	for (const ScriptVariant& v : _staticVars)
+		v.collectHeapUsage(usage, seenStrings);
+	for (const NameRecord& nr : _nameTable) {
+		stats.staticBytes += nr._staticValues.capacity() * sizeof(ScriptVariant);
+		for (const ScriptVariant& v : nr._staticValues)
+			v.collectHeapUsage(usage, seenStrings);
+	}
+
+	stats.codeCount = _code.size();
+	stats.codeBytes = _code.capacity() * sizeof(BytecodeVM);
+	for (const BytecodeVM& o : _code) {
+		stats.codeBytes += o.values.capacity() * sizeof(ScriptVariant);
+		for (const ScriptVariant& v : o.values)
+			v.collectHeapUsage(usage, seenStrings);
+	}
+	stats.codeBytes += _compiled.capacity() * sizeof(CompiledOp) + _hotCounters.capacity() * sizeof(HotCounter);
+	stats.codeBytes += getJitCodeBytes();
+	stats.debugInfoBytes = _debugInfo.memoryBytes();
+	if (_constants) {
+		stats.codeBytes += _constants->capacity() * sizeof(ScriptVariant);
+		for (const ScriptVariant& v : *_constants)
+			v.collectHeapUsage(usage, seenStrings);
+	}
+
+	_heap.collectHeapUsage(stats.heapBytes, usage, seenStrings);
+
+	stats.stringBytes = usage.stringBytes;
+	stats.payloadBytes = usage.payloadBytes;
+	return stats;
+}
+
 void ScriptVM::setExternalData(const ScriptVariant &data)
 {
 	for (size_t i=0;i< _nameTable.size();i++)
@@ -13,6 +13,9 @@
 #pragma once
 
 #include "BytecodeVM.h"
+#include "OpcodeStatistics.h"
+#include "NativeModule.h"
+#include "ScriptHeap.h"
 
 #include <ByteOrderStream.h>
 
@@ -25,6 +28,10 @@
 #include <map>
 #include <set>
 #include <functional>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <exception>
 
 /**
  * \brief Virtual bytecode machi for script exection
@@ -74,9 +81,37 @@ public:
 	};
 
 
+	/// Memory footprint of VM instance, see getMemoryStats().
+	struct MemoryStats {
+		size_t stackHighWater = 0;     //!< max operand stack slots used in current run (same as getMaxStackSize()).
+		size_t stackBytes = 0;         //!< allocated operand stack storage.
+		size_t maxCallDepth = 0;       //!< max _stackFrames depth since clear().
+		size_t staticCount = 0;        //!< static variable slots.
+		size_t staticBytes = 0;        //!< static variables storage, including initial values in name table.
+		size_t stringBytes = 0;        //!< live string buffers held by stack, statics and code.
+		size_t payloadBytes = 0;       //!< array and map payload held by stack, statics and code.
+		size_t heapBytes = 0;          //!< New/Dispose arena, including disposed blocks kept for reuse.
+		size_t codeCount = 0;          //!< instructions count.
+		size_t codeBytes = 0;          //!< instructions storage including operands and constant pool.
+		size_t debugInfoBytes = 0;     //!< line table and symbols.
+		size_t totalBytes() const { return stackBytes + staticBytes + stringBytes + payloadBytes + heapBytes + codeBytes + debugInfoBytes; }
+	};
+
+	/// Instruction of hot function, predecoded for handler dispatch. See ScriptVM_compiled.cpp.
+	struct CompiledOp {
+		using Handler = void (ScriptVM::*)(const CompiledOp&);
+		Handler handler = nullptr;           //!< nullptr - instruction is left to interpreter.
+		int a = 0, b = 0, c = 0, d = 0;      //!< integer operands, in BytecodeVM::values order; fused ops document own layout.
+		const ScriptVariant* value = nullptr;//!< PUSH value.
+		uint32_t entry = 0;                  //!< entry address of function, for loop counter.
+	};
+	using CompiledRange = std::vector<std::pair<uint32_t, CompiledOp>>;
+
 	static const int _formatVersion;
+	static const int _imageVersion;   //!< layout of saveImage() records.
 
-	enum DebugFlags { dNone = 0, dOpcode = 1 << 1, dStack = 1 << 2, dExternalVars = 1 << 3, dStaticVars = 1 << 4, dCallStack = 1 << 5, dOperations = 1 << 6,  dEmergencyMode = 1 << 7 };
+	enum DebugFlags { dNone = 0, dOpcode = 1 << 1, dStack = 1 << 2, dExternalVars = 1 << 3, dStaticVars = 1 << 4, dCallStack = 1 << 5, dOperations = 1 << 6,  dEmergencyMode = 1 << 7, dHeap = 1 << 8,
+					  dAllRuntime = dOpcode | dStack | dExternalVars | dStaticVars | dCallStack | dOperations }; //!< dAllRuntime - traced by interpreter only.
 	enum RunState { rsFinished, rsRunning };
 
 	int _debugFlags;
@@ -85,11 +120,18 @@ public:
 	bool _isRunnable;
 	bool _doExit;
 	std::vector<BytecodeVM> _code;
+	BytecodeDebugInfo _debugInfo;        //!< locations and symbols of _code; optional, interpreter does not read it.
 	std::vector<NameRecord> _nameTable;
 	std::vector<FuncNameRecord> _funcTable;
 	std::ostream* _errout;
 	std::ostream* _stdout;
 	std::ostream* _debugout;
+	OpcodeStatistics* _opcodeStatistics; //!< if set, every executed opcode is recorded.
+	int _compileThreshold;               //!< calls of function before it is translated to handlers; -1 disables.
+	int _optimizeThreshold;              //!< calls and loop iterations of translated function before typed/fused retranslation; -1 disables.
+	bool _optimizeInBackground;          //!< retranslate in worker thread; result is applied on next call or loop iteration.
+	bool _useJit;                        //!< translated functions are also emitted as x86-64 code; other platforms run handlers only.
+	bool _resetHeapOnRun;                //!< blocks not disposed by script are freed in O(1) when run finishes.
 	RunState  _runState;
 	bool _useBreakPoints;
 	std::set<int> _breakPointPC;
@@ -108,6 +150,11 @@ public:
 	int addVariable(std::string index, int size, NameRecord::BindDirection bd = NameRecord::bdIO);
 	int addStaticVariable(std::string index, const std::vector<ScriptVariant> &values);
 	int addFunction(std::string index);
+	/// Appends values to constant pool, returns offset for PUSHC. Pool shared with another VM is copied first.
+	int addConstants(const std::vector<ScriptVariant> &values);
+	/// Read-only data of program; VMs loaded with same program can share one pool instead of keeping copies.
+	const std::shared_ptr<const std::vector<ScriptVariant>> constants() const { return _constants; }
+	void shareConstants(const ScriptVM& another) { _constants = another._constants; }
 
 	bool bindFunction( std::string index, FuncNameRecord::funCallback func);
 	bool bindFunction( std::string index, FuncNameRecordInterface* func);
@@ -120,18 +167,43 @@ public:
 	bool initStatic();
 	bool hasFunction(std::string index);
 
+	bool loadNativeModule(const std::string& path);   //!< run() calls module entry instead of bytecode, until unloaded.
+	void unloadNativeModule();
+	bool hasNativeModule() const { return _nativeModule && _nativeModule->isLoaded(); }
+
 
 	void printOpcodes();
 	bool importFromHexString(const std::string &str);
 	std::string exportToHex() const;
+	/// Flat image of program with fixed-width records, see ScriptVM_image.cpp. Debug info is not saved.
+	bool saveImage(std::vector<uint8_t>& image) const;
+	bool loadImage(const uint8_t* data, size_t size);
+	bool loadImageFile(const std::string& path);   //!< maps file into memory instead of reading it.
+	/// Compact encoding with varints and shared string table, see ScriptVM_compact.cpp. Debug info is not saved.
+	bool writeCompact(ByteOrderDataStreamWriter& stream) const;
+	bool readCompact(ByteOrderDataStreamReader& stream);
 
 	operator bool () const { return _code.size(); }
 	int getOpCnt() const {return _opCnt;}
 	int getPC() const {return _pc;}
-	int getMaxStackSize() const {return _stack.size();}
+	int getMaxStackSize() const {return _maxStackSize;} //!< peak operand stack of current run.
+	int getCompiledFunctions() const; //!< functions translated to handlers, see ScriptVM_compiled.cpp.
+	int getJitFunctions() const;      //!< translated functions with x86-64 code, see ScriptVM_jit.cpp.
+	static bool hasJit();             //!< false if platform has no code emitter.
+	/// Translated functions and hot counters are kept between runs; call after changing _code directly.
+	void resetCompiled();
+	int getMaxCallDepth() const {return std::max<size_t>(_maxCallDepth, _stackFrames.size());}
+	const ScriptHeap& heap() const { return _heap; }
+	MemoryStats getMemoryStats() const; //!< walks stack, statics and code; do not call per instruction.
 
 	std::string getProfilingData();
 
+	/// Operations used by interpreter, for evaluators outside of VM (ExpressionProgram).
+	static void applyBinaryOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, ScriptVariant& res, const ScriptVariant& t1, const ScriptVariant& t2);
+	static void applyUnaryOperation(BytecodeVM::UnOp op, ScriptVariant::Types optype, ScriptVariant& t1);
+	static void applyMultOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, ScriptVariant& res, std::vector<ScriptVariant*>& args);
+	static bool applyCmpOperation(ScriptVariant& t1, ScriptVariant& t2); //!< CMPS of one element, type of t1.
+
 	void setExternalData(const ScriptVariant& data);
 	void getExternalData(ScriptVariant& data);
 	void getStackData(ScriptVariant& data);
@@ -139,7 +211,11 @@ public:
 
 
 protected:
+	friend ByteOrderDataStreamWriter& operator <<(ByteOrderDataStreamWriter& of,const ScriptVM& opc);
+	friend ByteOrderDataStreamReader& operator >>(ByteOrderDataStreamReader& ifs,ScriptVM& opc);
+
 	void runtimeError(const std::string &text);
+	void runNative();
 	ExecutionStatus executeOneCommand();
 	void printStack();
 	void printStatic();
@@ -176,6 +252,15 @@ protected:
 		for (size_t i=0;i<size;i++)
 			_stack[_stackSize+i]=v;
 		_stackSize += size;
+		_maxStackSize = std::max(_maxStackSize, _stackSize);
+	}
+	inline void sPushRange(const ScriptVariant* values, size_t size){
+		if (_stack.size() < _stackSize + size){
+			_stack.resize(_stackSize + size);
+		}
+		std::copy(values, values + size, _stack.begin() + _stackSize);
+		_stackSize += size;
+		_maxStackSize = std::max(_maxStackSize, _stackSize);
 	}
 
 	void termOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, BytecodeVM::BINOP_flags flags);
@@ -185,6 +270,88 @@ protected:
 
 	void multOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, int count);
 
+	bool pushReference(int offset, int scopeLevel, int size, bool autoDeref);
+	void callExternal(int index, int argSize, int retSize);
+	void heapAllocate(int size);
+	void heapRelease();
+	void finishHeap();
+
+	bool canRunCompiled() const;
+	static CompiledRange translateFunction(const std::vector<BytecodeVM>& code, uint32_t entry, bool optimize);
+	void applyCompiled(const CompiledRange& range);
+	void compileFunction(uint32_t entry);
+	void optimizeFunction(uint32_t entry);
+	void startOptimizations();
+	void applyOptimizations(bool wait);
+	ExecutionStatus runCompiled();
+
+	/// Tier 2 handlers; BINOP operation and type are in a and b.
+	enum TypedKind { tkNone, tkBinop, tkBinopConst, tkCompareJump };
+	static TypedKind typedKind(const CompiledOp& op);
+
+	// x86-64 code of translated ranges, see ScriptVM_jit.cpp.
+	struct JitBlock;
+	struct JitOperand;
+	class JitEmitter;
+	bool emitJit(const CompiledRange& range);
+	void runJit();
+	size_t getJitCodeBytes() const;
+
+	/// Tiers: 0 - interpreted, 1 - translated, 2 - typed and fused ops requested.
+	struct HotCounter {
+		int calls = 0;
+		int loops = 0;  //!< backward jumps, counted in translated code only.
+		int tier = 0;
+	};
+	inline void countCall(uint32_t entry){
+		if (_compileThreshold < 0 || entry >= _hotCounters.size())
+			return;
+		HotCounter& counter = _hotCounters[entry];
+		counter.calls++;
+		if (counter.tier == 0 && counter.calls > _compileThreshold) {
+			compileFunction(entry);
+			counter.tier = 1;
+		}
+		else if (counter.tier == 1 && _optimizeThreshold >= 0 && counter.calls + counter.loops > _optimizeThreshold)
+			optimizeFunction(entry);
+		if (_optimizeWorker.valid())
+			applyOptimizations(false);
+	}
+	inline void countLoop(uint32_t entry){
+		HotCounter& counter = _hotCounters[entry];
+		counter.loops++;
+		if (counter.tier == 1 && _optimizeThreshold >= 0 && counter.calls + counter.loops > _optimizeThreshold)
+			optimizeFunction(entry);
+		if (_optimizeWorker.valid())
+			applyOptimizations(false);
+	}
+
+	void cBinop(const CompiledOp& op);
+	void cUnop(const CompiledOp& op);
+	void cMultop(const CompiledOp& op);
+	void cMovs(const CompiledOp& op);
+	void cCmps(const CompiledOp& op);
+	void cAddRef(const CompiledOp& op);
+	void cIdx(const CompiledOp& op);
+	void cRef(const CompiledOp& op);
+	void cRefExt(const CompiledOp& op);
+	void cDeref(const CompiledOp& op);
+	void cPop(const CompiledOp& op);
+	void cPush(const CompiledOp& op);
+	void cCall(const CompiledOp& op);
+	void cCallExt(const CompiledOp& op);
+	void cRet(const CompiledOp& op);
+	void cJmp(const CompiledOp& op);
+	void cFjmp(const CompiledOp& op);
+	void cTjmp(const CompiledOp& op);
+	void cCvrt(const CompiledOp& op);
+
+	// tier 2, see translateFunction().
+	template<typename T, typename Op> void cBinopTyped(const CompiledOp& op);
+	template<typename T, typename Op> void cBinopConst(const CompiledOp& op);
+	template<typename T, typename Op> void cCompareJump(const CompiledOp& op);
+	void cRefDeref(const CompiledOp& op);
+
 	struct CallStackFrame {
 		int resultSize;
 		int paramsSize;
@@ -209,9 +376,21 @@ protected:
 	uint32_t _pc;
 	uint32_t _opCnt;
 	uint32_t _stackSize;
+	uint32_t _maxStackSize;              //!< since initialState(); _stack keeps slots of previous runs.
 	std::vector<ScriptVariant> _stack;
 	std::vector<ScriptVariant> _staticVars;
+	std::shared_ptr<std::vector<ScriptVariant>> _constants;
 	std::vector<CallStackFrame> _stackFrames;
+	size_t _maxCallDepth;
+	std::vector<CompiledOp> _compiled;   //!< parallel to _code, filled for hot functions.
+	std::vector<HotCounter> _hotCounters;//!< per entry address.
+	std::vector<uint32_t> _optimizeQueue;                  //!< entries which wait for worker.
+	std::future<std::vector<CompiledRange>> _optimizeWorker; //!< single task, retranslates entries queued before it started.
+	std::vector<const uint8_t*> _jitCode;                  //!< parallel to _code, native entry of translated instruction.
+	std::vector<std::shared_ptr<JitBlock>> _jitBlocks;     //!< replaced blocks are kept until resetCompiled(): running code may return into them.
+	std::exception_ptr _jitError;                          //!< thrown by handler called from native code, rethrown by runJit().
+	std::unique_ptr<NativeModule> _nativeModule;
+	ScriptHeap _heap;
 	int64_t _totalOPC;
 
 	struct ProfileResult {
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ScriptVM.h"
+
+#include <map>
+
+/*
+ * Compact program encoding, for storage and transfer of many compiled programs.
+ *
+ * All counts, indexes and integers are LEB128 varints (zigzag for signed types), so the format does not depend
+ * on byte order; floats are written with stream byte order. Strings of program (names, functions, string
+ * values) are stored once in string table and referenced by index. Instruction is varint index of its shape:
+ * shape is opcode with types of operands, program usually has few dozens of them, so opcode and types take one
+ * byte per instruction; operand payload follows without tags.
+ *
+ * Layout: marker, version, startPC, strings, shapes, code, names, functions, constants.
+ * Tagged values (statics and constants) are type followed by payload. Debug info is not saved.
+ */
+namespace {
+
+const uint32_t compactMarker = 0x43565350; // "PSVC"
+const uint32_t compactVersion = 1;
+
+class CompactWriter
+{
+public:
+	ByteOrderDataStreamWriter& stream;
+	std::vector<const std::string*> strings;
+	std::map<std::string, uint32_t> stringIndex;
+	std::string error;
+
+	explicit CompactWriter(ByteOrderDataStreamWriter& s) : stream(s) {}
+
+	void addString(const std::string& str)
+	{
+		auto it = stringIndex.emplace(str, strings.size());
+		if (it.second)
+			strings.push_back(&it.first->first);
+	}
+	void addStrings(const std::vector<ScriptVariant>& values)
+	{
+		for (const ScriptVariant& v : values)
+			if (v.getType() == ScriptVariant::T_string)
+				addString(v.getValue<std::string>());
+	}
+	void writeString(const std::string& str)
+	{
+		stream.WriteVarUInt(stringIndex[str]);
+	}
+	bool writePayload(const ScriptVariant& v)
+	{
+		const ScriptVariant::Types type = v.getType();
+		switch (type)
+		{
+			case ScriptVariant::T_bool: stream << uint8_t(v.getValue<bool>()); break;
+			case ScriptVariant::T_float32: stream << v.getValue<float>(); break;
+			case ScriptVariant::T_float64: stream << v.getValue<double>(); break;
+			case ScriptVariant::T_int8_t:
+			case ScriptVariant::T_int16_t:
+			case ScriptVariant::T_int32_t:
+			case ScriptVariant::T_int64_t: stream.WriteVarInt(v.getValue<int64_t>()); break;
+			case ScriptVariant::T_uint8_t:
+			case ScriptVariant::T_uint16_t:
+			case ScriptVariant::T_uint32_t:
+			case ScriptVariant::T_uint64_t: stream.WriteVarUInt(v.getValue<uint64_t>()); break;
+			case ScriptVariant::T_string: writeString(v.getValue<std::string>()); break;
+			case ScriptVariant::T_UNDEFINED: break;
+			case ScriptVariant::T_array:
+				if (v.listSize() == 0)
+					break;
+				// fallthrough
+			case ScriptVariant::T_map:
+				if (type == ScriptVariant::T_map && v.mapKeys().empty())
+					break;
+				// fallthrough
+			default:
+				error = "value of type " + std::to_string(int(type)) + " can not be stored in compact encoding.";
+				return false;
+		}
+		return true;
+	}
+	bool writeValues(const std::vector<ScriptVariant>& values)
+	{
+		stream.WriteVarUInt(values.size());
+		for (const ScriptVariant& v : values)
+		{
+			stream.WriteVarUInt(v.getType());
+			if (!writePayload(v))
+				return false;
+		}
+		return true;
+	}
+};
+
+class CompactReader
+{
+public:
+	ByteOrderDataStreamReader& stream;
+	std::vector<std::string> strings;
+	bool valid = true;
+
+	explicit CompactReader(ByteOrderDataStreamReader& s) : stream(s) {}
+
+	uint64_t readUInt(uint64_t limit = UINT32_MAX)
+	{
+		uint64_t value = 0;
+		if (!stream.ReadVarUInt(value) || value > limit)
+		{
+			valid = false;
+			return 0;
+		}
+		return value;
+	}
+	const std::string& readString()
+	{
+		static const std::string empty;
+		const uint64_t index = readUInt();
+		if (index >= strings.size())
+		{
+			valid = false;
+			return empty;
+		}
+		return strings[index];
+	}
+	void readPayload(ScriptVariant& v, ScriptVariant::Types type)
+	{
+		switch (type)
+		{
+			case ScriptVariant::T_bool: v.setValue(stream.ReadScalar<uint8_t>() != 0, type); break;
+			case ScriptVariant::T_float32: v.setValue(stream.ReadScalar<float>(), type); break;
+			case ScriptVariant::T_float64: v.setValue(stream.ReadScalar<double>(), type); break;
+			case ScriptVariant::T_int8_t:
+			case ScriptVariant::T_int16_t:
+			case ScriptVariant::T_int32_t:
+			case ScriptVariant::T_int64_t: {
+				int64_t i = 0;
+				valid = valid && stream.ReadVarInt(i);
+				v.setValue(i, type);
+			}break;
+			case ScriptVariant::T_uint8_t:
+			case ScriptVariant::T_uint16_t:
+			case ScriptVariant::T_uint32_t:
+			case ScriptVariant::T_uint64_t: v.setValue(readUInt(UINT64_MAX), type); break;
+			case ScriptVariant::T_string: v.setValue(readString(), type); break;
+			case ScriptVariant::T_array:
+			case ScriptVariant::T_map: v = ScriptVariant(type); break;
+			case ScriptVariant::T_UNDEFINED: v = ScriptVariant(); break;
+			default: valid = false;
+		}
+	}
+	ScriptVariant::Types readType()
+	{
+		return ScriptVariant::Types(readUInt(ScriptVariant::T_UNDEFINED));
+	}
+	void readValues(std::vector<ScriptVariant>& values)
+	{
+		values.resize(readUInt(stream.GetBuffer().GetRemainRead()));
+		for (size_t i = 0; i < values.size() && valid; i++)
+			readPayload(values[i], readType());
+	}
+};
+
+}
+
+bool ScriptVM::writeCompact(ByteOrderDataStreamWriter &stream) const
+{
+	CompactWriter writer(stream);
+	std::vector<std::vector<uint8_t>> shapes;
+	std::map<std::vector<uint8_t>, uint32_t> shapeIndex;
+	std::vector<uint32_t> codeShapes(_code.size());
+	for (size_t i = 0; i < _code.size(); i++)
+	{
+		const BytecodeVM& o = _code[i];
+		std::vector<uint8_t> shape(1, uint8_t(o.op));
+		for (const ScriptVariant& v : o.values)
+			shape.push_back(v.getType());
+		auto it = shapeIndex.emplace(shape, shapes.size()).first;
+		if (it->second == shapes.size())
+			shapes.push_back(shape);
+		codeShapes[i] = it->second;
+		writer.addStrings(o.values);
+	}
+	for (const NameRecord& nr : _nameTable)
+	{
+		writer.addString(nr._name);
+		writer.addStrings(nr._staticValues);
+	}
+	for (const FuncNameRecord& fr : _funcTable)
+		writer.addString(fr._name);
+	if (_constants)
+		writer.addStrings(*_constants);
+
+	stream << compactMarker;
+	stream.WriteVarUInt(compactVersion);
+	stream.WriteVarUInt(_startPC);
+	stream.WriteVarUInt(writer.strings.size());
+	for (const std::string* str : writer.strings)
+	{
+		stream.WriteVarUInt(str->size());
+		stream.WriteBlock(reinterpret_cast<const uint8_t*>(str->data()), str->size());
+	}
+	stream.WriteVarUInt(shapes.size());
+	for (const std::vector<uint8_t>& shape : shapes)
+	{
+		stream.WriteVarUInt(shape.size() - 1);
+		for (uint8_t b : shape)
+			stream.WriteVarUInt(b);
+	}
+	stream.WriteVarUInt(_code.size());
+	for (size_t i = 0; i < _code.size() && writer.error.empty(); i++)
+	{
+		stream.WriteVarUInt(codeShapes[i]);
+		for (const ScriptVariant& v : _code[i].values)
+			if (!writer.writePayload(v))
+				break;
+	}
+	stream.WriteVarUInt(_nameTable.size());
+	for (size_t i = 0; i < _nameTable.size() && writer.error.empty(); i++)
+	{
+		const NameRecord& nr = _nameTable[i];
+		stream.WriteVarUInt(nr._flags);
+		stream.WriteVarUInt(nr._sizeBytes);
+		writer.writeString(nr._name);
+		writer.writeValues(nr._staticValues);
+	}
+	stream.WriteVarUInt(_funcTable.size());
+	for (const FuncNameRecord& fr : _funcTable)
+		writer.writeString(fr._name);
+	if (writer.error.empty())
+		writer.writeValues(_constants ? *_constants : std::vector<ScriptVariant>());
+
+	if (!writer.error.empty())
+	{
+		if (_errout)
+			(*_errout) << "Compact encoding error:" << writer.error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ScriptVM::readCompact(ByteOrderDataStreamReader &stream)
+{
+	CompactReader reader(stream);
+	auto fail = [this](const char* text) {
+		clear();
+		if (_errout)
+			(*_errout) << "Compact encoding error:" << text << std::endl;
+		return false;
+	};
+	if (stream.ReadScalar<uint32_t>() != compactMarker || stream.EofRead())
+		return fail("not a compact program.");
+	if (reader.readUInt() != compactVersion)
+		return fail("compact encoding version differs.");
+
+	// no count may exceed remaining bytes: every element takes at least one.
+	auto count = [&reader, &stream]() { return size_t(reader.readUInt(stream.GetBuffer().GetRemainRead())); };
+
+	clear();
+	_startPC = reader.readUInt();
+	reader.strings.resize(count());
+	for (size_t i = 0; i < reader.strings.size() && reader.valid; i++)
+	{
+		reader.strings[i].resize(count());
+		if (!reader.strings[i].empty())
+			reader.valid = stream.ReadBlock(reinterpret_cast<uint8_t*>(&reader.strings[i][0]), reader.strings[i].size());
+	}
+
+	struct Shape {
+		BytecodeVM::OpCodeType op;
+		std::vector<ScriptVariant::Types> types;
+	};
+	std::vector<Shape> shapes(count());
+	for (size_t i = 0; i < shapes.size() && reader.valid; i++)
+	{
+		shapes[i].types.resize(reader.readUInt(UINT8_MAX));
+		shapes[i].op = BytecodeVM::OpCodeType(reader.readUInt(BytecodeVM::OPCODE_COUNT - 1));
+		for (ScriptVariant::Types& type : shapes[i].types)
+			type = reader.readType();
+	}
+
+	_code.resize(count());
+	for (size_t i = 0; i < _code.size() && reader.valid; i++)
+	{
+		const uint64_t shapeIndex = reader.readUInt(shapes.size() - 1);
+		if (!reader.valid || shapes.empty())
+			return fail("program is corrupted.");
+		const Shape& shape = shapes[shapeIndex];
+		BytecodeVM& o = _code[i];
+		o.op = shape.op;
+		o.values.resize(shape.types.size());
+		for (size_t j = 0; j < shape.types.size(); j++)
+			reader.readPayload(o.values[j], shape.types[j]);
+	}
+
+	_nameTable.resize(count());
+	for (size_t i = 0; i < _nameTable.size() && reader.valid; i++)
+	{
+		NameRecord& nr = _nameTable[i];
+		nr._flags = NameRecord::BindDirection(reader.readUInt(NameRecord::bdIO));
+		nr._sizeBytes = reader.readUInt();
+		nr._name = reader.readString();
+		reader.readValues(nr._staticValues);
+	}
+	_funcTable.resize(count());
+	for (size_t i = 0; i < _funcTable.size() && reader.valid; i++)
+		_funcTable[i]._name = reader.readString();
+	std::vector<ScriptVariant> constants;
+	reader.readValues(constants);
+	if (!constants.empty())
+		_constants = std::make_shared<std::vector<ScriptVariant>>(std::move(constants));
+
+	for (const BytecodeVM& o : _code)
+	{
+		if (reader.valid && o.op == BytecodeVM::PUSHC)
+			reader.valid = o.values.size() == 2 && _constants
+					&& size_t(o.values[0].getValue<int>()) + o.values[1].getValue<int>() <= _constants->size();
+	}
+	if (!reader.valid || stream.EofRead())
+		return fail("program is corrupted.");
+	return true;
+}
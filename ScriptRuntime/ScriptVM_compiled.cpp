@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ScriptVM.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+ * Hot function translation.
+ *
+ * When function entry (CALL target) is called more than _compileThreshold times, every instruction
+ * reachable from entry is predecoded into CompiledOp: operands are extracted from ScriptVariant values once,
+ * and opcode is bound to handler member. runCompiled() then executes handlers in tight loop without
+ * operand decoding and debug checks; instructions without handler (WRT, EXIT, ...) are left to interpreter.
+ * Runtime trace flags (dAllRuntime), step limit, breakpoints and opcode statistics always use interpreter.
+ *
+ * Tier 2: when calls plus loop iterations of translated function exceed _optimizeThreshold, function is
+ * translated again with typed arithmetic and fused pairs (REF+DEREF, PUSH+BINOP, compare+FJMP), optionally in
+ * one worker thread, which takes functions queued while previous task was running. Fused op replaces first instruction of pair; second one keeps its own handler, so pairs are
+ * fused only when second instruction is not a jump target. Typed handlers fall back to generic operation
+ * when runtime operand types differ from BINOP type. Executed instruction count is kept exact.
+ *
+ * Tier 3 on x86-64: every applied range is also emitted as machine code (ScriptVM_jit.cpp) and runCompiled()
+ * enters it instead of handler loop, see _useJit.
+ *
+ * Translated code and hot counters are kept between runs, so repeated run() of same program starts with
+ * handlers ready; resetCompiled() drops them when _code is replaced (clear(), loaders, linking).
+ */
+
+namespace {
+int operand(const BytecodeVM& o, size_t index, int def = 0)
+{
+	return o.values.size() > index ? o.values[index].getValue<int>() : def;
+}
+
+template<typename T> struct TypeOf;
+template<> struct TypeOf<int32_t> { static const ScriptVariant::Types value = ScriptVariant::T_int32_t; };
+template<> struct TypeOf<int64_t> { static const ScriptVariant::Types value = ScriptVariant::T_int64_t; };
+template<> struct TypeOf<double>  { static const ScriptVariant::Types value = ScriptVariant::T_float64; };
+
+struct OpPlus  { template<typename T> static T apply(T a, T b) { return a + b; } };
+struct OpMinus { template<typename T> static T apply(T a, T b) { return a - b; } };
+struct OpMul   { template<typename T> static T apply(T a, T b) { return a * b; } };
+struct OpDivr  { template<typename T> static T apply(T a, T b) { return a / b; } };
+struct OpLt    { template<typename T> static bool apply(T a, T b) { return a < b; } };
+struct OpGt    { template<typename T> static bool apply(T a, T b) { return a > b; } };
+struct OpLe    { template<typename T> static bool apply(T a, T b) { return a <= b; } };
+struct OpGe    { template<typename T> static bool apply(T a, T b) { return a >= b; } };
+struct OpEq    { template<typename T> static bool apply(T a, T b) { return a == b; } };
+struct OpNe    { template<typename T> static bool apply(T a, T b) { return a != b; } };
+
+bool isCompare(int binop)
+{
+	return binop == BytecodeVM::LT || binop == BytecodeVM::GT || binop == BytecodeVM::LE
+		|| binop == BytecodeVM::GE || binop == BytecodeVM::EQ || binop == BytecodeVM::NE;
+}
+}
+
+// member templates can not be passed as template template arguments, so typed handler is selected by macro; nullptr if there is no typed version.
+#define TYPED_HANDLER(name, T, binop, result) \
+	switch (binop) { \
+		case BytecodeVM::PLUS:  result = &ScriptVM::name<T, OpPlus>;  break; \
+		case BytecodeVM::MINUS: result = &ScriptVM::name<T, OpMinus>; break; \
+		case BytecodeVM::MUL:   result = &ScriptVM::name<T, OpMul>;   break; \
+		case BytecodeVM::DIVR:  result = &ScriptVM::name<T, OpDivr>;  break; \
+		case BytecodeVM::LT:    result = &ScriptVM::name<T, OpLt>;    break; \
+		case BytecodeVM::GT:    result = &ScriptVM::name<T, OpGt>;    break; \
+		case BytecodeVM::LE:    result = &ScriptVM::name<T, OpLe>;    break; \
+		case BytecodeVM::GE:    result = &ScriptVM::name<T, OpGe>;    break; \
+		case BytecodeVM::EQ:    if (!std::is_floating_point<T>::value) result = &ScriptVM::name<T, OpEq>; break; \
+		case BytecodeVM::NE:    if (!std::is_floating_point<T>::value) result = &ScriptVM::name<T, OpNe>; break; \
+		default: break; \
+	}
+
+#define SELECT_TYPED_HANDLER(name, type, binop, result) \
+	switch (type) { \
+		case ScriptVariant::T_int32_t: TYPED_HANDLER(name, int32_t, binop, result); break; \
+		case ScriptVariant::T_int64_t: TYPED_HANDLER(name, int64_t, binop, result); break; \
+		case ScriptVariant::T_float64: TYPED_HANDLER(name, double,  binop, result); break; \
+		default: break; \
+	}
+
+bool ScriptVM::canRunCompiled() const
+{
+	return _compileThreshold >= 0
+			&& !(_debugout && (_debugFlags & dAllRuntime))
+			&& !_opcodeStatistics
+			&& !_useBreakPoints
+			&& !_useCurrentLine
+			&& _stepLimit < 0;
+}
+
+ScriptVM::CompiledRange ScriptVM::translateFunction(const std::vector<BytecodeVM> &code, uint32_t entry, bool optimize)
+{
+	CompiledRange range;
+	// scratch is sized by function, not by whole program: every hot function is translated separately.
+	std::unordered_map<uint32_t, size_t> slot; // index in range.
+	std::unordered_set<uint32_t> jumpTargets;
+	std::vector<uint32_t> queue(1, entry);
+	while (!queue.empty())
+	{
+		uint32_t pc = queue.back();
+		queue.pop_back();
+		while (pc < code.size() && !slot.count(pc))
+		{
+			const BytecodeVM& o = code[pc];
+			CompiledOp c;
+			c.entry = entry;
+			c.a = operand(o, 0);
+			c.b = operand(o, 1);
+			c.c = operand(o, 2);
+			c.d = operand(o, 3, 1);
+			switch (o.op)
+			{
+				case BytecodeVM::BINOP:   c.handler = &ScriptVM::cBinop;   break;
+				case BytecodeVM::UNOP:    c.handler = &ScriptVM::cUnop;    break;
+				case BytecodeVM::MULTOP:  c.handler = &ScriptVM::cMultop;  break;
+				case BytecodeVM::MOVS:    c.handler = &ScriptVM::cMovs;    break;
+				case BytecodeVM::CMPS:    c.handler = &ScriptVM::cCmps;    break;
+				case BytecodeVM::ADDREF:  c.handler = &ScriptVM::cAddRef;  break;
+				case BytecodeVM::IDX:     c.handler = &ScriptVM::cIdx;     break;
+				case BytecodeVM::REF:     c.handler = &ScriptVM::cRef;     break;
+				case BytecodeVM::REFEXT:  c.handler = &ScriptVM::cRefExt;  break;
+				case BytecodeVM::DEREF:   c.handler = &ScriptVM::cDeref;   break;
+				case BytecodeVM::POP:     c.handler = &ScriptVM::cPop;     break;
+				case BytecodeVM::PUSH:    c.handler = &ScriptVM::cPush; c.value = &o.values[0]; break;
+				case BytecodeVM::CALL:    c.handler = &ScriptVM::cCall;    break;
+				case BytecodeVM::CALLEXT: c.handler = &ScriptVM::cCallExt; break;
+				case BytecodeVM::RET:     c.handler = &ScriptVM::cRet;     break;
+				case BytecodeVM::JMP:     c.handler = &ScriptVM::cJmp;     break;
+				case BytecodeVM::FJMP:    c.handler = &ScriptVM::cFjmp;    break;
+				case BytecodeVM::TJMP:    c.handler = &ScriptVM::cTjmp;    break;
+				case BytecodeVM::CVRT:    c.handler = &ScriptVM::cCvrt;    break;
+				default:
+					break;
+			}
+			slot[pc] = range.size();
+			range.push_back(std::make_pair(pc, c));
+
+			if (o.op == BytecodeVM::RET || o.op == BytecodeVM::EXIT)
+				break;
+			if (o.op == BytecodeVM::JMP || o.op == BytecodeVM::FJMP || o.op == BytecodeVM::TJMP)
+			{
+				const uint32_t target = pc + c.a;
+				jumpTargets.insert(target);
+				if (o.op == BytecodeVM::JMP)
+				{
+					pc = target;
+					continue;
+				}
+				queue.push_back(target);
+			}
+			pc++; // CALL also returns here; callee is translated when it becomes hot itself.
+		}
+	}
+	if (!optimize)
+		return range;
+
+	for (auto& item : range)
+	{
+		const uint32_t pc = item.first;
+		CompiledOp& c = item.second;
+		const BytecodeVM& o = code[pc];
+		const bool canFuse = pc + 1 < code.size() && slot.count(pc + 1) && !jumpTargets.count(pc + 1);
+		const BytecodeVM* next = canFuse ? &code[pc + 1] : nullptr;
+		const CompiledOp* nextOp = canFuse ? &range[slot.at(pc + 1)].second : nullptr;
+
+		if (o.op == BytecodeVM::REF && next && next->op == BytecodeVM::DEREF)
+		{
+			c.handler = &ScriptVM::cRefDeref;
+		}
+		else if (o.op == BytecodeVM::PUSH && c.b == 1 && next && next->op == BytecodeVM::BINOP
+				 && c.value->_Type == nextOp->b)
+		{
+			// layout: a, b - BINOP operation and type, value - constant right operand.
+			CompiledOp::Handler handler = nullptr;
+			SELECT_TYPED_HANDLER(cBinopConst, nextOp->b, nextOp->a, handler);
+			if (handler)
+			{
+				c.handler = handler;
+				c.a = nextOp->a;
+				c.b = nextOp->b;
+			}
+		}
+		else if (o.op == BytecodeVM::BINOP && isCompare(c.a) && next && next->op == BytecodeVM::FJMP)
+		{
+			// layout: a, b - BINOP operation and type, c - FJMP offset.
+			CompiledOp::Handler handler = nullptr;
+			SELECT_TYPED_HANDLER(cCompareJump, c.b, c.a, handler);
+			if (handler)
+			{
+				c.handler = handler;
+				c.c = nextOp->a;
+			}
+		}
+		else if (o.op == BytecodeVM::BINOP)
+		{
+			CompiledOp::Handler handler = nullptr;
+			SELECT_TYPED_HANDLER(cBinopTyped, c.b, c.a, handler);
+			if (handler)
+				c.handler = handler;
+		}
+	}
+	return range;
+}
+
+int ScriptVM::getCompiledFunctions() const
+{
+	return std::count_if(_hotCounters.begin(), _hotCounters.end(), [](const HotCounter& counter) { return counter.tier > 0; });
+}
+
+void ScriptVM::applyCompiled(const ScriptVM::CompiledRange &range)
+{
+	for (const auto& item : range)
+		if (item.first < _compiled.size())
+			_compiled[item.first] = item.second;
+	if (_useJit)
+		emitJit(range); // handlers are used if range can not be emitted.
+}
+
+ScriptVM::TypedKind ScriptVM::typedKind(const ScriptVM::CompiledOp &op)
+{
+	CompiledOp::Handler handler = nullptr;
+	SELECT_TYPED_HANDLER(cBinopTyped, op.b, op.a, handler);
+	if (handler && handler == op.handler)
+		return tkBinop;
+	handler = nullptr;
+	SELECT_TYPED_HANDLER(cBinopConst, op.b, op.a, handler);
+	if (handler && handler == op.handler)
+		return tkBinopConst;
+	handler = nullptr;
+	SELECT_TYPED_HANDLER(cCompareJump, op.b, op.a, handler);
+	if (handler && handler == op.handler)
+		return tkCompareJump;
+	return tkNone;
+}
+
+void ScriptVM::compileFunction(uint32_t entry)
+{
+	if (_compiled.size() != _code.size())
+		return;
+	applyCompiled(translateFunction(_code, entry, false));
+}
+
+void ScriptVM::optimizeFunction(uint32_t entry)
+{
+	_hotCounters[entry].tier = 2;
+	if (!_optimizeInBackground)
+	{
+		applyCompiled(translateFunction(_code, entry, true));
+		return;
+	}
+	_optimizeQueue.push_back(entry);
+	if (!_optimizeWorker.valid())
+		startOptimizations();
+}
+
+void ScriptVM::startOptimizations()
+{
+	// _code is not modified while worker runs: resetCompiled() waits for it.
+	const std::vector<BytecodeVM>* code = &_code;
+	std::vector<uint32_t> entries;
+	entries.swap(_optimizeQueue);
+	_optimizeWorker = std::async(std::launch::async, [code, entries]() {
+		std::vector<CompiledRange> ranges;
+		for (uint32_t entry : entries)
+			ranges.push_back(translateFunction(*code, entry, true));
+		return ranges;
+	});
+}
+
+void ScriptVM::applyOptimizations(bool wait)
+{
+	while (_optimizeWorker.valid())
+	{
+		if (!wait && _optimizeWorker.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+		// swapped between two instructions, so running function continues with new handlers.
+		for (const CompiledRange& range : _optimizeWorker.get())
+			applyCompiled(range);
+		if (!_optimizeQueue.empty())
+			startOptimizations();
+	}
+}
+
+void ScriptVM::resetCompiled()
+{
+	_optimizeQueue.clear();
+	if (_optimizeWorker.valid())
+		_optimizeWorker.wait();
+	_optimizeWorker = std::future<std::vector<CompiledRange>>();
+	_compiled.clear(); // sized to _code by next initialState().
+	_hotCounters.clear();
+	_jitCode.clear();
+	_jitBlocks.clear();
+	_jitError = nullptr;
+}
+
+ScriptVM::ExecutionStatus ScriptVM::runCompiled()
+{
+	const size_t size = _compiled.size();
+	while (_pc < size)
+	{
+		if (_useJit && _pc < _jitCode.size() && _jitCode[_pc])
+		{
+			runJit(); // returns on instruction without native code.
+			if (_doExit)
+				break;
+			continue;
+		}
+		const CompiledOp& op = _compiled[_pc];
+		if (!op.handler)
+			break;
+		(this->*op.handler)(op);
+		_opCnt++;
+		if (_doExit)
+			break;
+	}
+	if (!(_pc < _code.size() && _code[_pc].op != BytecodeVM::EXIT && !_doExit))
+		return Error;
+	return Success;
+}
+
+// ------------------- Handlers -----------------
+
+void ScriptVM::cBinop(const CompiledOp &op)
+{
+	termOperation(BytecodeVM::BinOp(op.a), ScriptVariant::Types(op.b), BytecodeVM::BINOP_flags(op.c));
+	_pc++;
+}
+
+void ScriptVM::cUnop(const CompiledOp &op)
+{
+	unaryOperation(BytecodeVM::UnOp(op.a), ScriptVariant::Types(op.b));
+	_pc++;
+}
+
+void ScriptVM::cMultop(const CompiledOp &op)
+{
+	multOperation(BytecodeVM::BinOp(op.a), ScriptVariant::Types(op.b), op.c);
+	_pc++;
+}
+
+void ScriptVM::cMovs(const CompiledOp &op)
+{
+	movs(BytecodeVM::MOVS_flags(op.a), op.b);
+	_pc++;
+}
+
+void ScriptVM::cCmps(const CompiledOp &op)
+{
+	cmps(BytecodeVM::CMPS_flags(op.a), op.b);
+	_pc++;
+}
+
+void ScriptVM::cAddRef(const CompiledOp &op)
+{
+	sTop(0).addPointer(op.a);
+	_pc++;
+}
+
+void ScriptVM::cIdx(const CompiledOp &op)
+{
+	int offset = (sTopValue(0) - op.b) * op.a;
+	sTop(1).addPointer(offset);
+	sPops();
+	_pc++;
+}
+
+void ScriptVM::cRef(const CompiledOp &op)
+{
+	if (!pushReference(op.a, op.b, op.c, op.d != 0))
+		throw std::runtime_error("Trying to reference address beyond stack size.");
+	_pc++;
+}
+
+void ScriptVM::cRefExt(const CompiledOp &op)
+{
+	ScriptVariant r;
+	r.setPointerDbg(_nameTable[op.a]._ptr);
+	sPush(r);
+	_pc++;
+}
+
+void ScriptVM::cDeref(const CompiledOp &)
+{
+	ScriptVariant r = *(sTop().getReferenced(0, 1));
+	sTop() = r;
+	_pc++;
+}
+
+void ScriptVM::cPop(const CompiledOp &op)
+{
+	sPops(op.a);
+	_pc++;
+}
+
+void ScriptVM::cPush(const CompiledOp &op)
+{
+	sPush(*op.value, op.b);
+	_pc++;
+}
+
+void ScriptVM::cCall(const CompiledOp &op)
+{
+	int bottomAddress = sSize() - op.b - op.c;
+	_stackFrames.push_back(CallStackFrame(op.c, op.b, _pc + 1, bottomAddress, op.d));
+	if (_stackFrames.size() > _maxCallDepth)
+		_maxCallDepth = _stackFrames.size();
+	_pc = op.a;
+	countCall(_pc);
+}
+
+void ScriptVM::cCallExt(const CompiledOp &op)
+{
+	callExternal(op.a, op.b, op.c);
+	_pc++;
+}
+
+void ScriptVM::cRet(const CompiledOp &)
+{
+	CallStackFrame &cur = _stackFrames[_stackFrames.size() - 1];
+	_pc = cur.returnAddress;
+	if (_stackFrames.size() > 1)
+	{
+		_stackSize = cur.bottomAddress + cur.resultSize;
+		_stackFrames.pop_back();
+	}
+}
+
+void ScriptVM::cJmp(const CompiledOp &op)
+{
+	_pc += op.a;
+	if (op.a < 0)
+		countLoop(op.entry);
+}
+
+void ScriptVM::cFjmp(const CompiledOp &op)
+{
+	_pc += sTop().getValue<bool>() ? 1 : op.a;
+	sPops();
+}
+
+void ScriptVM::cTjmp(const CompiledOp &op)
+{
+	_pc += sTop().getValue<bool>() ? op.a : 1;
+	sPops();
+}
+
+void ScriptVM::cCvrt(const CompiledOp &op)
+{
+	sTop(0).setType(ScriptVariant::Types(op.a));
+	_pc++;
+}
+
+// ------------------- Tier 2 handlers -----------------
+
+template<typename T, typename Op>
+void ScriptVM::cBinopTyped(const CompiledOp &op)
+{
+	ScriptVariant& t1 = sTop(1);
+	const ScriptVariant& t2 = sTop(0);
+	if (t1._Type != TypeOf<T>::value || t2._Type != TypeOf<T>::value)
+	{
+		cBinop(op);
+		return;
+	}
+	t1.setValue(Op::apply(t1.getValue<T>(), t2.getValue<T>()), ScriptVariant::T_AUTO);
+	sPops();
+	_pc++;
+}
+
+template<typename T, typename Op>
+void ScriptVM::cBinopConst(const CompiledOp &op)
+{
+	ScriptVariant& t1 = sTop(0);
+	if (t1._Type == TypeOf<T>::value)
+		t1.setValue(Op::apply(t1.getValue<T>(), op.value->getValue<T>()), ScriptVariant::T_AUTO);
+	else
+	{
+		sPush(*op.value);
+		termOperation(BytecodeVM::BinOp(op.a), ScriptVariant::Types(op.b), BytecodeVM::bNo);
+	}
+	_pc += 2;
+	_opCnt++;
+}
+
+template<typename T, typename Op>
+void ScriptVM::cCompareJump(const CompiledOp &op)
+{
+	const ScriptVariant& t1 = sTop(1);
+	const ScriptVariant& t2 = sTop(0);
+	bool condition;
+	if (t1._Type == TypeOf<T>::value && t2._Type == TypeOf<T>::value)
+	{
+		condition = Op::apply(t1.getValue<T>(), t2.getValue<T>());
+		sPops(2);
+	}
+	else
+	{
+		termOperation(BytecodeVM::BinOp(op.a), ScriptVariant::Types(op.b), BytecodeVM::bNo);
+		condition = sTop().getValue<bool>();
+		sPops();
+	}
+	_pc += condition ? 2 : 1 + op.c;
+	_opCnt++;
+}
+
+void ScriptVM::cRefDeref(const CompiledOp &op)
+{
+	if (!pushReference(op.a, op.b, op.c, op.d != 0))
+		throw std::runtime_error("Trying to reference address beyond stack size.");
+	ScriptVariant r = *(sTop().getReferenced(0, 1));
+	sTop() = r;
+	_pc += 2;
+	_opCnt++;
+}
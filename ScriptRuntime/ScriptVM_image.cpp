@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ScriptVM.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Flat program image.
+ *
+ * Image is a header followed by arrays of fixed-width records, each array at offset given in header:
+ * instructions, operands (values of instructions, static values of names and constant pool), names, functions
+ * and string blob. Records have no tags or variable-length fields, strings are (offset, size) in blob, so loader
+ * checks bounds once per array and converts records in single pass; file is mapped into memory, not read.
+ * Numbers are stored in host byte order, header marker rejects image of other order.
+ * Debug info is not part of image.
+ */
+const int ScriptVM::_imageVersion = 1;
+
+namespace {
+
+const char imageMagic[4] = {'P', 'S', 'V', 'M'};
+const uint32_t imageByteOrder = 0x01020304;
+
+struct ImageHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t startPC;
+	uint32_t codeOffset, codeCount;
+	uint32_t operandOffset, operandCount;
+	uint32_t nameOffset, nameCount;
+	uint32_t funcOffset, funcCount;
+	uint32_t constantFirst, constantCount;  //!< range of operands.
+	uint32_t stringsOffset, stringsSize;
+};
+
+struct ImageInstruction {
+	uint8_t op;
+	uint8_t count;
+	uint16_t reserved;
+	uint32_t firstOperand;
+};
+
+struct ImageString {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct ImageValue {
+	uint8_t type;
+	uint8_t reserved[7];
+	union {
+		int64_t i;
+		uint64_t u;
+		double f;
+		ImageString s;
+	};
+};
+
+struct ImageName {
+	uint32_t flags;
+	uint32_t sizeBytes;
+	ImageString name;
+	uint32_t firstStatic, staticCount;
+};
+
+struct ImageFunction {
+	ImageString name;
+};
+
+static_assert(sizeof(ImageInstruction) == 8, "instruction record must be fixed width");
+static_assert(sizeof(ImageValue) == 16, "operand record must be fixed width");
+
+class ImageWriter
+{
+public:
+	std::vector<ImageValue> operands;
+	std::string strings;
+	std::string error;
+
+	ImageString addString(const std::string& str)
+	{
+		ImageString s;
+		s.offset = strings.size();
+		s.size = str.size();
+		strings += str;
+		return s;
+	}
+	bool addValue(const ScriptVariant& v)
+	{
+		ImageValue rec;
+		memset(&rec, 0, sizeof(rec));
+		const ScriptVariant::Types type = v.getType();
+		rec.type = type;
+		if (type == ScriptVariant::T_bool || ScriptVariant::isTypeInt(type))
+		{
+			if (type == ScriptVariant::T_uint64_t)
+				rec.u = v.getValue<uint64_t>();
+			else
+				rec.i = v.getValue<int64_t>();
+		}
+		else if (ScriptVariant::isTypeFloat(type))
+			rec.f = v.getValue<double>();
+		else if (type == ScriptVariant::T_string)
+			rec.s = addString(v.getValue<std::string>());
+		else if ((type == ScriptVariant::T_array && v.listSize() == 0) || (type == ScriptVariant::T_map && v.mapKeys().empty()))
+			; // default value of dynamic type.
+		else if (type != ScriptVariant::T_UNDEFINED)
+		{
+			error = "value of type " + std::to_string(int(type)) + " can not be stored in image.";
+			return false;
+		}
+		operands.push_back(rec);
+		return true;
+	}
+};
+
+template<class T>
+void appendRecords(std::vector<uint8_t>& image, uint32_t& offset, const std::vector<T>& records)
+{
+	while (image.size() % 8)
+		image.push_back(0);
+	offset = image.size();
+	const uint8_t* begin = reinterpret_cast<const uint8_t*>(records.data());
+	image.insert(image.end(), begin, begin + records.size() * sizeof(T));
+}
+
+}
+
+bool ScriptVM::saveImage(std::vector<uint8_t> &image) const
+{
+	ImageWriter writer;
+	std::vector<ImageInstruction> code(_code.size());
+	std::vector<ImageName> names(_nameTable.size());
+	std::vector<ImageFunction> funcs(_funcTable.size());
+	for (size_t i = 0; i < _code.size(); i++)
+	{
+		const BytecodeVM& o = _code[i];
+		code[i].op = o.op;
+		code[i].count = o.values.size();
+		code[i].reserved = 0;
+		code[i].firstOperand = writer.operands.size();
+		for (const ScriptVariant& v : o.values)
+			if (!writer.addValue(v))
+				break;
+	}
+	for (size_t i = 0; i < _nameTable.size() && writer.error.empty(); i++)
+	{
+		const NameRecord& nr = _nameTable[i];
+		names[i].flags = nr._flags;
+		names[i].sizeBytes = nr._sizeBytes;
+		names[i].name = writer.addString(nr._name);
+		names[i].firstStatic = writer.operands.size();
+		names[i].staticCount = nr._staticValues.size();
+		for (const ScriptVariant& v : nr._staticValues)
+			if (!writer.addValue(v))
+				break;
+	}
+	for (size_t i = 0; i < _funcTable.size(); i++)
+		funcs[i].name = writer.addString(_funcTable[i]._name);
+
+	ImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, imageMagic, sizeof(imageMagic));
+	header.version = _imageVersion;
+	header.byteOrder = imageByteOrder;
+	header.startPC = _startPC;
+	header.constantFirst = writer.operands.size();
+	if (_constants)
+	{
+		header.constantCount = _constants->size();
+		for (const ScriptVariant& v : *_constants)
+			if (!writer.addValue(v))
+				break;
+	}
+	if (!writer.error.empty())
+	{
+		if (_errout)
+			(*_errout) << "Image error:" << writer.error << std::endl;
+		return false;
+	}
+
+	image.assign(sizeof(header), 0);
+	header.codeCount = code.size();
+	appendRecords(image, header.codeOffset, code);
+	header.operandCount = writer.operands.size();
+	appendRecords(image, header.operandOffset, writer.operands);
+	header.nameCount = names.size();
+	appendRecords(image, header.nameOffset, names);
+	header.funcCount = funcs.size();
+	appendRecords(image, header.funcOffset, funcs);
+	header.stringsOffset = image.size();
+	header.stringsSize = writer.strings.size();
+	image.insert(image.end(), writer.strings.begin(), writer.strings.end());
+	memcpy(image.data(), &header, sizeof(header));
+	return true;
+}
+
+bool ScriptVM::loadImage(const uint8_t *data, size_t size)
+{
+	auto fail = [this](const char* text) {
+		if (_errout)
+			(*_errout) << "Image error:" << text << std::endl;
+		return false;
+	};
+	ImageHeader header;
+	if (size < sizeof(header))
+		return fail("image is too small.");
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, imageMagic, sizeof(imageMagic)) != 0)
+		return fail("not a program image.");
+	if (header.version != uint32_t(_imageVersion) || header.byteOrder != imageByteOrder)
+		return fail("image version or byte order differs.");
+
+	auto fits = [size](uint32_t offset, uint64_t count, size_t recordSize) {
+		return offset % 8 == 0 && uint64_t(offset) + count * recordSize <= size;
+	};
+	if (!fits(header.codeOffset, header.codeCount, sizeof(ImageInstruction))
+		|| !fits(header.operandOffset, header.operandCount, sizeof(ImageValue))
+		|| !fits(header.nameOffset, header.nameCount, sizeof(ImageName))
+		|| !fits(header.funcOffset, header.funcCount, sizeof(ImageFunction))
+		|| uint64_t(header.stringsOffset) + header.stringsSize > size
+		|| uint64_t(header.constantFirst) + header.constantCount > header.operandCount)
+		return fail("image is truncated.");
+
+	const ImageInstruction* code = reinterpret_cast<const ImageInstruction*>(data + header.codeOffset);
+	const ImageValue* operands = reinterpret_cast<const ImageValue*>(data + header.operandOffset);
+	const ImageName* names = reinterpret_cast<const ImageName*>(data + header.nameOffset);
+	const ImageFunction* funcs = reinterpret_cast<const ImageFunction*>(data + header.funcOffset);
+	const char* strings = reinterpret_cast<const char*>(data + header.stringsOffset);
+
+	bool valid = true;
+	auto str = [&](const ImageString& s) {
+		if (uint64_t(s.offset) + s.size > header.stringsSize)
+		{
+			valid = false;
+			return std::string();
+		}
+		return std::string(strings + s.offset, s.size);
+	};
+	auto values = [&](std::vector<ScriptVariant>& out, uint32_t first, uint32_t count) {
+		if (uint64_t(first) + count > header.operandCount)
+		{
+			valid = false;
+			return;
+		}
+		out.resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const ImageValue& rec = operands[first + i];
+			const ScriptVariant::Types type = ScriptVariant::Types(rec.type);
+			if (type == ScriptVariant::T_bool)
+				out[i].setValue(rec.i != 0, type);
+			else if (type == ScriptVariant::T_uint64_t)
+				out[i].setValue(rec.u, type);
+			else if (ScriptVariant::isTypeInt(type))
+				out[i].setValue(rec.i, type);
+			else if (ScriptVariant::isTypeFloat(type))
+				out[i].setValue(rec.f, type);
+			else if (type == ScriptVariant::T_string)
+				out[i].setValue(str(rec.s), type);
+			else if (type == ScriptVariant::T_array || type == ScriptVariant::T_map)
+				out[i] = ScriptVariant(type);
+			else if (type != ScriptVariant::T_UNDEFINED)
+				valid = false;
+		}
+	};
+
+	// records are decoded aside: corrupted image leaves program and bindings of VM untouched.
+	std::vector<BytecodeVM> newCode(header.codeCount);
+	for (uint32_t i = 0; i < header.codeCount && valid; i++)
+	{
+		if (code[i].op >= BytecodeVM::OPCODE_COUNT)
+			valid = false;
+		newCode[i].op = BytecodeVM::OpCodeType(code[i].op);
+		values(newCode[i].values, code[i].firstOperand, code[i].count);
+	}
+	std::vector<NameRecord> newNames(header.nameCount);
+	for (uint32_t i = 0; i < header.nameCount && valid; i++)
+	{
+		NameRecord& nr = newNames[i];
+		nr._flags = NameRecord::BindDirection(names[i].flags);
+		nr._sizeBytes = names[i].sizeBytes;
+		nr._name = str(names[i].name);
+		values(nr._staticValues, names[i].firstStatic, names[i].staticCount);
+	}
+	std::vector<FuncNameRecord> newFuncs(header.funcCount);
+	for (uint32_t i = 0; i < header.funcCount && valid; i++)
+		newFuncs[i]._name = str(funcs[i].name);
+	std::shared_ptr<std::vector<ScriptVariant>> newConstants;
+	if (header.constantCount && valid)
+	{
+		newConstants = std::make_shared<std::vector<ScriptVariant>>();
+		values(*newConstants, header.constantFirst, header.constantCount);
+	}
+	for (const BytecodeVM& o : newCode)
+	{
+		if (valid && o.op == BytecodeVM::PUSHC)
+			valid = o.values.size() == 2 && newConstants
+					&& size_t(o.values[0].getValue<int>()) + o.values[1].getValue<int>() <= newConstants->size();
+	}
+	if (!valid)
+		return fail("image is corrupted.");
+
+	clear();
+	_startPC = header.startPC;
+	_code = std::move(newCode);
+	_nameTable = std::move(newNames);
+	_funcTable = std::move(newFuncs);
+	_constants = std::move(newConstants);
+	return true;
+}
+
+bool ScriptVM::loadImageFile(const std::string &path)
+{
+#ifdef _WIN32
+	std::ifstream file(path, std::ios::binary);
+	std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!file.good() && !file.eof())
+	{
+		if (_errout)
+			(*_errout) << "Image error:failed to read " << path << std::endl;
+		return false;
+	}
+	return loadImage(image.data(), image.size());
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		if (_errout)
+			(*_errout) << "Image error:failed to open " << path << std::endl;
+		return false;
+	}
+	void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		if (_errout)
+			(*_errout) << "Image error:failed to map " << path << std::endl;
+		return false;
+	}
+	const bool result = loadImage(static_cast<const uint8_t*>(mapped), st.st_size);
+	munmap(mapped, st.st_size);
+	return result;
+#endif
+}
@@ -0,0 +1,1478 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "ScriptVM.h"
+#include "ExecutableMemory.h"
+
+#include <deque>
+#include <stddef.h>
+#include <stdexcept>
+#include <string.h>
+#include <tuple>
+#include <unordered_map>
+
+/*
+ * x86-64 code of translated functions.
+ *
+ * applyCompiled() passes every range of tier 1 and tier 2 to emitJit(), which emits one block of machine code.
+ * Emitter keeps virtual operand stack instead of VM stack:
+ *  - REF, REF+DEREF, IDX, ADDRF and PUSH of number or boolean are not executed, they become operands;
+ *    IDX computes offset of element, which is checked against array size and kept in native frame;
+ *  - BINOP +, -, *, / and compares on int32, int64 and float64, MOVS to scalar variable, ++/-- of variable,
+ *    POP and FJMP/TJMP are computed from operands: references are resolved by scope level as in pushReference(),
+ *    values are read by their runtime type and converted as getValue() does, results are kept in native frame;
+ *    operands which handlers left on VM stack, such as results of calls, are read from it;
+ *  - other instructions need VM stack: JitEmitter::materialize() pushes operands and instruction calls its
+ *    handler through JitEmitter::handler(), which catches exceptions: native frames can not be unwound,
+ *    so exception is kept in _jitError and rethrown by runJit();
+ *  - unexpected type (string, pointer chain, double to integer) or offset out of range exits: operands are
+ *    pushed as they were before instruction, handler executes it and code continues in dispatcher.
+ * Operand stack is empty at jump targets, after CALL and before handler calls; only such instructions get
+ * _jitCode entry. CALL, RET and jumps out of range continue in dispatcher, which loads _jitCode[_pc] and returns
+ * to runCompiled() if instruction has no native code. Loop back edges go through dispatcher until function reaches
+ * last tier, so running loop enters retranslated block.
+ * Variables stay ScriptVariant: strings, var parameters, pointer assignments and calls cost as much as handlers.
+ *
+ * rbx holds ScriptVM, [rsp + 32] operand slots; _pc is stored only before handler calls and exits,
+ * _opCnt is added before them.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCRIPTVM_JIT_X64
+#endif
+
+/// Operand which native code keeps out of VM stack.
+struct ScriptVM::JitOperand {
+	enum Kind {
+		Reference,  //!< REF of variable, array element or field.
+		Value,      //!< REF+DEREF; variable is read when operand is used.
+		Constant,
+		Computed,   //!< BINOP result in operand slot of native frame, slot is position in operand stack.
+		Stacked     //!< value which is already on VM stack, below operand stack; never kept in operand stack.
+	};
+	Kind kind;
+	const CompiledOp* ref;          //!< Reference and Value.
+	const ScriptVariant* constant;
+	int type;                       //!< Computed: T_bool, T_int32_t, T_int64_t or T_float64.
+	uint32_t pc;                    //!< instruction which pushed operand.
+	bool indexed = false;           //!< IDX offset of Reference is in operand slot.
+	int field = -1;                 //!< ADDRF offset.
+	int depth = 0;                  //!< Stacked: position below VM stack top.
+	uint32_t pending = 0;           //!< instructions not added to _opCnt before the one which pushed operand.
+
+	/// REF without autoDeref and DEREF: copy of pointer variable, which field is addressed.
+	bool pointer() const { return kind == Value && !ref->d; }
+};
+
+/// Code of translated range; ops are copied, so replaced block is still valid when calls return into it.
+struct ScriptVM::JitBlock {
+	ExecutableMemory code;
+	std::vector<CompiledOp> ops;
+	/// argument of JitEmitter::materialize() call embedded in code; pending instructions were added to _opCnt before it.
+	struct Materialized {
+		std::vector<JitOperand> operands;
+		uint32_t pending;
+	};
+	std::deque<Materialized> materialized;
+};
+
+#ifdef SCRIPTVM_JIT_X64
+namespace {
+
+enum Reg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4 };
+
+/// x86-64 encoder.
+class Assembler
+{
+public:
+	enum Condition { cAE = 0x3, cE = 0x4, cNE = 0x5, cA = 0x7, cL = 0xC, cGE = 0xD, cLE = 0xE, cG = 0xF };
+
+	std::vector<uint8_t> code;
+
+	size_t pos() const { return code.size(); }
+	void bytes(std::initializer_list<uint8_t> values) { code.insert(code.end(), values); }
+	void imm32(uint32_t value) { append(&value, sizeof(value)); }
+	void imm64(uint64_t value) { append(&value, sizeof(value)); }
+
+	/// opcode with [base + disp32]; prefix is mandatory prefix of SSE instruction.
+	void mem(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, Reg base, int disp)
+	{
+		if (prefix)
+			bytes({prefix});
+		if (wide)
+			bytes({0x48});
+		bytes(opcode);
+		bytes({uint8_t(0x80 | (reg << 3) | base)});
+		if (base == RSP)
+			bytes({0x24});
+		imm32(uint32_t(disp));
+	}
+	/// opcode with register operands.
+	void regs(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int rm)
+	{
+		if (prefix)
+			bytes({prefix});
+		if (wide)
+			bytes({0x48});
+		bytes(opcode);
+		bytes({uint8_t(0xC0 | (reg << 3) | rm)});
+	}
+
+	/// returns position of rel32 for patch().
+	size_t jmp() { bytes({0xE9}); imm32(0); return pos() - 4; }
+	size_t jcc(Condition cond) { bytes({0x0F, uint8_t(0x80 | cond)}); imm32(0); return pos() - 4; }
+	void patch(size_t at, size_t target)
+	{
+		const int32_t rel = int32_t(int64_t(target) - int64_t(at + 4));
+		memcpy(&code[at], &rel, sizeof(rel));
+	}
+	void bind(std::vector<size_t>& fixups)
+	{
+		for (size_t at : fixups)
+			patch(at, pos());
+		fixups.clear();
+	}
+
+	/// frame: shadow space of Win64, operand slots; keeps stack aligned.
+	void prologue(uint32_t frame)
+	{
+		bytes({0x53});                           // push rbx
+		bytes({0x48, 0x81, 0xEC}); imm32(frame); // sub rsp, frame
+#ifdef _WIN32
+		bytes({0x48, 0x89, 0xCB});               // mov rbx, rcx
+		bytes({0xFF, 0xE2});                     // jmp rdx
+#else
+		bytes({0x48, 0x89, 0xFB});               // mov rbx, rdi
+		bytes({0xFF, 0xE6});                     // jmp rsi
+#endif
+	}
+	void epilogue(uint32_t frame)
+	{
+		bytes({0x48, 0x81, 0xC4}); imm32(frame); // add rsp, frame
+		bytes({0x5B, 0xC3});                     // pop rbx; ret
+	}
+	/// function(vm, arg) or function(vm, arg, rsp + thirdDisp), result in al.
+	void call(uintptr_t function, uint64_t arg, int thirdDisp = -1)
+	{
+#ifdef _WIN32
+		bytes({0x48, 0x89, 0xD9});               // mov rcx, rbx
+		bytes({0x48, 0xBA}); imm64(arg);         // mov rdx, arg
+		if (thirdDisp >= 0)
+		{
+			bytes({0x4C, 0x8D, 0x84, 0x24});     // lea r8, [rsp + disp]
+			imm32(uint32_t(thirdDisp));
+		}
+#else
+		bytes({0x48, 0x89, 0xDF});               // mov rdi, rbx
+		bytes({0x48, 0xBE}); imm64(arg);         // mov rsi, arg
+		if (thirdDisp >= 0)
+			mem(0, true, {0x8D}, RDX, RSP, thirdDisp);
+#endif
+		bytes({0x48, 0xB8}); imm64(function);
+		bytes({0xFF, 0xD0});                     // call rax
+		bytes({0x84, 0xC0});                     // test al, al
+	}
+	/// rax = table[dword [rbx + disp]], jumps to exit if index is not below size.
+	size_t loadEntry(int disp, uint32_t size, const void* table)
+	{
+		mem(0, false, {0x8B}, RAX, RBX, disp);
+		bytes({0x3D}); imm32(size);              // cmp eax, size
+		const size_t outside = jcc(cAE);
+		bytes({0x48, 0xB9}); imm64(uint64_t(reinterpret_cast<uintptr_t>(table)));
+		bytes({0x48, 0x8B, 0x04, 0xC1});         // mov rax, [rcx + rax * 8]
+		bytes({0x48, 0x85, 0xC0});               // test rax, rax
+		return outside;
+	}
+	void jmpRax() { bytes({0xFF, 0xE0}); }
+
+	// dword fields of ScriptVM.
+	void vmStore(int disp, uint32_t value) { mem(0, false, {0xC7}, 0, RBX, disp); imm32(value); }
+	void vmAdd(int disp, uint32_t value)   { mem(0, false, {0x81}, 0, RBX, disp); imm32(value); }
+	void vmSub(int disp, uint32_t value)   { mem(0, false, {0x81}, 5, RBX, disp); imm32(value); }
+	void vmCmp(int disp, uint32_t value)   { mem(0, false, {0x81}, 7, RBX, disp); imm32(value); }
+
+	void cmpByte(Reg base, int disp, uint8_t value) { mem(0, false, {0x80}, 7, base, disp); bytes({value}); }
+	/// add (0), sub (5) or cmp (7) with immediate.
+	void alu(int operation, bool wide, Reg reg, uint32_t value) { regs(0, wide, {0x81}, operation, reg); imm32(value); }
+	void cmpCl(uint8_t value) { bytes({0x80, 0xF9, value}); }
+	void moveRcx(uint64_t value) { bytes({0x48, 0xB9}); imm64(value); }
+	void moveXmm0Rcx() { bytes({0x66, 0x48, 0x0F, 0x6E, 0xC1}); }
+	/// flags of xmm0 - xmm1, or xmm1 - xmm0 if swapped.
+	void ucomisd(bool swapped) { regs(0x66, false, {0x0F, 0x2E}, swapped ? 1 : 0, swapped ? 0 : 1); }
+	void setccCl(Condition cond) { regs(0, false, {0x0F, uint8_t(0x90 | cond)}, 0, RCX); }
+
+private:
+	void append(const void* data, size_t size)
+	{
+		const uint8_t* begin = static_cast<const uint8_t*>(data);
+		code.insert(code.end(), begin, begin + size);
+	}
+};
+
+/// Template of typed operation.
+struct TypedTemplate {
+	bool supported = false;
+	bool compare = false;
+	Assembler::Condition condition = Assembler::cE;
+	bool swapped = false;  //!< ucomisd operands.
+	uint8_t opcode = 0;    //!< addsd 0x58, mulsd 0x59, subsd 0x5C, divsd 0x5E.
+};
+
+TypedTemplate typedTemplate(int binop, int type)
+{
+	TypedTemplate t;
+	const bool isFloat = type == ScriptVariant::T_float64;
+	if (!isFloat && type != ScriptVariant::T_int32_t && type != ScriptVariant::T_int64_t)
+		return t;
+	t.supported = true;
+	switch (binop)
+	{
+		case BytecodeVM::PLUS:  t.opcode = 0x58; break;
+		case BytecodeVM::MINUS: t.opcode = 0x5C; break;
+		case BytecodeVM::MUL:   t.opcode = 0x59; break;
+		case BytecodeVM::DIVR: // integer division by zero traps in handler as well, but is left to it.
+			t.opcode = 0x5E;
+			t.supported = isFloat;
+			break;
+		// unordered float64 compares are false, as in C++: a < b is b above a.
+		case BytecodeVM::LT: t.compare = true; t.condition = isFloat ? Assembler::cA  : Assembler::cL;  t.swapped = true; break;
+		case BytecodeVM::GT: t.compare = true; t.condition = isFloat ? Assembler::cA  : Assembler::cG;  break;
+		case BytecodeVM::LE: t.compare = true; t.condition = isFloat ? Assembler::cAE : Assembler::cLE; t.swapped = true; break;
+		case BytecodeVM::GE: t.compare = true; t.condition = isFloat ? Assembler::cAE : Assembler::cGE; break;
+		// float64 equality is fuzzy in ScriptVariant.
+		case BytecodeVM::EQ: t.compare = true; t.condition = Assembler::cE;  t.supported = !isFloat; break;
+		case BytecodeVM::NE: t.compare = true; t.condition = Assembler::cNE; t.supported = !isFloat; break;
+		default:
+			t.supported = false;
+			break;
+	}
+	return t;
+}
+
+/// Source types which getValue() converts to type without deoptimization, most common first.
+std::vector<int> sourcesOf(int type)
+{
+	switch (type)
+	{
+		case ScriptVariant::T_float64: return {ScriptVariant::T_float64, ScriptVariant::T_int32_t, ScriptVariant::T_int64_t};
+		case ScriptVariant::T_int64_t: return {ScriptVariant::T_int64_t, ScriptVariant::T_int32_t};
+		case ScriptVariant::T_int32_t: return {ScriptVariant::T_int32_t, ScriptVariant::T_int64_t};
+		case ScriptVariant::T_bool:    return {ScriptVariant::T_bool};
+		default: return {};
+	}
+}
+
+bool convertible(int from, int to)
+{
+	for (int type : sourcesOf(to))
+		if (type == from)
+			return true;
+	return false;
+}
+
+/// Offsets of begin and end pointers in std::vector, which layout is not standardized.
+template<typename T>
+bool vectorLayout(int& begin, int& end)
+{
+	std::vector<T> probe(1);
+	probe.reserve(2);
+	const char* raw = reinterpret_cast<const char*>(&probe);
+	begin = end = -1;
+	for (size_t offset = 0; offset + sizeof(void*) <= sizeof(probe); offset += sizeof(void*))
+	{
+		const void* pointer;
+		memcpy(&pointer, raw + offset, sizeof(pointer));
+		if (pointer == probe.data())
+			begin = int(offset);
+		else if (pointer == probe.data() + 1)
+			end = int(offset);
+	}
+	return begin >= 0 && end >= 0;
+}
+
+}
+
+class ScriptVM::JitEmitter
+{
+public:
+	JitEmitter(ScriptVM& vm, const CompiledRange& sorted, JitBlock& block);
+
+	bool emit();
+	const std::vector<std::pair<uint32_t, size_t>>& entries() const { return _entries; }
+
+	static bool handler(ScriptVM* vm, const CompiledOp* op);
+	static bool countLoop(ScriptVM* vm, uint32_t entry);
+	static bool materialize(ScriptVM* vm, const JitBlock::Materialized* call, const uint8_t* slots);
+
+private:
+	enum OpKind { oNone, oRef, oRefDeref, oIdx, oAddRef, oDeref, oPush, oBinop, oBinopConst, oCompareJump, oMovs, oUnop, oPop, oJmp, oFjmp, oTjmp, oCall, oRet, oOther };
+
+	struct Layout {
+		bool valid = false;
+		int stackBegin = 0, stackEnd = 0, framesBegin = 0, framesEnd = 0;
+		int type = 0, valueChanged = 0, data = 0;
+		int container = 0, container2 = 0, index = 0, maxIndex = 0;
+		int frameSize = 0, frameScope = 0, frameBottom = 0;
+	};
+	static Layout probe();
+
+	/// Exit of instruction: operands as they were before it.
+	struct SideExit {
+		std::vector<size_t> fixups;
+		std::vector<JitOperand> operands;
+		uint32_t pending;
+		uint32_t pc;
+		const CompiledOp* op;
+	};
+
+	// native frame: shadow space, operand slots, temporaries, resolved variables; even slot count keeps stack aligned.
+	enum { SlotCount = 32, TempA = SlotCount, TempB, TempType, CacheFirst, CacheCount = 8, Frame = 32 + 8 * (CacheFirst + CacheCount + 1) };
+	static int slot(int index) { return 32 + 8 * index; }
+
+	OpKind kindOf(const CompiledOp& op) const;
+	void analyze();
+	size_t nextEmitted(size_t i) const;
+	bool emitVirtual(size_t i);
+
+	void commit();
+	void flush();
+	void follow(size_t i, uint32_t target);
+	void jumpTo(uint32_t target) { _jumps.emplace_back(_a.jmp(), target); }
+	void jumpIf(Assembler::Condition cond, uint32_t target) { _jumps.emplace_back(_a.jcc(cond), target); }
+	void callHandler(uint32_t pc, const CompiledOp& op);
+	void callMaterialize(const std::vector<JitOperand>& operands, uint32_t pending);
+	std::vector<size_t>& sideExit();
+	void push(const JitOperand& operand);
+	size_t take(size_t count, std::vector<JitOperand>& taken) const;
+	bool valueBelow(size_t count) const;
+
+	void resolve(const JitOperand& operand, size_t index);
+	void followPointer();
+	bool loadable(const JitOperand& operand, int type) const;
+	void loadConverted(int from, int to, Reg base, int disp);
+	void loadConstant(const ScriptVariant& value, int type);
+	void load(const JitOperand& operand, size_t index, int type, int temp);
+	void storeVariable(int type);
+	void storeSlot(int type, int index);
+
+	bool index(size_t i);
+	bool field(size_t i);
+	bool binop(size_t i, OpKind kind);
+	bool movs(size_t i);
+	bool unop(size_t i);
+	bool condition(size_t i, bool onFalse);
+
+	ScriptVM& _vm;
+	const CompiledRange& _sorted;
+	JitBlock& _block;
+	const Layout& _layout;
+	const int _pcField, _opCntField, _sizeField, _stackField, _framesField;
+	const uint32_t _entry;
+	bool _lastTier;
+
+	Assembler _a;
+	std::vector<OpKind> _kinds;
+	std::vector<bool> _emitted, _boundary;
+	std::vector<JitOperand> _operands;
+	std::vector<std::tuple<int, int, bool>> _resolved;  //!< offset, scope level and pointer() of variable in cache slot; calls clear it.
+	uint32_t _pending = 0;                   //!< executed instructions not added to _opCnt.
+	std::vector<JitOperand> _startOperands;  //!< state before current instruction, for side exit.
+	uint32_t _startPending = 0;
+	int _sideExit = -1;
+	size_t _current = 0;
+	std::vector<SideExit> _sideExits;
+	std::unordered_map<uint32_t, size_t> _labels;
+	std::vector<std::pair<size_t, uint32_t>> _jumps; // rel32 position, target pc.
+	std::vector<size_t> _exits, _dispatches;
+	std::vector<std::pair<uint32_t, size_t>> _entries;
+};
+
+ScriptVM::JitEmitter::Layout ScriptVM::JitEmitter::probe()
+{
+	Layout layout;
+	layout.valid = vectorLayout<ScriptVariant>(layout.stackBegin, layout.stackEnd)
+				&& vectorLayout<CallStackFrame>(layout.framesBegin, layout.framesEnd);
+	ScriptVariant value(int32_t(0));
+	const char* base = reinterpret_cast<const char*>(&value);
+	layout.type = int(reinterpret_cast<const char*>(&value._Type) - base);
+	layout.valueChanged = int(reinterpret_cast<const char*>(&value._ValueChanged) - base);
+	layout.data = int(value.getDataPointerInternal() - base);
+	layout.container = int(offsetof(ScriptVariant::AddressPtr, container));
+	layout.container2 = int(offsetof(ScriptVariant::AddressPtr, container2));
+	layout.index = int(offsetof(ScriptVariant::AddressPtr, index));
+	layout.maxIndex = int(offsetof(ScriptVariant::AddressPtr, maxIndex));
+	layout.frameSize = int(sizeof(CallStackFrame));
+	layout.frameScope = int(offsetof(CallStackFrame, scopeLevel));
+	layout.frameBottom = int(offsetof(CallStackFrame, bottomAddress));
+	return layout;
+}
+
+ScriptVM::JitEmitter::JitEmitter(ScriptVM &vm, const CompiledRange &sorted, JitBlock &block)
+	: _vm(vm)
+	, _sorted(sorted)
+	, _block(block)
+	, _layout([]() -> const Layout& { static const Layout layout = probe(); return layout; }())
+	, _pcField(int(reinterpret_cast<const char*>(&vm._pc) - reinterpret_cast<const char*>(&vm)))
+	, _opCntField(int(reinterpret_cast<const char*>(&vm._opCnt) - reinterpret_cast<const char*>(&vm)))
+	, _sizeField(int(reinterpret_cast<const char*>(&vm._stackSize) - reinterpret_cast<const char*>(&vm)))
+	, _stackField(int(reinterpret_cast<const char*>(&vm._stack) - reinterpret_cast<const char*>(&vm)))
+	, _framesField(int(reinterpret_cast<const char*>(&vm._stackFrames) - reinterpret_cast<const char*>(&vm)))
+	, _entry(sorted[0].second.entry)
+{
+	_lastTier = vm._optimizeThreshold < 0 || (_entry < vm._hotCounters.size() && vm._hotCounters[_entry].tier == 2);
+}
+
+ScriptVM::JitEmitter::OpKind ScriptVM::JitEmitter::kindOf(const CompiledOp &op) const
+{
+	if (!op.handler)
+		return oNone;
+	switch (typedKind(op))
+	{
+		case tkBinop:       return oBinop;
+		case tkBinopConst:  return oBinopConst;
+		case tkCompareJump: return oCompareJump;
+		case tkNone: break;
+	}
+	if (op.handler == &ScriptVM::cRef)      return oRef;
+	if (op.handler == &ScriptVM::cRefDeref) return oRefDeref;
+	if (op.handler == &ScriptVM::cIdx)      return oIdx;
+	if (op.handler == &ScriptVM::cAddRef)   return oAddRef;
+	if (op.handler == &ScriptVM::cDeref)    return oDeref;
+	if (op.handler == &ScriptVM::cPush)     return oPush;
+	if (op.handler == &ScriptVM::cBinop)    return oBinop;
+	if (op.handler == &ScriptVM::cMovs)     return oMovs;
+	if (op.handler == &ScriptVM::cUnop)     return oUnop;
+	if (op.handler == &ScriptVM::cPop)      return oPop;
+	if (op.handler == &ScriptVM::cJmp)      return oJmp;
+	if (op.handler == &ScriptVM::cFjmp)     return oFjmp;
+	if (op.handler == &ScriptVM::cTjmp)     return oTjmp;
+	if (op.handler == &ScriptVM::cCall)     return oCall;
+	if (op.handler == &ScriptVM::cRet)      return oRet;
+	return oOther;
+}
+
+void ScriptVM::JitEmitter::analyze()
+{
+	// instruction keeps operands of previous one only if it is reached by fall through from it alone.
+	const size_t count = _sorted.size();
+	std::unordered_map<uint32_t, size_t> indexOf;
+	for (size_t i = 0; i < count; i++)
+	{
+		indexOf[_sorted[i].first] = i;
+		_kinds.push_back(kindOf(_block.ops[i]));
+	}
+	// targets of instruction; branch targets are entered with empty operand stack.
+	auto successors = [&](size_t i, bool& branch) -> std::vector<uint32_t> {
+		const uint32_t pc = _sorted[i].first;
+		const CompiledOp& op = _block.ops[i];
+		branch = true;
+		switch (_kinds[i])
+		{
+			case oNone:
+			case oRet:
+			case oCall:         return {};
+			case oJmp:          return {pc + op.a};
+			case oFjmp:
+			case oTjmp:         return {pc + 1, pc + op.a};
+			case oCompareJump:  return {pc + 2, pc + 1 + op.c};
+			default: break;
+		}
+		branch = false;
+		return {pc + (_kinds[i] == oBinopConst || _kinds[i] == oRefDeref ? 2 : 1)};
+	};
+
+	std::vector<int> preds(count, 0);
+	std::vector<size_t> pred(count, 0);
+	std::vector<bool> entry(count, false), branchTarget(count, false);
+	_emitted.assign(count, false);
+	_boundary.assign(count, false);
+	std::vector<size_t> queue;
+	auto reach = [&](size_t i) {
+		if (!_emitted[i])
+			queue.push_back(i);
+		_emitted[i] = true;
+	};
+	if (indexOf.count(_entry))
+	{
+		entry[indexOf[_entry]] = true;
+		reach(indexOf[_entry]);
+	}
+	// second instruction of fused pair is not reached.
+	while (!queue.empty())
+	{
+		const size_t i = queue.back();
+		queue.pop_back();
+		const uint32_t pc = _sorted[i].first;
+		if (_kinds[i] == oCall && indexOf.count(pc + 1))
+		{
+			entry[indexOf[pc + 1]] = true;
+			reach(indexOf[pc + 1]);
+		}
+		bool branch;
+		for (uint32_t target : successors(i, branch))
+		{
+			auto it = indexOf.find(target);
+			if (it == indexOf.end())
+				continue;
+			preds[it->second]++;
+			pred[it->second] = i;
+			if (branch)
+				branchTarget[it->second] = true;
+			reach(it->second);
+		}
+	}
+	size_t previous = count;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!_emitted[i])
+			continue;
+		_boundary[i] = entry[i] || preds[i] != 1 || branchTarget[i] || pred[i] != previous;
+		previous = i;
+	}
+}
+
+size_t ScriptVM::JitEmitter::nextEmitted(size_t i) const
+{
+	for (i++; i < _sorted.size(); i++)
+		if (_emitted[i])
+			return i;
+	return i;
+}
+
+void ScriptVM::JitEmitter::commit()
+{
+	if (_pending)
+		_a.vmAdd(_opCntField, _pending);
+	_pending = 0;
+}
+
+void ScriptVM::JitEmitter::callMaterialize(const std::vector<JitOperand>& operands, uint32_t pending)
+{
+	_block.materialized.push_back(JitBlock::Materialized{operands, pending});
+	_a.call(reinterpret_cast<uintptr_t>(&JitEmitter::materialize), reinterpret_cast<uintptr_t>(&_block.materialized.back()), slot(0));
+	_exits.push_back(_a.jcc(Assembler::cE));
+	_resolved.clear(); // stack may be reallocated.
+}
+
+void ScriptVM::JitEmitter::flush()
+{
+	if (_operands.empty())
+		return;
+	const uint32_t pending = _pending;
+	commit();
+	callMaterialize(_operands, pending);
+	_operands.clear();
+}
+
+void ScriptVM::JitEmitter::follow(size_t i, uint32_t target)
+{
+	const size_t next = nextEmitted(i);
+	if (next < _sorted.size() && _sorted[next].first == target)
+		return; // operands are kept; boundary instruction flushes them itself.
+	flush();
+	commit();
+	jumpTo(target);
+}
+
+void ScriptVM::JitEmitter::callHandler(uint32_t pc, const CompiledOp &op)
+{
+	_a.vmStore(_pcField, pc);
+	_a.call(reinterpret_cast<uintptr_t>(&JitEmitter::handler), reinterpret_cast<uintptr_t>(&op));
+	_exits.push_back(_a.jcc(Assembler::cE));
+	_a.vmAdd(_opCntField, 1);
+	_resolved.clear();
+}
+
+std::vector<size_t> &ScriptVM::JitEmitter::sideExit()
+{
+	if (_sideExit < 0)
+	{
+		_sideExit = int(_sideExits.size());
+		_sideExits.push_back(SideExit{{}, _startOperands, _startPending, _sorted[_current].first, &_block.ops[_current]});
+	}
+	return _sideExits[size_t(_sideExit)].fixups;
+}
+
+void ScriptVM::JitEmitter::push(const JitOperand &operand)
+{
+	if (_operands.size() >= SlotCount)
+		flush();
+	_operands.push_back(operand);
+	_operands.back().pending = _pending;
+}
+
+size_t ScriptVM::JitEmitter::take(size_t count, std::vector<JitOperand> &taken) const
+{
+	// operands of instruction; missing ones were pushed to VM stack by flush() or by handlers.
+	const size_t stacked = count > _operands.size() ? count - _operands.size() : 0;
+	taken.clear();
+	for (size_t i = 0; i < stacked; i++)
+	{
+		JitOperand operand{JitOperand::Stacked, nullptr, nullptr, 0, 0};
+		operand.depth = int(stacked - 1 - i);
+		taken.push_back(operand);
+	}
+	taken.insert(taken.end(), _operands.end() - (count - stacked), _operands.end());
+	return stacked;
+}
+
+bool ScriptVM::JitEmitter::valueBelow(size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		if (_operands[i].kind == JitOperand::Value)
+			return true;
+	return false;
+}
+
+void ScriptVM::JitEmitter::resolve(const JitOperand &operand, size_t index)
+{
+	// rax = variable; frame search of pushReference(), offsets of IDX and ADDRF, then pointer is followed as
+	// setPointer() does. Frames, stack size and buffers change only in calls, so address of variable is kept
+	// until next call or jump target.
+	if (operand.kind == JitOperand::Stacked)
+	{
+		_a.mem(0, false, {0x8B}, RAX, RBX, _sizeField);                   // mov eax, _stackSize
+		_a.alu(5, false, RAX, uint32_t(operand.depth + 1));
+		_a.regs(0, true, {0x69}, RAX, RAX); _a.imm32(sizeof(ScriptVariant));
+		_a.mem(0, true, {0x03}, RAX, RBX, _stackField + _layout.stackBegin);
+		followPointer();
+		return;
+	}
+	const CompiledOp& ref = *operand.ref;
+	const bool pointer = operand.pointer();
+	const bool plain = !operand.indexed && operand.field < 0;
+	const auto key = std::make_tuple(ref.a, ref.b, pointer);
+	const auto cached = std::find(_resolved.begin(), _resolved.end(), key);
+	if ((plain || pointer) && cached != _resolved.end())
+		_a.mem(0, true, {0x8B}, RAX, RSP, slot(CacheFirst + int(cached - _resolved.begin())));
+	else
+	{
+		_a.mem(0, true, {0x8B}, RCX, RBX, _framesField + _layout.framesEnd);   // mov rcx, frames end
+		_a.mem(0, true, {0x8B}, RDX, RBX, _framesField + _layout.framesBegin); // mov rdx, frames begin
+		const size_t search = _a.pos();
+		_a.alu(5, true, RCX, uint32_t(_layout.frameSize));
+		_a.regs(0, true, {0x39}, RDX, RCX);                                     // cmp rcx, rdx
+		const size_t first = _a.jcc(Assembler::cE);
+		_a.mem(0, false, {0x81}, 7, RCX, _layout.frameScope); _a.imm32(uint32_t(ref.b));
+		_a.patch(_a.jcc(Assembler::cNE), search);
+		_a.patch(first, _a.pos());
+		// whole array or record is checked, so its elements are below _stackSize.
+		const int last = pointer || ref.c < 1 ? 0 : ref.c - 1;
+		_a.mem(0, false, {0x8B}, RAX, RCX, _layout.frameBottom);               // mov eax, bottom
+		_a.alu(0, false, RAX, uint32_t(ref.a + last));
+		_a.mem(0, false, {0x3B}, RAX, RBX, _sizeField);                        // cmp eax, _stackSize
+		sideExit().push_back(_a.jcc(Assembler::cAE));
+		if (last)
+			_a.alu(5, false, RAX, uint32_t(last));
+		_a.regs(0, true, {0x69}, RAX, RAX); _a.imm32(sizeof(ScriptVariant));    // imul rax, rax, size
+		_a.mem(0, true, {0x03}, RAX, RBX, _stackField + _layout.stackBegin);   // add rax, stack begin
+		if (!plain && !pointer)
+		{
+			// array in var parameter is pointer, which REF replaces by its target.
+			_a.cmpByte(RAX, _layout.type, ScriptVariant::T_ptr);
+			sideExit().push_back(_a.jcc(Assembler::cE));
+		}
+		if (pointer || plain)
+		{
+			if (!pointer)
+				followPointer();
+			if (_resolved.size() < CacheCount)
+			{
+				_a.mem(0, true, {0x89}, RAX, RSP, slot(CacheFirst + int(_resolved.size())));
+				_resolved.push_back(key);
+			}
+		}
+	}
+	if (pointer)
+	{
+		// addPointer() of pointer copy: offset is checked by maxIndex and by size of container.
+		_a.cmpByte(RAX, _layout.type, ScriptVariant::T_ptr);
+		sideExit().push_back(_a.jcc(Assembler::cNE));
+		_a.mem(0, true, {0x83}, 7, RAX, _layout.data + _layout.container2); _a.bytes({0});
+		sideExit().push_back(_a.jcc(Assembler::cNE));
+		_a.mem(0, true, {0x8B}, RCX, RAX, _layout.data + _layout.index);
+		if (operand.field > 0)
+			_a.alu(0, true, RCX, uint32_t(operand.field));
+		_a.mem(0, true, {0x3B}, RCX, RAX, _layout.data + _layout.maxIndex);    // cmp rcx, maxIndex
+		sideExit().push_back(_a.jcc(Assembler::cA));
+		_a.mem(0, true, {0x8B}, RAX, RAX, _layout.data + _layout.container);
+		_a.mem(0, true, {0x8B}, RDX, RAX, _layout.stackEnd);
+		_a.mem(0, true, {0x2B}, RDX, RAX, _layout.stackBegin);                 // rdx = container bytes
+		_a.regs(0, true, {0x69}, RCX, RCX); _a.imm32(sizeof(ScriptVariant));
+		_a.regs(0, true, {0x39}, RDX, RCX);                                     // cmp rcx, rdx
+		sideExit().push_back(_a.jcc(Assembler::cAE));
+		_a.mem(0, true, {0x03}, RCX, RAX, _layout.stackBegin);
+		_a.regs(0, true, {0x89}, RCX, RAX);                                     // mov rax, rcx
+		followPointer();
+	}
+	else if (!plain)
+	{
+		if (operand.indexed)
+		{
+			_a.mem(0, true, {0x8B}, RCX, RSP, slot(int(index)));
+			_a.regs(0, true, {0x69}, RCX, RCX); _a.imm32(sizeof(ScriptVariant));
+			_a.regs(0, true, {0x01}, RCX, RAX);                                 // add rax, rcx
+			if (operand.field >= 0)
+			{
+				// element which is pointer is replaced by its target before ADDRF.
+				_a.cmpByte(RAX, _layout.type, ScriptVariant::T_ptr);
+				sideExit().push_back(_a.jcc(Assembler::cE));
+			}
+		}
+		if (operand.field > 0)
+			_a.alu(0, true, RAX, uint32_t(operand.field * int(sizeof(ScriptVariant))));
+		followPointer();
+	}
+}
+
+void ScriptVM::JitEmitter::followPointer()
+{
+	// autoDeref of setPointer(): variable which is pointer is replaced by its target.
+	_a.cmpByte(RAX, _layout.type, ScriptVariant::T_ptr);
+	const size_t scalar = _a.jcc(Assembler::cNE);
+	_a.mem(0, true, {0x83}, 7, RAX, _layout.data + _layout.container2); _a.bytes({0});
+	sideExit().push_back(_a.jcc(Assembler::cNE));
+	_a.mem(0, true, {0x8B}, RCX, RAX, _layout.data + _layout.index);
+	_a.mem(0, true, {0x8B}, RAX, RAX, _layout.data + _layout.container);
+	_a.regs(0, true, {0x69}, RCX, RCX); _a.imm32(sizeof(ScriptVariant));
+	_a.mem(0, true, {0x03}, RCX, RAX, _layout.stackBegin);
+	_a.regs(0, true, {0x89}, RCX, RAX);                                         // mov rax, rcx
+	_a.patch(scalar, _a.pos());
+}
+
+bool ScriptVM::JitEmitter::loadable(const JitOperand &operand, int type) const
+{
+	switch (operand.kind)
+	{
+		case JitOperand::Constant: return convertible(operand.constant->_Type, type);
+		case JitOperand::Computed: return convertible(operand.type, type);
+		case JitOperand::Value:    return (!operand.pointer() || operand.field >= 0) && !sourcesOf(type).empty();
+		default: return !sourcesOf(type).empty();
+	}
+}
+
+void ScriptVM::JitEmitter::loadConverted(int from, int to, Reg base, int disp)
+{
+	// float64 to xmm0, other types to rcx.
+	const bool wide = from == ScriptVariant::T_int64_t;
+	if (to == ScriptVariant::T_float64 && from == ScriptVariant::T_float64)
+		_a.mem(0xF2, false, {0x0F, 0x10}, 0, base, disp);        // movsd xmm0
+	else if (to == ScriptVariant::T_float64)
+		_a.mem(0xF2, wide, {0x0F, 0x2A}, 0, base, disp);         // cvtsi2sd xmm0
+	else if (to == ScriptVariant::T_int64_t && from == ScriptVariant::T_int32_t)
+		_a.mem(0, true, {0x63}, RCX, base, disp);                // movsxd rcx
+	else if (to == ScriptVariant::T_bool)
+		_a.mem(0, false, {0x0F, 0xB6}, RCX, base, disp);         // movzx ecx, byte
+	else
+		_a.mem(0, to == ScriptVariant::T_int64_t, {0x8B}, RCX, base, disp);
+}
+
+void ScriptVM::JitEmitter::loadConstant(const ScriptVariant &value, int type)
+{
+	uint64_t bits = 0;
+	if (type == ScriptVariant::T_float64)
+	{
+		const double converted = value.getValue<double>();
+		memcpy(&bits, &converted, sizeof(bits));
+	}
+	else if (type == ScriptVariant::T_int64_t)
+		bits = uint64_t(value.getValue<int64_t>());
+	else if (type == ScriptVariant::T_int32_t)
+		bits = uint32_t(value.getValue<int32_t>());
+	else
+		bits = value.getValue<bool>() ? 1 : 0;
+	_a.moveRcx(bits);
+	if (type == ScriptVariant::T_float64)
+		_a.moveXmm0Rcx();
+}
+
+void ScriptVM::JitEmitter::load(const JitOperand &operand, size_t index, int type, int temp)
+{
+	if (operand.kind == JitOperand::Constant)
+		loadConstant(*operand.constant, type);
+	else if (operand.kind == JitOperand::Computed)
+		loadConverted(operand.type, type, RSP, slot(int(index)));
+	else
+	{
+		resolve(operand, index);
+		std::vector<size_t> done;
+		for (int from : sourcesOf(type))
+		{
+			_a.cmpByte(RAX, _layout.type, uint8_t(from));
+			const size_t other = _a.jcc(Assembler::cNE);
+			loadConverted(from, type, RAX, _layout.data);
+			done.push_back(_a.jmp());
+			_a.patch(other, _a.pos());
+		}
+		sideExit().push_back(_a.jmp());
+		_a.bind(done);
+	}
+	storeSlot(type, temp);
+}
+
+void ScriptVM::JitEmitter::storeVariable(int type)
+{
+	const int disp = _layout.data;
+	if (type == ScriptVariant::T_float64)
+		_a.mem(0xF2, false, {0x0F, 0x11}, 0, RAX, disp);         // movsd [rax + data], xmm0
+	else if (type == ScriptVariant::T_bool)
+		_a.mem(0, false, {0x88}, RCX, RAX, disp);                // mov [rax + data], cl
+	else
+		_a.mem(0, type == ScriptVariant::T_int64_t, {0x89}, RCX, RAX, disp);
+}
+
+void ScriptVM::JitEmitter::storeSlot(int type, int index)
+{
+	if (type == ScriptVariant::T_float64)
+		_a.mem(0xF2, false, {0x0F, 0x11}, 0, RSP, slot(index));
+	else
+		_a.mem(0, true, {0x89}, RCX, RSP, slot(index));
+}
+
+bool ScriptVM::JitEmitter::index(size_t i)
+{
+	// (index - low) * stride is checked against size of array and kept in operand slot of array.
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const size_t n = _operands.size();
+	if (n < 2 || op.a <= 0)
+		return false;
+	const JitOperand& array = _operands[n - 2];
+	if (array.kind != JitOperand::Reference || array.indexed || array.field >= 0 || !loadable(_operands[n - 1], ScriptVariant::T_int32_t))
+		return false;
+	load(_operands[n - 1], n - 1, ScriptVariant::T_int32_t, TempA);
+	_a.mem(0, true, {0x63}, RCX, RSP, slot(TempA));                  // movsxd rcx
+	if (op.b)
+		_a.alu(5, true, RCX, uint32_t(op.b));
+	_a.regs(0, true, {0x69}, RCX, RCX); _a.imm32(uint32_t(op.a));
+	_a.alu(7, true, RCX, uint32_t(array.ref->c));
+	sideExit().push_back(_a.jcc(Assembler::cAE));
+	_a.mem(0, true, {0x89}, RCX, RSP, slot(int(n - 2)));
+	_operands.pop_back();
+	_operands.back().indexed = true;
+	_pending++;
+	follow(i, pc + 1);
+	return true;
+}
+
+bool ScriptVM::JitEmitter::field(size_t i)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const size_t n = _operands.size();
+	if (!n || op.a < 0 || _operands[n - 1].field >= 0)
+		return false;
+	JitOperand& record = _operands[n - 1];
+	if (record.kind == JitOperand::Reference && record.indexed)
+	{
+		_a.mem(0, true, {0x8B}, RCX, RSP, slot(int(n - 1)));
+		_a.alu(0, true, RCX, uint32_t(op.a));
+		_a.alu(7, true, RCX, uint32_t(record.ref->c));
+		sideExit().push_back(_a.jcc(Assembler::cAE));
+	}
+	else if (record.kind == JitOperand::Reference)
+	{
+		if (op.a >= record.ref->c)
+			return false;
+	}
+	else if (!record.pointer())
+		return false;
+	record.field = op.a;
+	_pending++;
+	follow(i, pc + 1);
+	return true;
+}
+
+bool ScriptVM::JitEmitter::binop(size_t i, OpKind kind)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const TypedTemplate t = typedTemplate(op.a, op.b);
+	const size_t count = kind == oBinopConst ? 1 : 2;
+	if (!t.supported)
+		return false;
+	const int type = op.b;
+	const size_t n = _operands.size();
+	std::vector<JitOperand> taken;
+	const size_t stacked = take(count, taken);
+	const size_t first = n + stacked - count;
+	const JitOperand constant{JitOperand::Constant, nullptr, op.value, 0, pc};
+	const JitOperand& left = taken[0];
+	const JitOperand& right = kind == oBinopConst ? constant : taken[1];
+	if (!loadable(left, type) || !loadable(right, type))
+		return false;
+
+	load(right, n - 1, type, TempB);
+	load(left, n - count, type, TempA);
+	_operands.resize(first);
+	if (stacked)
+		_a.vmSub(_sizeField, uint32_t(stacked));
+	_pending += kind == oBinop ? 1 : 2;
+	if (kind == oCompareJump)
+	{
+		flush();
+		commit();
+	}
+
+	const bool isFloat = type == ScriptVariant::T_float64;
+	const bool wide = type == ScriptVariant::T_int64_t;
+	if (isFloat)
+		_a.mem(0xF2, false, {0x0F, 0x10}, 0, RSP, slot(TempA));
+	else
+		_a.mem(0, wide, {0x8B}, RCX, RSP, slot(TempA));
+	if (t.compare && isFloat)
+	{
+		_a.mem(0xF2, false, {0x0F, 0x10}, 1, RSP, slot(TempB));  // movsd xmm1
+		_a.ucomisd(t.swapped);
+	}
+	else if (t.compare)
+		_a.mem(0, wide, {0x3B}, RCX, RSP, slot(TempB));          // cmp rcx, right
+
+	if (kind == oCompareJump)
+	{
+		jumpIf(t.condition, pc + 2);
+		follow(i, pc + 1 + op.c);
+		return true;
+	}
+	const int result = int(first);
+	if (t.compare)
+	{
+		_a.setccCl(t.condition);
+		_a.mem(0, false, {0x88}, RCX, RSP, slot(result));
+	}
+	else
+	{
+		if (isFloat)
+			_a.mem(0xF2, false, {0x0F, t.opcode}, 0, RSP, slot(TempB));
+		else if (op.a == BytecodeVM::PLUS)
+			_a.mem(0, wide, {0x03}, RCX, RSP, slot(TempB));
+		else if (op.a == BytecodeVM::MINUS)
+			_a.mem(0, wide, {0x2B}, RCX, RSP, slot(TempB));
+		else
+			_a.mem(0, wide, {0x0F, 0xAF}, RCX, RSP, slot(TempB));
+		storeSlot(type, result);
+	}
+	_operands.push_back(JitOperand{JitOperand::Computed, nullptr, nullptr, t.compare ? int(ScriptVariant::T_bool) : type, pc});
+	follow(i, pc + (kind == oBinop ? 1 : 2));
+	return true;
+}
+
+bool ScriptVM::JitEmitter::movs(size_t i)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const size_t n = _operands.size();
+	if (op.b != 1 || !(op.a & BytecodeVM::mLeftIsRef) || (op.a & BytecodeVM::mAddress))
+		return false;
+	std::vector<JitOperand> taken;
+	const size_t stacked = take(2, taken);
+	const size_t first = n + stacked - 2;
+	const JitOperand& left = taken[0];
+	const JitOperand& right = taken[1];
+	auto addressed = [](const JitOperand& operand) {
+		return operand.kind == JitOperand::Reference || operand.kind == JitOperand::Stacked || (operand.pointer() && operand.field >= 0);
+	};
+	const bool dynamic = right.kind == JitOperand::Reference || right.kind == JitOperand::Value || right.kind == JitOperand::Stacked;
+	if (!addressed(left) || ((op.a & BytecodeVM::mRightIsRef) && !addressed(right)) || (right.pointer() && right.field < 0) || valueBelow(first))
+		return false;
+	const int from = right.kind == JitOperand::Constant ? right.constant->_Type : right.type;
+	if (!dynamic && !convertible(from, from))
+		return false;
+
+	// setOpValue(): same type is copied, other scalar is converted to type of variable.
+	std::vector<size_t> done;
+	if (dynamic)
+	{
+		resolve(right, n - 1);
+		_a.mem(0, false, {0x8A}, RCX, RAX, _layout.type);             // mov cl, type
+		_a.cmpCl(ScriptVariant::T_ptr);
+		sideExit().push_back(_a.jcc(Assembler::cAE));
+		_a.mem(0, false, {0x88}, RCX, RSP, slot(TempType));
+		_a.mem(0, true, {0x8B}, RCX, RAX, _layout.data);
+		_a.mem(0, true, {0x89}, RCX, RSP, slot(TempB));
+		resolve(left, n - 2);
+		_a.mem(0, false, {0x8A}, RCX, RSP, slot(TempType));
+		_a.mem(0, false, {0x38}, RCX, RAX, _layout.type);             // cmp type, cl
+		const size_t converted = _a.jcc(Assembler::cNE);
+		_a.mem(0, true, {0x8B}, RCX, RSP, slot(TempB));
+		_a.mem(0, true, {0x89}, RCX, RAX, _layout.data);
+		done.push_back(_a.jmp());
+		_a.patch(converted, _a.pos());
+		for (int to : {ScriptVariant::T_float64, ScriptVariant::T_int64_t, ScriptVariant::T_int32_t})
+		{
+			_a.cmpByte(RAX, _layout.type, uint8_t(to));
+			const size_t otherTarget = _a.jcc(Assembler::cNE);
+			for (int source : sourcesOf(to))
+			{
+				if (source == to)
+					continue;
+				_a.cmpCl(uint8_t(source));
+				const size_t otherSource = _a.jcc(Assembler::cNE);
+				loadConverted(source, to, RSP, slot(TempB));
+				storeVariable(to);
+				done.push_back(_a.jmp());
+				_a.patch(otherSource, _a.pos());
+			}
+			sideExit().push_back(_a.jmp());
+			_a.patch(otherTarget, _a.pos());
+		}
+		sideExit().push_back(_a.jmp());
+	}
+	else
+	{
+		resolve(left, n - 2);
+		for (int to : {ScriptVariant::T_float64, ScriptVariant::T_int32_t, ScriptVariant::T_int64_t, ScriptVariant::T_bool})
+		{
+			if (!convertible(from, to))
+				continue;
+			_a.cmpByte(RAX, _layout.type, uint8_t(to));
+			const size_t otherTarget = _a.jcc(Assembler::cNE);
+			if (right.kind == JitOperand::Constant)
+				loadConstant(*right.constant, to);
+			else
+				loadConverted(from, to, RSP, slot(int(n - 1)));
+			storeVariable(to);
+			done.push_back(_a.jmp());
+			_a.patch(otherTarget, _a.pos());
+		}
+		sideExit().push_back(_a.jmp());
+	}
+	_a.bind(done);
+	_a.mem(0, false, {0xC6}, 0, RAX, _layout.valueChanged); _a.bytes({1});
+	_operands.resize(first);
+	if (stacked)
+		_a.vmSub(_sizeField, uint32_t(stacked));
+	_pending++;
+	follow(i, pc + 1);
+	return true;
+}
+
+bool ScriptVM::JitEmitter::unop(size_t i)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const size_t n = _operands.size();
+	if ((op.a != BytecodeVM::UINC && op.a != BytecodeVM::UDEC) || (op.b != ScriptVariant::T_int32_t && op.b != ScriptVariant::T_int64_t)
+		|| n < 1 || _operands[n - 1].kind != JitOperand::Reference || valueBelow(n - 1))
+		return false;
+	// reference stays on stack, variable of other type is converted by setValue().
+	resolve(_operands[n - 1], n - 1);
+	_a.cmpByte(RAX, _layout.type, uint8_t(op.b));
+	sideExit().push_back(_a.jcc(Assembler::cNE));
+	_a.mem(0, op.b == ScriptVariant::T_int64_t, {0xFF}, op.a == BytecodeVM::UINC ? 0 : 1, RAX, _layout.data);
+	_pending++;
+	follow(i, pc + 1);
+	return true;
+}
+
+bool ScriptVM::JitEmitter::condition(size_t i, bool onFalse)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	const uint32_t whenTrue = onFalse ? pc + 1 : pc + op.a;
+	const uint32_t whenFalse = onFalse ? pc + op.a : pc + 1;
+	std::vector<JitOperand> taken;
+	const size_t stacked = take(1, taken);
+	const JitOperand top = taken[0];
+	const size_t index = _operands.size() - 1;
+	if (top.kind == JitOperand::Constant)
+	{
+		if (top.constant->_Type != ScriptVariant::T_bool)
+			return false;
+		_operands.pop_back();
+		_pending++;
+		flush();
+		commit();
+		const uint32_t target = top.constant->getValue<bool>() ? whenTrue : whenFalse;
+		follow(i, target);
+		return true;
+	}
+	if (!loadable(top, ScriptVariant::T_bool))
+		return false;
+	int conditionSlot = int(index);
+	if (top.kind != JitOperand::Computed)
+	{
+		load(top, index, ScriptVariant::T_bool, TempA);
+		conditionSlot = TempA;
+	}
+	if (stacked)
+		_a.vmSub(_sizeField, 1);
+	else
+		_operands.pop_back();
+	_pending++;
+	flush();
+	commit();
+	_a.cmpByte(RSP, slot(conditionSlot), 0);
+	jumpIf(Assembler::cNE, whenTrue);
+	follow(i, whenFalse);
+	return true;
+}
+
+bool ScriptVM::JitEmitter::emitVirtual(size_t i)
+{
+	const uint32_t pc = _sorted[i].first;
+	const CompiledOp& op = _block.ops[i];
+	switch (_kinds[i])
+	{
+		case oRef:
+		case oRefDeref:
+			if (op.c < 1 || (!op.d && _kinds[i] == oRef))
+				return false;
+			push(JitOperand{_kinds[i] == oRef ? JitOperand::Reference : JitOperand::Value, &op, nullptr, 0, pc});
+			_pending += _kinds[i] == oRef ? 1 : 2;
+			follow(i, pc + (_kinds[i] == oRef ? 1 : 2));
+			return true;
+		case oIdx:
+			return index(i);
+		case oAddRef:
+			return field(i);
+		case oDeref:
+			if (_operands.empty() || _operands.back().kind != JitOperand::Reference)
+				return false;
+			_operands.back().kind = JitOperand::Value;
+			_pending++;
+			follow(i, pc + 1);
+			return true;
+		case oPush:
+			// locals of function are pushed at its entry and referenced right after.
+			if (op.b != 1 || !convertible(op.value->_Type, op.value->_Type) || pc == _entry
+				|| (i > 0 && _kinds[i - 1] == oPush && _sorted[i - 1].first + 1 == pc && _operands.empty()))
+				return false;
+			push(JitOperand{JitOperand::Constant, nullptr, op.value, 0, pc});
+			_pending++;
+			follow(i, pc + 1);
+			return true;
+		case oBinop:
+		case oBinopConst:
+		case oCompareJump:
+			return binop(i, _kinds[i]);
+		case oMovs:
+			return movs(i);
+		case oUnop:
+			return unop(i);
+		case oFjmp:
+		case oTjmp:
+			return condition(i, _kinds[i] == oFjmp);
+		case oPop:
+			if (op.a <= 0 || _operands.size() < size_t(op.a))
+				return false;
+			_operands.resize(_operands.size() - size_t(op.a));
+			_pending++;
+			follow(i, pc + 1);
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool ScriptVM::JitEmitter::emit()
+{
+	if (!_layout.valid)
+		return false;
+	analyze();
+	_a.prologue(Frame);
+	for (size_t i = 0; i < _sorted.size(); i++)
+	{
+		if (!_emitted[i])
+			continue;
+		const uint32_t pc = _sorted[i].first;
+		const CompiledOp& op = _block.ops[i];
+		if (_boundary[i])
+		{
+			flush();
+			commit();
+			_resolved.clear();
+			_labels[pc] = _a.pos();
+			if (op.handler)
+				_entries.emplace_back(pc, _a.pos());
+		}
+		_current = i;
+		_sideExit = -1;
+		_startOperands = _operands;
+		_startPending = _pending;
+		if (emitVirtual(i))
+			continue;
+
+		flush();
+		commit();
+		switch (_kinds[i])
+		{
+			case oNone:
+				_a.vmStore(_pcField, pc);
+				_exits.push_back(_a.jmp());
+				break;
+			case oPop:
+				_a.vmSub(_sizeField, uint32_t(op.a));
+				_a.vmAdd(_opCntField, 1);
+				follow(i, pc + 1);
+				break;
+			case oJmp:
+				if (op.a >= 0)
+				{
+					_a.vmAdd(_opCntField, 1);
+					follow(i, pc + op.a);
+					break;
+				}
+				_a.vmStore(_pcField, pc + op.a);
+				_a.call(reinterpret_cast<uintptr_t>(&JitEmitter::countLoop), op.entry);
+				_exits.push_back(_a.jcc(Assembler::cE));
+				_resolved.clear();
+				_a.vmAdd(_opCntField, 1);
+				if (_lastTier)
+					jumpTo(pc + op.a);
+				else
+					_dispatches.push_back(_a.jmp()); // block may be replaced by tier 2.
+				break;
+			case oCall:
+			case oRet:
+				callHandler(pc, op);
+				_dispatches.push_back(_a.jmp());
+				break;
+			case oFjmp:
+			case oTjmp:
+			case oCompareJump:
+			{
+				// handler has set _pc to one of two targets.
+				const uint32_t first = _kinds[i] == oCompareJump ? pc + 2 : pc + 1;
+				const uint32_t second = _kinds[i] == oCompareJump ? pc + 1 + op.c : pc + op.a;
+				callHandler(pc, op);
+				_a.vmCmp(_pcField, first);
+				jumpIf(Assembler::cE, first);
+				follow(i, second);
+			} break;
+			case oBinopConst:
+			case oRefDeref:
+				callHandler(pc, op);
+				follow(i, pc + 2);
+				break;
+			default:
+				callHandler(pc, op);
+				follow(i, pc + 1);
+				break;
+		}
+	}
+	flush();
+	commit();
+
+	// exit executes instruction by handler with operands pushed.
+	for (SideExit& exit : _sideExits)
+	{
+		_a.bind(exit.fixups);
+		if (exit.pending)
+			_a.vmAdd(_opCntField, exit.pending);
+		if (!exit.operands.empty())
+			callMaterialize(exit.operands, exit.pending);
+		callHandler(exit.pc, *exit.op);
+		_dispatches.push_back(_a.jmp());
+	}
+	// targets out of range continue in dispatcher.
+	std::unordered_map<uint32_t, size_t> stubs;
+	for (const auto& jump : _jumps)
+	{
+		auto label = _labels.find(jump.second);
+		if (label != _labels.end())
+		{
+			_a.patch(jump.first, label->second);
+			continue;
+		}
+		auto stub = stubs.find(jump.second);
+		if (stub == stubs.end())
+		{
+			stub = stubs.emplace(jump.second, _a.pos()).first;
+			_a.vmStore(_pcField, jump.second);
+			_dispatches.push_back(_a.jmp());
+		}
+		_a.patch(jump.first, stub->second);
+	}
+	const size_t dispatch = _a.pos();
+	_exits.push_back(_a.loadEntry(_pcField, uint32_t(_vm._jitCode.size()), _vm._jitCode.data()));
+	_exits.push_back(_a.jcc(Assembler::cE));
+	_a.jmpRax();
+	const size_t exit = _a.pos();
+	_a.epilogue(Frame);
+	for (size_t at : _dispatches)
+		_a.patch(at, dispatch);
+	for (size_t at : _exits)
+		_a.patch(at, exit);
+	return _block.code.assign(_a.code.data(), _a.code.size());
+}
+
+bool ScriptVM::JitEmitter::handler(ScriptVM *vm, const CompiledOp *op)
+{
+	try {
+		(vm->*op->handler)(*op);
+	} catch (...) {
+		vm->_jitError = std::current_exception();
+		return false;
+	}
+	return true;
+}
+
+bool ScriptVM::JitEmitter::countLoop(ScriptVM *vm, uint32_t entry)
+{
+	try {
+		vm->countLoop(entry);
+	} catch (...) {
+		vm->_jitError = std::current_exception();
+		return false;
+	}
+	return true;
+}
+
+bool ScriptVM::JitEmitter::materialize(ScriptVM *vm, const JitBlock::Materialized *call, const uint8_t *slots)
+{
+	try {
+		for (size_t i = 0; i < call->operands.size(); i++)
+		{
+			const JitOperand& operand = call->operands[i];
+			switch (operand.kind)
+			{
+				case JitOperand::Reference:
+				case JitOperand::Value: {
+					const CompiledOp& ref = *operand.ref;
+					if (!vm->pushReference(ref.a, ref.b, ref.c, ref.d != 0))
+					{
+						// REF fails as its handler does: later instructions are not executed.
+						vm->_pc = operand.pc;
+						vm->_opCnt -= call->pending - operand.pending;
+						throw std::runtime_error("Trying to reference address beyond stack size.");
+					}
+					if (operand.indexed)
+					{
+						int64_t offset;
+						memcpy(&offset, slots + 8 * i, sizeof(offset));
+						vm->sTop().addPointer(int32_t(offset));
+					}
+					if (operand.field >= 0 && !operand.pointer())
+						vm->sTop().addPointer(operand.field);
+					if (operand.kind == JitOperand::Value)
+					{
+						ScriptVariant r = *(vm->sTop().getReferenced(0, 1));
+						vm->sTop() = r;
+					}
+					if (operand.field >= 0 && operand.pointer())
+						vm->sTop().addPointer(operand.field);
+				} break;
+				case JitOperand::Constant:
+					vm->sPush(*operand.constant);
+					break;
+				case JitOperand::Stacked:
+					break;
+				case JitOperand::Computed: {
+					const uint8_t* data = slots + 8 * i;
+					ScriptVariant value;
+					if (operand.type == ScriptVariant::T_float64)
+					{
+						double number;
+						memcpy(&number, data, sizeof(number));
+						value.setValue(number, ScriptVariant::T_AUTO);
+					}
+					else if (operand.type == ScriptVariant::T_int64_t)
+					{
+						int64_t number;
+						memcpy(&number, data, sizeof(number));
+						value.setValue(number, ScriptVariant::T_AUTO);
+					}
+					else if (operand.type == ScriptVariant::T_int32_t)
+					{
+						int32_t number;
+						memcpy(&number, data, sizeof(number));
+						value.setValue(number, ScriptVariant::T_AUTO);
+					}
+					else
+						value.setValue(*data != 0, ScriptVariant::T_AUTO);
+					vm->sPush(value);
+				} break;
+			}
+		}
+	} catch (...) {
+		vm->_jitError = std::current_exception();
+		return false;
+	}
+	return true;
+}
+#endif
+
+bool ScriptVM::hasJit()
+{
+#ifdef SCRIPTVM_JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+int ScriptVM::getJitFunctions() const
+{
+	int count = 0;
+	for (size_t entry = 0; entry < _hotCounters.size() && entry < _jitCode.size(); entry++)
+		if (_hotCounters[entry].tier > 0 && _jitCode[entry])
+			count++;
+	return count;
+}
+
+size_t ScriptVM::getJitCodeBytes() const
+{
+	size_t bytes = _jitCode.capacity() * sizeof(const uint8_t*);
+	for (const auto& block : _jitBlocks)
+		bytes += block->code.size() + block->ops.capacity() * sizeof(CompiledOp);
+	return bytes;
+}
+
+bool ScriptVM::emitJit(const CompiledRange &range)
+{
+#ifndef SCRIPTVM_JIT_X64
+	(void)range;
+	return false;
+#else
+	if (range.empty())
+		return false;
+	if (_jitCode.empty()) // blocks embed its address, so it is not resized until resetCompiled().
+		_jitCode.assign(_code.size(), nullptr);
+
+	CompiledRange sorted(range);
+	std::sort(sorted.begin(), sorted.end(), [](const CompiledRange::value_type& l, const CompiledRange::value_type& r) { return l.first < r.first; });
+	std::shared_ptr<JitBlock> block(new JitBlock);
+	block->ops.reserve(sorted.size());
+	for (const auto& item : sorted)
+		block->ops.push_back(item.second);
+
+	JitEmitter emitter(*this, sorted, *block);
+	if (!emitter.emit())
+		return false;
+	const uint8_t* base = block->code.data();
+	for (const auto& item : sorted)
+		if (item.first < _jitCode.size())
+			_jitCode[item.first] = nullptr;
+	for (const auto& entry : emitter.entries())
+		if (entry.first < _jitCode.size())
+			_jitCode[entry.first] = base + entry.second;
+	_jitBlocks.push_back(std::move(block));
+	return true;
+#endif
+}
+
+void ScriptVM::runJit()
+{
+#ifdef SCRIPTVM_JIT_X64
+	// every block starts with same prologue: entry(vm, code).
+	using Entry = void (*)(ScriptVM* vm, const uint8_t* code);
+	const Entry entry = reinterpret_cast<Entry>(reinterpret_cast<uintptr_t>(_jitBlocks.front()->code.data()));
+	entry(this, _jitCode[_pc]);
+	if (_jitError)
+	{
+		std::exception_ptr error = _jitError;
+		_jitError = nullptr;
+		std::rethrow_exception(error);
+	}
+#endif
+}
@@ -66,7 +66,14 @@ inline void CMP_F<float>(bool &res,const float& p1, const float& p2)
 { res = (qAbs1(p1 - p2) <= 0.00001f * qMin1(qAbs1(p1), qAbs1(p2))); }
 
 inline void PLUS_F(std::string &res,const std::string& p1,const std::string& p2)
-{ res = p1 + p2; } // concatenation.
+{ // concatenation; res may be p1 when folding several arguments.
+	if (&res == &p1) {
+		res += p2;
+		return;
+	}
+	res.reserve(p1.size() + p2.size());
+	res.assign(p1).append(p2);
+}
 inline void DIV_F(bool &res,const bool& ,const bool& )
 { res = false; }
 inline void DIVR_F(bool &res,const bool& ,const bool& )
@@ -81,7 +88,7 @@ inline void SHR_F(bool &res,const bool& ,const bool& )
 #define CASE_BIN(name, nameF) \
 	 case BytecodeVM::name:{\
 		   nameF(res , t1.getValue<T>(), t2.getValue<T>());\
-		   Vres.setValue(res, ScriptVariant::T_AUTO); \
+		   Vres.setValue(std::move(res), ScriptVariant::T_AUTO); \
 		};break
 
 #define CASE_BIN_L(name, nameF) \
@@ -165,7 +172,8 @@ void makeUnaryOperation(BytecodeVM::UnOp op, ScriptVariant& t1)
 		case BytecodeVM::UINV:{
 			 T val;
 			 INVERSE_F(val, t1.getValue<T>(), t1.getValue<T>());
-			 t1.setValue(val);
+			 tmp.setValue(val, ScriptVariant::T_AUTO); // operand may be reference to variable, which must stay unchanged.
+			 t1 = tmp;
 			 } break;
 		default: ; break;
 	}
@@ -217,11 +225,8 @@ bool makeCmpOperationWrap(ScriptVariant& t1, ScriptVariant& t2)
 
 }
 
-void ScriptVM::termOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, BytecodeVM::BINOP_flags /*flags*/)
+void ScriptVM::applyBinaryOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, ScriptVariant &res, const ScriptVariant &t1, const ScriptVariant &t2)
 {
-	ScriptVariant& t1= sTop(1);
-	ScriptVariant& t2= sTop(0);
-	ScriptVariant res;
 	switch(optype) {
 	   case ScriptVariant::T_bool:        makeBinaryOperation<bool       >(op, res, t1, t2); break;
 	   case ScriptVariant::T_float32:     makeBinaryOperation<float      >(op, res, t1, t2); break;
@@ -237,6 +242,14 @@ void ScriptVM::termOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype,
 	   case ScriptVariant::T_string:      makeBinaryOperation<std::string>(op, res, t1, t2); break;
 	   default: res._Type = ScriptVariant::T_UNDEFINED;
 	}
+}
+
+void ScriptVM::termOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, BytecodeVM::BINOP_flags /*flags*/)
+{
+	ScriptVariant& t1= sTop(1);
+	ScriptVariant& t2= sTop(0);
+	ScriptVariant res;
+	applyBinaryOperation(op, optype, res, t1, t2);
 
 	if (_debugFlags & dOperations)
 		(*_debugout) << "BINOP t=" << optype << " " << t1.getString() << " " << BytecodeVM::binopStr[op] << " " << t2.getString() << " = " << res.getString() << "\n";
@@ -261,6 +274,17 @@ void ScriptVM::movs(BytecodeVM::MOVS_flags flags, int size)
 	ScriptVariant &rightPointer = sList(rightOffset, 0);
 	std::string v;
 	const bool debugOperations =(_debugFlags & dOperations) && _debugout ;
+	if (isLeftRef && isRightRef && !isAddress && !debugOperations && size > 1) {
+		// whole array or record: resolve both ranges once instead of per element.
+		ScriptVariant *left = leftPointer.getReferencedRange(size);
+		const ScriptVariant *right = rightPointer.getReferencedRange(size);
+		if (left && right) {
+			for (int i=0; i<size;i++)
+				left[i].setOpValue(right[i]);
+			sPops(baseOffset);
+			return;
+		}
+	}
 	for (int i=0; i<size;i++){
 		ScriptVariant &leftVal  = isLeftRef ?  (* (leftPointer .getReferenced(i, 1))) : sList(baseOffset, i);
 		ScriptVariant &rightVal = isRightRef ? (* (rightPointer.getReferenced(i, 1))) : sList(rightOffset, i);
@@ -297,7 +321,13 @@ void ScriptVM::cmps(BytecodeVM::CMPS_flags flags, int size)
 	ScriptVariant &rightPointer = sList(rightOffset, 0);
 
 	bool t = true;
-	for (int i=0; i<size;i++){
+	ScriptVariant *leftRange  = isLeftRef  && size > 1 ? leftPointer .getReferencedRange(size) : nullptr;
+	ScriptVariant *rightRange = isRightRef && size > 1 ? rightPointer.getReferencedRange(size) : nullptr;
+	if (leftRange && rightRange) {
+		for (int i=0; i<size && t;i++)
+			t = makeCmpOperationWrap(leftRange[i], rightRange[i]); // follows pointer elements itself.
+	}
+	else for (int i=0; i<size;i++){
 		ScriptVariant &leftVal  = isLeftRef ?  (* (leftPointer .getReferenced(i))) : sList(baseOffset, i);
 		ScriptVariant &rightVal = isRightRef ? (* (rightPointer.getReferenced(i))) : sList(rightOffset, i);
 		t = makeCmpOperationWrap(leftVal, rightVal);
@@ -311,10 +341,8 @@ void ScriptVM::cmps(BytecodeVM::CMPS_flags flags, int size)
 	sPush(res);
 }
 
-void ScriptVM::unaryOperation(BytecodeVM::UnOp op, ScriptVariant::Types optype)
+void ScriptVM::applyUnaryOperation(BytecodeVM::UnOp op, ScriptVariant::Types optype, ScriptVariant &t1)
 {
-	ScriptVariant& t1= sTop(0);
-	ScriptVariant dbg = t1;
 	switch(optype){
 		case ScriptVariant::T_bool:       makeUnaryOperation<bool       >(op, t1); break;
 		case ScriptVariant::T_float32:    makeUnaryOperation<float      >(op, t1); break;
@@ -330,6 +358,13 @@ void ScriptVM::unaryOperation(BytecodeVM::UnOp op, ScriptVariant::Types optype)
 	   // case ScriptVariant::T_string:     makeUnaryOperation<std::string>(op, t1); break;
 		default: t1._Type = ScriptVariant::T_UNDEFINED;
 	}
+}
+
+void ScriptVM::unaryOperation(BytecodeVM::UnOp op, ScriptVariant::Types optype)
+{
+	ScriptVariant& t1= sTop(0);
+	ScriptVariant dbg = t1;
+	applyUnaryOperation(op, optype, t1);
 	if (_debugFlags & dOperations)
 		(*_debugout) << "UNNOP t=" << optype<< " " << BytecodeVM::unopStr[op] << " " << dbg.getValue<double>()  <<  " = " << t1.getValue<double>() << "\n";
 
@@ -365,18 +400,12 @@ void multOper(BytecodeVM::BinOp op, std::vector<ScriptVariant*>& args, ScriptVar
 			r = args[index + 1]->getValue<T>();
 		}
 	}
-	res.setValue(r, ScriptVariant::T_AUTO);
+	res.setValue(std::move(r), ScriptVariant::T_AUTO);
 }
 
 
-void ScriptVM::multOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, int count)
+void ScriptVM::applyMultOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, ScriptVariant &res, std::vector<ScriptVariant *> &args)
 {
-	if (!count) return;
-	std::vector<ScriptVariant*> args;
-	for (int i=0;i<count;i++){
-		args.push_back(&(sList(count, i)));
-	}
-	ScriptVariant res;
 	switch(optype){
 		case ScriptVariant::T_bool:       multOper<bool       >(op, args, res); break;
 		case ScriptVariant::T_float32:    multOper<float      >(op, args, res); break;
@@ -392,6 +421,22 @@ void ScriptVM::multOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype,
 		case ScriptVariant::T_string:     multOper<std::string>(op, args, res); break;
 		default: res._Type = ScriptVariant::T_UNDEFINED;
 	}
+}
+
+bool ScriptVM::applyCmpOperation(ScriptVariant &t1, ScriptVariant &t2)
+{
+	return makeCmpOperationWrap(t1, t2);
+}
+
+void ScriptVM::multOperation(BytecodeVM::BinOp op, ScriptVariant::Types optype, int count)
+{
+	if (!count) return;
+	std::vector<ScriptVariant*> args;
+	for (int i=0;i<count;i++){
+		args.push_back(&(sList(count, i)));
+	}
+	ScriptVariant res;
+	applyMultOperation(op, optype, res, args);
 	//printStack();
 	sPops(count);
 	sPush(res);
@@ -26,6 +26,37 @@ std::ostream &operator <<( std::ostream &debug, const ScriptVariant &opv)
 
 ScriptVariant ScriptVariant::_dumb;
 
+namespace {
+const size_t stringPoolLimit = 256;
+const size_t stringPoolMaxCapacity = 4096; // larger buffers are returned to heap.
+
+struct StringPool {
+	std::vector<std::shared_ptr<std::string>> free;
+	ScriptVariant::StringStats stats;
+	~StringPool();
+};
+thread_local StringPool stringPool;
+thread_local bool stringPoolAlive = true; // trivial, so it is valid while variants of thread are destroyed after pool.
+
+StringPool::~StringPool()
+{
+	stringPoolAlive = false;
+}
+
+std::shared_ptr<std::string> takeString()
+{
+	StringPool& pool = stringPool;
+	if (!pool.free.empty()) {
+		std::shared_ptr<std::string> str = std::move(pool.free.back());
+		pool.free.pop_back();
+		pool.stats.reused++;
+		return str;
+	}
+	pool.stats.allocated++;
+	return std::make_shared<std::string>(); // string and counter in one block.
+}
+}
+
 std::string ScriptVariant::typenames[ScriptVariant::TYPES_COUNT] = {
 	"bool",
 	"float32",
@@ -51,6 +82,114 @@ ScriptVariant::ScriptVariant()
 	_ValueChanged = false;
 }
 
+ScriptVariant::ScriptVariant(const ScriptVariant &another)
+	: _Type(another._Type)
+	, _ValueChanged(another._ValueChanged)
+	, _Data(another._Data)
+	, f_str(another.f_str)
+{
+	if (another.f_compound)
+		f_compound.reset(new Compound(*another.f_compound));
+}
+
+ScriptVariant::ScriptVariant(ScriptVariant &&another) noexcept = default;
+
+ScriptVariant &ScriptVariant::operator =(const ScriptVariant &another)
+{
+	if (this == &another)
+		return *this;
+	_Type = another._Type;
+	_ValueChanged = another._ValueChanged;
+	_Data = another._Data;
+	if (f_str != another.f_str) {
+		releaseString();
+		f_str = another.f_str;
+	}
+	if (another.f_compound)
+		f_compound.reset(new Compound(*another.f_compound)); // another may be element of our payload, so copy before reset.
+	else
+		f_compound.reset();
+	return *this;
+}
+
+ScriptVariant &ScriptVariant::operator =(ScriptVariant &&another) noexcept = default;
+
+void ScriptVariant::assignString(const std::string &value)
+{
+	if (f_str && f_str.use_count() == 1) {
+		*f_str = value; // keeps capacity
+		stringPool.stats.reused++;
+		return;
+	}
+	std::shared_ptr<std::string> str = takeString();
+	*str = value;
+	f_str = std::move(str);
+}
+
+void ScriptVariant::assignString(std::string &&value)
+{
+	if (f_str && f_str.use_count() == 1) {
+		*f_str = std::move(value);
+		stringPool.stats.reused++;
+		return;
+	}
+	std::shared_ptr<std::string> str = takeString();
+	*str = std::move(value);
+	f_str = std::move(str);
+}
+
+void ScriptVariant::releaseString()
+{
+	if (f_str && f_str.use_count() == 1 && stringPoolAlive
+		&& stringPool.free.size() < stringPoolLimit && f_str->capacity() <= stringPoolMaxCapacity) {
+		f_str->clear();
+		stringPool.free.push_back(std::move(f_str));
+	}
+	f_str.reset();
+}
+
+ScriptVariant::StringStats ScriptVariant::stringStats()
+{
+	StringStats stats = stringPool.stats;
+	stats.pooled = stringPool.free.size();
+	return stats;
+}
+
+void ScriptVariant::resetStringStats()
+{
+	stringPool.stats = StringStats();
+}
+
+void ScriptVariant::releaseStringPool()
+{
+	std::vector<std::shared_ptr<std::string>>().swap(stringPool.free);
+}
+
+void ScriptVariant::setValue(std::string &&val, unsigned char newType)
+{
+	if (newType == T_AUTO)
+		newType = T_string;
+	if (newType < T_UNDEFINED)
+		_Type = newType;
+	if (_Type == T_string)
+		assignString(std::move(val));
+	else
+		ScriptVariantSetter<std::string>::set(this, val);
+}
+
+ScriptVariant::Compound &ScriptVariant::compound()
+{
+	if (!f_compound)
+		f_compound.reset(new Compound());
+	return *f_compound;
+}
+
+const ScriptVariant::Compound &ScriptVariant::compound() const
+{
+	static const Compound empty;
+	return f_compound ? *f_compound : empty;
+}
+
 ScriptVariant::ScriptVariant(ScriptVariant::Types type)
 	: _Type(type)
 {
@@ -84,7 +223,7 @@ bool ScriptVariant::readFromByteStream(ByteOrderDataStreamReader &storage)
 			if (!storage.ReadPascalString (t ) ){
 				return false;
 			}
-			f_str.reset(new std::string(t));
+			assignString(std::move(t));
 
 		}
 		break;
@@ -96,23 +235,25 @@ bool ScriptVariant::readFromByteStream(ByteOrderDataStreamReader &storage)
 		case T_array:  {
 			uint32_t size;
 			storage >> size;
-			f_array.resize(size);
-			for (size_t i =0; i< f_array.size(); i++) {
-				f_array[i].readFromByteStream(storage);
+			std::vector<ScriptVariant>& array = compound().array;
+			array.resize(size);
+			for (size_t i =0; i< array.size(); i++) {
+				array[i].readFromByteStream(storage);
 			}
 		}break;
 		case T_map:  {
 			uint32_t size;
 			storage >> size;
-			f_map.clear();
-			f_map_keys.resize(size);
+			Compound& c = compound();
+			c.map.clear();
+			c.mapKeys.resize(size);
 			for (size_t i =0; i< size; i++) {
 				std::string t;
 				if (!storage.ReadPascalString (t ) ){
 					return false;
 				}
-				f_map_keys[i] = t;
-				f_map[t].readFromByteStream(storage);
+				c.mapKeys[i] = t;
+				c.map[t].readFromByteStream(storage);
 			}
 		}break;
 
@@ -143,16 +284,18 @@ void ScriptVariant::writeToByteStream(ByteOrderDataStreamWriter &storage) const
 			storage << (_Data.f_str_char?*_Data.f_str_char : char(0) );
 		}break;
 		case T_array:  {
-			storage << uint32_t(f_array.size());
-			for (size_t i =0; i< f_array.size(); i++) {
-				f_array[i].writeToByteStream(storage);
+			const std::vector<ScriptVariant>& array = compound().array;
+			storage << uint32_t(array.size());
+			for (size_t i =0; i< array.size(); i++) {
+				array[i].writeToByteStream(storage);
 			}
 		}break;
 		case T_map:  {
-			storage << uint32_t(f_map_keys.size());
-			for (size_t i =0; i< f_map_keys.size(); i++) {
-				storage.WritePascalString ( f_map_keys[i] ) ;
-				((f_map.find(f_map_keys[i]))->second).writeToByteStream(storage);
+			const Compound& c = compound();
+			storage << uint32_t(c.mapKeys.size());
+			for (size_t i =0; i< c.mapKeys.size(); i++) {
+				storage.WritePascalString ( c.mapKeys[i] ) ;
+				((c.map.find(c.mapKeys[i]))->second).writeToByteStream(storage);
 			}
 		}break;
 	}
@@ -179,8 +322,8 @@ bool ScriptVariant::operator ==(const ScriptVariant &Another) const
 		case T_string_char: {
 			return _Data.f_str_char && Another._Data.f_str_char && (*_Data.f_str_char) == (*Another._Data.f_str_char);
 		}
-		case T_array : return (f_array) == (Another.f_array);
-		case T_map : return (f_map) == (Another.f_map);
+		case T_array : return compound().array == Another.compound().array;
+		case T_map : return compound().map == Another.compound().map;
 		default: ; break;
 	}
 	return  false;
@@ -236,6 +379,27 @@ size_t ScriptVariant::getStorageSize() const
 	return res;
 }
 
+void ScriptVariant::collectHeapUsage(ScriptVariant::HeapUsage &usage, std::set<const void *> &seenStrings) const
+{
+	if (f_str && seenStrings.insert(f_str.get()).second)
+		usage.stringBytes += sizeof(std::string) + f_str->capacity();
+
+	if (!f_compound)
+		return;
+	usage.payloadBytes += sizeof(Compound);
+	usage.payloadBytes += f_compound->array.capacity() * sizeof(ScriptVariant);
+	for (const ScriptVariant& item : f_compound->array)
+		item.collectHeapUsage(usage, seenStrings);
+
+	for (const auto& item : f_compound->map) {
+		usage.payloadBytes += sizeof(item) + item.first.capacity();
+		item.second.collectHeapUsage(usage, seenStrings);
+	}
+	usage.payloadBytes += f_compound->mapKeys.capacity() * sizeof(std::string);
+	for (const std::string& key : f_compound->mapKeys)
+		usage.payloadBytes += key.capacity();
+}
+
 ScriptVariant::Types ScriptVariant::string2type(const std::string &str)
 {
 	std::map<std::string, ScriptVariant::Types>::const_iterator i = name2type.find(str);
@@ -258,11 +422,18 @@ std::map<std::string, ScriptVariant::Types> ScriptVariant::name2typeF()
 
 ScriptVariant::~ScriptVariant()
 {
+	if (f_str)
+		releaseString();
 }
 #define COPY_CASE(type)  case T_##type:   _Data.f_##type =  another.getValue<type>(); break;
 
 void ScriptVariant::setOpValue(const ScriptVariant &another)
 {
+	if (_Type == another._Type && _Type < T_ptr){ // scalar of same type, payload is not used.
+		_Data = another._Data;
+		_ValueChanged = true;
+		return;
+	}
 	if (_Type == another._Type && _Type !=T_ptr){
 	   *this = another;
 		_ValueChanged = true;
@@ -283,7 +454,7 @@ void ScriptVariant::setOpValue(const ScriptVariant &another)
 		COPY_CASE(int64_t) ;
 		COPY_CASE(uint64_t) ;
 		case T_string: {
-			(*f_str) = another.getString();
+			assignString(another.getString()); // copies sharing old value keep it.
 			break;
 		}
 		case T_string_char: {
@@ -388,20 +559,31 @@ void ScriptVariant::addPointer(int32_t i)
 
 const ScriptVariant *ScriptVariant::getReferenced(int offset, int limit) const
 {
-	if (limit == 0) return this;
-	if (_Type== T_ptr) return _Data.f_ptr.getSafe(offset)->getReferenced(0, limit -1);
-	return this;
+	return const_cast<ScriptVariant*>(this)->getReferenced(offset, limit);
 }
 ScriptVariant *ScriptVariant::getReferenced(int offset, int limit)
 {
-	if (limit == 0) return this;
-	if (_Type== T_ptr){
-		return _Data.f_ptr.getSafe(offset)->getReferenced(0, limit-1);
+	// offset applies to first pointer only; limit -1 follows whole chain.
+	ScriptVariant* v = this;
+	for (int depth = 0; depth != limit && v->_Type == T_ptr; depth++) {
+		if (depth > MAX_REFERENCE_DEPTH)
+			throw std::runtime_error("cyclic reference.");
+		v = v->_Data.f_ptr.getSafe(depth ? 0 : offset);
 	}
-	return this;
+	return v;
 }
 
 
+ScriptVariant *ScriptVariant::getReferencedRange(size_t size)
+{
+	if (_Type != T_ptr || !_Data.f_ptr.container || _Data.f_ptr.container2)
+		return nullptr;
+	const AddressPtr& ptr = _Data.f_ptr;
+	if (ptr.index + size > ptr.container->size())
+		return nullptr;
+	return &(*ptr.container)[ptr.index];
+}
+
 int ScriptVariant::getOffset() const
 {
 	if (_Type== T_ptr){
@@ -413,62 +595,66 @@ int ScriptVariant::getOffset() const
 void ScriptVariant::listAppend(const ScriptVariant &val)
 {
 	_Type = T_array;
-	f_array.push_back(val);
+	compound().array.push_back(val);
 }
 
 void ScriptVariant::listResize(size_t size)
 {
 	_Type = T_array;
-	f_array.resize(size);
+	compound().array.resize(size);
 }
 
 size_t ScriptVariant::listSize() const
 {
-	return f_array.size();
+	return compound().array.size();
 }
 
 ScriptVariant &ScriptVariant::operator [](size_t index)
 {
-	if (_Type == T_array && index < f_array.size() ) {
-		return f_array[index];
+	if (_Type == T_array && index < compound().array.size() ) {
+		return f_compound->array[index];
 	}
 	return _dumb;
 }
 
 const ScriptVariant &ScriptVariant::operator [](size_t index) const
 {
-	if (_Type == T_array && index < f_array.size() ) {
-		return f_array[index];
+	if (_Type == T_array && index < compound().array.size() ) {
+		return f_compound->array[index];
 	}
 	return _dumb;
 }
 
 const std::vector<std::string> &ScriptVariant::mapKeys() const
 {
-	return f_map_keys;
+	return compound().mapKeys;
 }
 
 void ScriptVariant::mapClear()
 {
 	_Type = T_map;
-	f_map.clear();
-	f_map_keys.clear();
+	if (f_compound) {
+		f_compound->map.clear();
+		f_compound->mapKeys.clear();
+	}
 }
 
 ScriptVariant &ScriptVariant::operator [](const std::string &index)
 {
 	_Type = T_map;
-	std::map<std::string, ScriptVariant>::const_iterator i = f_map.find(index);
-	if (i == f_map.end()) {
-		f_map_keys.push_back(index);
+	Compound& c = compound();
+	std::map<std::string, ScriptVariant>::const_iterator i = c.map.find(index);
+	if (i == c.map.end()) {
+		c.mapKeys.push_back(index);
 	}
-	return f_map[index];
+	return c.map[index];
 }
 
 const ScriptVariant &ScriptVariant::operator [](const std::string &index) const
 {
-	std::map<std::string, ScriptVariant>::const_iterator i = f_map.find(index);
-	if (i == f_map.end()) {
+	const std::map<std::string, ScriptVariant>& map = compound().map;
+	std::map<std::string, ScriptVariant>::const_iterator i = map.find(index);
+	if (i == map.end()) {
 		return _dumb;
 	}
 	return i->second;
@@ -530,18 +716,20 @@ std::string ScriptVariant::ConvertToString (bool useType, bool usePhysical, int
 			break;
 		case T_array: {
 			 os << "[ ";
-			 for (size_t i=0; i< f_array.size();i++) {
+			 const std::vector<ScriptVariant>& array = compound().array;
+			 for (size_t i=0; i< array.size();i++) {
 				 if (i>0) os << ", ";
-				 os << f_array[i].getString();
+				 os << array[i].getString();
 			 }
 			 os << " ]";
 		}break;
 		case T_map: {
 			 os << "{ ";
-			 for (size_t i=0; i< f_map_keys.size();i++) {
+			 const Compound& c = compound();
+			 for (size_t i=0; i< c.mapKeys.size();i++) {
 				 if (i>0) os << ", ";
-				 os << f_map_keys[i] << ": ";
-				 os << (f_map.find(f_map_keys[i])->second).getString();
+				 os << c.mapKeys[i] << ": ";
+				 os << (c.map.find(c.mapKeys[i])->second).getString();
 			 }
 			 os << " }";
 		}break;
@@ -584,7 +772,7 @@ bool ScriptVariant::ConvertFromString (const std::string &Input)
 		CONVERT_FROM_STR(float32)
 		CONVERT_FROM_STR(float64)
 		case T_string:
-			f_str.reset(new std::string(Input));
+			assignString(Input);
 			break;
 		case T_ptr:
 			_Data.f_ptr.get()->ConvertFromString(Input);
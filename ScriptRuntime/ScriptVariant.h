@@ -16,6 +16,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <stdint.h>
 #include <typeinfo>
 #include <stdexcept>
@@ -113,6 +114,8 @@ public:
 
 	template<class T>
 	void setValue(const T& val, unsigned char newType = T_UNDEFINED);
+	/// Takes buffer of val if variant becomes string, e.g. result of concatenation.
+	void setValue(std::string&& val, unsigned char newType = T_UNDEFINED);
 
 	void setOpValue(const ScriptVariant& another);
 	void setOpValueAddress(const ScriptVariant& another);
@@ -125,9 +128,12 @@ public:
 	void setPointer(const ScriptVariant::AddressPtr& ptr, bool autoDeref = true);
 	void setPointerDbg(const ScriptVariant::AddressPtr& ptr, bool autoDeref = true);
 	void addPointer(int32_t i);
+	const AddressPtr* getPointer() const { return _Type == T_ptr ? &_Data.f_ptr : nullptr; }
 
 	const ScriptVariant *getReferenced(int offset = 0, int limit = -1) const;
 	ScriptVariant *getReferenced(int offset = 0, int limit = -1);
+	/// First of size referenced values if they are adjacent elements of one container, otherwise nullptr.
+	ScriptVariant *getReferencedRange(size_t size);
 	int getOffset() const;
 
 	void listAppend(const ScriptVariant& val);
@@ -146,6 +152,10 @@ public:
 
 	ScriptVariant();
 	ScriptVariant(Types type);
+	ScriptVariant(const ScriptVariant& another);
+	ScriptVariant(ScriptVariant&& another) noexcept;
+	ScriptVariant& operator =(const ScriptVariant& another);
+	ScriptVariant& operator =(ScriptVariant&& another) noexcept;
 
 	template <class T>
 	inline ScriptVariant(const T& value){
@@ -171,6 +181,28 @@ public:
 	size_t getDataPointerSize() const;
 	size_t getStorageSize() const;
 
+	/// Heap memory owned by variant (not counting sizeof(ScriptVariant) itself).
+	struct HeapUsage {
+		size_t stringBytes = 0;   //!< f_str buffers; shared buffers counted once per seen set.
+		size_t payloadBytes = 0;  //!< array and map storage, including nested elements.
+	};
+	void collectHeapUsage(HeapUsage& usage, std::set<const void*>& seenStrings) const;
+
+	/**
+	 * String payloads of current thread. Assignment to a string that is not shared with copies overwrites it in place,
+	 * buffers released by destroyed or retyped variants are kept in a small pool and reused by the next strings,
+	 * so repeated VM runs of string formatting code reach steady state without malloc.
+	 */
+	struct StringStats {
+		size_t allocated = 0;     //!< new shared buffers.
+		size_t reused = 0;        //!< assignments served by own or pooled buffer.
+		size_t pooled = 0;        //!< buffers waiting in pool.
+	};
+	static StringStats stringStats();
+	static void resetStringStats();
+	/// Frees pooled buffers of current thread.
+	static void releaseStringPool();
+
 	static Types string2type(const std::string& str);
 	static std::string type2string(Types type);
 
@@ -191,10 +223,31 @@ private:
 		char      *f_str_char;
 	} _Data;
 	std::shared_ptr<std::string> f_str;
-	std::vector<ScriptVariant> f_array;
-	std::map<std::string, ScriptVariant> f_map;
-	std::vector<std::string> f_map_keys;
+	void assignString(const std::string& value);
+	void assignString(std::string&& value);
+	void releaseString();
+	/// Payload of T_array and T_map; most variants are scalars, so it is allocated on first use.
+	struct Compound {
+		std::vector<ScriptVariant> array;
+		std::map<std::string, ScriptVariant> map;
+		std::vector<std::string> mapKeys;
+	};
+	std::unique_ptr<Compound> f_compound;   //!< nullptr for scalars; deep copied.
+	Compound& compound();
+	const Compound& compound() const;
 	static const int MAX_REFERENCE_DEPTH = 32;
+
+	/// Follows pointer chain without recursion; chain longer than maxRefCount is treated as cycle.
+	template<class V>
+	static inline V* referencedValue(V* v, int maxRefCount)
+	{
+		while (v->_Type == T_ptr) {
+			if (maxRefCount-- <= 0)
+				throw std::runtime_error("cyclic reference.");
+			v = v->_Data.f_ptr.get();
+		}
+		return v;
+	}
 	template<class T>
 	inline Types determine(const T& ){
 		return T_UNDEFINED;
@@ -241,9 +294,6 @@ T ScriptVariant::getValueCounted(int maxRefCount) const
 
 template <class T>
 inline T ScriptVariantGetter<T>::get(const ScriptVariant* opv, int maxRefCount){
-	if (maxRefCount < 0) {
-		throw std::runtime_error("cyclic reference.");
-	}
 	switch (opv->_Type){
 		case ScriptVariant::T_bool:       return T(opv->_Data.f_bool);
 		case ScriptVariant::T_float32:    return T(opv->_Data.f_float32);
@@ -257,10 +307,8 @@ inline T ScriptVariantGetter<T>::get(const ScriptVariant* opv, int maxRefCount){
 		case ScriptVariant::T_int64_t:    return T(opv->_Data.f_int64_t);
 		case ScriptVariant::T_uint64_t:   return T(opv->_Data.f_uint64_t);
 		case ScriptVariant::T_string_char:   return T(opv->_Data.f_str_char? *opv->_Data.f_str_char : 0);
-		case ScriptVariant::T_ptr: {
-			const ScriptVariant* o =opv->_Data.f_ptr.get();
-			return o->getValueCounted<T>(maxRefCount -1);
-		}
+		case ScriptVariant::T_ptr: // depth is checked only when pointer is read, scalar read has no checks.
+			return ScriptVariantGetter<T>::get(ScriptVariant::referencedValue(opv, maxRefCount), 0);
 		case ScriptVariant::T_string: {
 		   ScriptVariant tmp;
 		   tmp.setValue(T(), ScriptVariant::T_AUTO);
@@ -289,7 +337,7 @@ inline std::string ScriptVariantGetter<std::string>::get(const ScriptVariant* op
 		case ScriptVariant::T_string_char:{
 			return opv->getString(false);
 		}
-		case ScriptVariant::T_ptr: return opv->_Data.f_ptr.get()->getValueCounted<std::string>(maxRefCount-1);
+		case ScriptVariant::T_ptr: return ScriptVariantGetter<std::string>::get(ScriptVariant::referencedValue(opv, maxRefCount), 0);
 		case ScriptVariant::T_string:
 		   return *(opv->f_str);
 	}
@@ -310,11 +358,11 @@ inline void ScriptVariantSetter<T>::set(ScriptVariant* opv, const T& value){
 		case ScriptVariant::T_uint32_t: opv->_Data.f_uint32_t    = uint32_t(value); break;
 		case ScriptVariant::T_int64_t: opv->_Data.f_int64_t      = int64_t(value); break;
 		case ScriptVariant::T_uint64_t: opv->_Data.f_uint64_t    = uint64_t(value); break;
-		case ScriptVariant::T_ptr: opv->_Data.f_ptr.get()->setValue(value); break;
+		case ScriptVariant::T_ptr: ScriptVariant::referencedValue(opv, ScriptVariant::MAX_REFERENCE_DEPTH)->setValue(value); break;
 		case ScriptVariant::T_string: {
 			ScriptVariant tmp;
 			tmp.setValue(value, ScriptVariant::T_AUTO);
-			opv->f_str.reset( new std::string(tmp.getValue<std::string>()));
+			opv->assignString(tmp.getValue<std::string>());
 		 }break;
 		case ScriptVariant::T_string_char:
 			if (opv->_Data.f_str_char)  *opv->_Data.f_str_char=value;
@@ -343,7 +391,7 @@ inline void ScriptVariantSetter<std::string>::set(ScriptVariant* opv, const std:
 
 		case ScriptVariant::T_ptr: opv->_Data.f_ptr.get()->setValue(value); break;
 		case ScriptVariant::T_string: {
-			opv->f_str.reset( new std::string(value));
+			opv->assignString(value);
 		 }break;
 	}
 }
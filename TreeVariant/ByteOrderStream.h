@@ -169,6 +169,33 @@ public:
 		m_buf->CheckRemain(0);
 		return !EofRead();
 	}
+	/// Read LEB128 varint: 7 bits per byte, low bits first. Returns false on truncated or longer than 64 bits value.
+	bool ReadVarUInt(uint64_t & value)
+	{
+		const uint8_t * start = m_buf->PosRead();
+		const ptrdiff_t remain = m_buf->GetRemainRead();
+		value = 0;
+		for (ptrdiff_t i = 0; i < remain && i < 10; i++)
+		{
+			value |= uint64_t(start[i] & 0x7f) << (7 * i);
+			if (!(start[i] & 0x80))
+			{
+				m_buf->MarkRead(i + 1);
+				return true;
+			}
+		}
+		m_buf->PosRead(remain + 1); // sets eof.
+		return false;
+	}
+	/// Signed varint, zigzag-coded so small negative numbers are short too.
+	bool ReadVarInt(int64_t & value)
+	{
+		uint64_t u = 0;
+		if (!ReadVarUInt(u))
+			return false;
+		value = int64_t(u >> 1) ^ -int64_t(u & 1);
+		return true;
+	}
 private:
 	template<size_t bytes>
 	inline void read(uint8_t* ,const uint8_t*,uint_fast8_t ) const{ static_assert(bytes <= 8, "Unknown size");}
@@ -239,6 +266,25 @@ public:
 		m_buf->CheckRemain(0);
 		return true;
 	}
+	/// Write LEB128 varint: 1 byte for values below 128, up to 10 bytes. Does not depend on stream byte order.
+	bool WriteVarUInt(uint64_t value)
+	{
+		uint8_t bytes[10];
+		ptrdiff_t size = 0;
+		do
+		{
+			bytes[size] = value & 0x7f;
+			value >>= 7;
+			if (value)
+				bytes[size] |= 0x80;
+			size++;
+		} while (value);
+		return WriteBlock(bytes, size);
+	}
+	bool WriteVarInt(int64_t value)
+	{
+		return WriteVarUInt((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+	}
 private:
 	template<size_t bytes>
 	inline void write(const uint8_t* ,uint8_t* ,uint_fast8_t ) const{static_assert(bytes <= 8, "Unknown size"); }
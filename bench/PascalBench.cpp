@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+
+#include <CompilerFrontend.h>
+#include <OpcodeStatistics.h>
+#include <ScriptVM.h>
+#include <StadardLibrary.h>
+#include <TreeVariant.h>
+#include <ast.h>
+
+#include "SourceGenerator.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+const QStringList corpus = QStringList()
+		<< "nbody"
+		<< "fannkuch"
+		<< "spectralnorm"
+		<< "mandelbrot"
+		<< "binarytrees"
+		<< "strings"
+		<< "records"
+		   ;
+
+TreeVariant number(qint64 value)
+{
+	return TreeVariant(QVariant(value));
+}
+
+/// min/median/mean of iteration timings, nanoseconds.
+TreeVariant summary(QList<qint64> values)
+{
+	TreeVariant ret;
+	if (values.isEmpty())
+		return ret;
+	std::sort(values.begin(), values.end());
+	qint64 total = 0;
+	foreach (qint64 value, values)
+		total += value;
+	ret["min"] = number(values.first());
+	ret["median"] = number(values[values.size() / 2]);
+	ret["mean"] = number(total / values.size());
+	return ret;
+}
+
+TreeVariant memoryStats(const ScriptVM::MemoryStats& stats)
+{
+	TreeVariant ret;
+	ret["stack_high_water"] = number(stats.stackHighWater);
+	ret["max_call_depth"] = number(stats.maxCallDepth);
+	ret["stack_bytes"] = number(stats.stackBytes);
+	ret["static_bytes"] = number(stats.staticBytes);
+	ret["string_bytes"] = number(stats.stringBytes);
+	ret["payload_bytes"] = number(stats.payloadBytes);
+	ret["heap_bytes"] = number(stats.heapBytes);
+	ret["code_count"] = number(stats.codeCount);
+	ret["code_bytes"] = number(stats.codeBytes);
+	ret["debug_info_bytes"] = number(stats.debugInfoBytes);
+	ret["total_bytes"] = number(stats.totalBytes());
+	return ret;
+}
+
+TreeVariant runBenchmark(const QString& name, const QString& source, int iterations, int compileThreshold, int optimizeThreshold, bool useJit, OpcodeStatistics* opcodeStatistics)
+{
+	TreeVariant ret;
+	ret["name"] = name;
+
+	CompilerFrontend compiler;
+	compiler.setSemantic(CompilerFrontend::smPascal);
+	compiler.addFuncs(SciptRuntimeLibrary::allStandardProtoTypes());
+
+	QList<qint64> compileTimes, runTimes;
+	qint64 instructions = 0;
+	ScriptVM::MemoryStats peak;
+	ScriptVariant::StringStats strings;
+	bool ok = true;
+	for (int i = 0; i < iterations && ok; i++)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		ok = compiler.parseText(source, false);
+		compileTimes << timer.nsecsElapsed();
+		if (!ok)
+		{
+			foreach (const AST::CodeMessage& msg, compiler.messages()._messages)
+				std::cerr << msg.toString().toUtf8().constData() << std::endl;
+			break;
+		}
+
+		compiler.vm()->_opcodeStatistics = opcodeStatistics;
+		compiler.vm()->_compileThreshold = compileThreshold;
+		compiler.vm()->_optimizeThreshold = optimizeThreshold;
+		compiler.vm()->_useJit = useJit;
+		ScriptVariant::resetStringStats();
+		timer.restart();
+		ok = compiler.run(true); // parseText() recreates function table, so library is bound again.
+		runTimes << timer.nsecsElapsed();
+		strings = ScriptVariant::stringStats(); // last run shows steady state, when pool is warm.
+		if (!ok)
+		{
+			std::cerr << compiler.getOutput(CompilerFrontend::ocError).constData() << std::endl;
+			break;
+		}
+		instructions = compiler.vm()->getOpCnt();
+		const ScriptVM::MemoryStats stats = compiler.vm()->getMemoryStats();
+		if (stats.totalBytes() > peak.totalBytes())
+			peak = stats;
+	}
+
+	ret["ok"] = TreeVariant(ok);
+	ret["compile_ns"] = summary(compileTimes);
+	ret["run_ns"] = summary(runTimes);
+	ret["instructions"] = number(instructions);
+	ret["memory"] = memoryStats(peak);
+	ret["string_allocations"] = number(strings.allocated);
+	ret["string_reuses"] = number(strings.reused);
+	return ret;
+}
+
+/// Compiler phases on generated source. Scanner is driven by parser, so scan_ns is measured by separate tokenizer pass.
+TreeVariant runCompilerBenchmark(const QString& source, int iterations)
+{
+	TreeVariant ret;
+	ret["name"] = "generated";
+	ret["source_bytes"] = number(source.size());
+
+	CompilerFrontend compiler;
+	compiler.setSemantic(CompilerFrontend::smPascal);
+	compiler.addFuncs(SciptRuntimeLibrary::allStandardProtoTypes());
+
+	QList<qint64> totalTimes, scanTimes, preprocessTimes, parseTimes, codegenTimes, linkTimes;
+	bool ok = true;
+	for (int i = 0; i < iterations && ok; i++)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		QList<AST::TToken> tokens;
+		compiler.makeTokenList(source, tokens);
+		scanTimes << timer.nsecsElapsed();
+		ret["tokens"] = number(tokens.size());
+
+		timer.restart();
+		ok = compiler.parseText(source, false);
+		totalTimes << timer.nsecsElapsed();
+		if (!ok)
+		{
+			foreach (const AST::CodeMessage& msg, compiler.messages()._messages)
+				std::cerr << msg.toString().toUtf8().constData() << std::endl;
+			break;
+		}
+		const CompilerFrontend::CompileStats& stats = compiler.compileStats();
+		preprocessTimes << stats.preprocessNs;
+		parseTimes << stats.parseNs;
+		codegenTimes << stats.codegenNs;
+		linkTimes << stats.linkNs;
+		ret["source_lines"] = number(stats.sourceLines);
+		ret["code_count"] = number(compiler.vm()->_code.size());
+	}
+
+	ret["ok"] = TreeVariant(ok);
+	ret["total_ns"] = summary(totalTimes);
+	ret["scan_ns"] = summary(scanTimes);
+	ret["preprocess_ns"] = summary(preprocessTimes);
+	ret["parse_ns"] = summary(parseTimes);
+	ret["codegen_ns"] = summary(codegenTimes);
+	ret["link_ns"] = summary(linkTimes);
+	return ret;
+}
+
+}
+
+// usage: PascalBench [--iterations <n>] [--filter <name>] [--output <file.json>] [--opcode-stats] [--compile-threshold <n>] [--optimize-threshold <n>] [--no-jit]
+//        PascalBench --compiler [--procedures <n>] [--depth <n>] [--fields <n>] [--initializer <n>] [--else-if <n>] [--dump <file.pas>] [--iterations <n>] [--output <file.json>]
+int main(int argc, char *argv[])
+{
+	QCoreApplication application( argc, argv );
+	const QStringList args = application.arguments();
+
+	int iterations = 5;
+	int compileThreshold = ScriptVM()._compileThreshold;
+	int optimizeThreshold = ScriptVM()._optimizeThreshold;
+	bool compilerMode = args.contains("--compiler");
+	bool opcodeStatsMode = args.contains("--opcode-stats");
+	bool useJit = !args.contains("--no-jit");
+	SourceGeneratorOptions generatorOptions;
+	QString filter, outputFile, dumpFile;
+	for (int i = 1; i < args.size() - 1; i++)
+	{
+		if (args[i] == "--iterations")
+			iterations = std::max(1, args[++i].toInt());
+		else if (args[i] == "--filter")
+			filter = args[++i];
+		else if (args[i] == "--output")
+			outputFile = args[++i];
+		else if (args[i] == "--procedures")
+			generatorOptions.procedures = args[++i].toInt();
+		else if (args[i] == "--depth")
+			generatorOptions.nestingDepth = args[++i].toInt();
+		else if (args[i] == "--fields")
+			generatorOptions.recordFields = std::max(1, args[++i].toInt());
+		else if (args[i] == "--initializer")
+			generatorOptions.initializerSize = args[++i].toInt();
+		else if (args[i] == "--else-if")
+			generatorOptions.elseIfChain = args[++i].toInt();
+		else if (args[i] == "--dump")
+			dumpFile = args[++i];
+		else if (args[i] == "--compile-threshold")
+			compileThreshold = args[++i].toInt();
+		else if (args[i] == "--optimize-threshold")
+			optimizeThreshold = args[++i].toInt();
+	}
+
+	TreeVariant report;
+	report["iterations"] = TreeVariant(iterations);
+	bool allOk = true;
+	if (compilerMode)
+	{
+		const QString source = generatePascalSource(generatorOptions);
+		if (!dumpFile.isEmpty())
+		{
+			QFile dump(dumpFile);
+			if (dump.open(QIODevice::WriteOnly))
+				dump.write(source.toUtf8());
+		}
+		TreeVariant result = runCompilerBenchmark(source, iterations);
+		allOk = result["ok"].toBool();
+		report["benchmarks"].append(result);
+	}
+	else
+	{
+		foreach (const QString& name, corpus)
+		{
+			if (!filter.isEmpty() && !name.contains(filter))
+				continue;
+
+			QFile file(":/bench/pascal/" + name + ".pas");
+			if (!file.open(QIODevice::ReadOnly))
+			{
+				std::cerr << "missing benchmark " << name.toStdString() << std::endl;
+				return 1;
+			}
+			const QString source = QString::fromUtf8(file.readAll());
+
+			std::cerr << name.toStdString() << "..." << std::endl;
+			OpcodeStatistics opcodeStatistics;
+			TreeVariant result = runBenchmark(name, source, iterations, compileThreshold, optimizeThreshold, useJit, opcodeStatsMode ? &opcodeStatistics : nullptr);
+			allOk = allOk && result["ok"].toBool();
+			report["benchmarks"].append(result);
+			if (opcodeStatsMode) // instrumented timings are not representative, counters are.
+				std::cerr << opcodeStatistics.report().c_str() << std::endl;
+		}
+	}
+
+	QByteArray json;
+	report.saveToByteArray(json, "json");
+	if (outputFile.isEmpty())
+	{
+		std::cout << json.constData();
+	}
+	else
+	{
+		QFile output(outputFile);
+		if (!output.open(QIODevice::WriteOnly))
+			return 1;
+		output.write(json);
+	}
+
+	return allOk ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#include "SourceGenerator.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+namespace {
+
+QString indent(int level)
+{
+	return QString("  ").repeated(level);
+}
+
+QString fieldType(int field)
+{
+	return field % 2 ? "double" : "integer";
+}
+
+/// Nested block of statements; block kind alternates between if, for and with.
+void generateBlock(QString& out, int level, int depth, const SourceGeneratorOptions& options)
+{
+	const QString ind = indent(level);
+	const int field = (level * 7) % options.recordFields;
+	out += ind + "t := t + " + QString::number(level) + ";\n";
+	out += ind + "r.f" + QString::number(field) + " := r.f" + QString::number(field) + " + t;\n";
+	if (depth <= 0)
+	{
+		out += ind + "acc := acc + t mod 13;\n";
+		return;
+	}
+
+	switch (depth % 3)
+	{
+		case 0:
+			out += ind + "if t mod 2 = 0 then\n";
+			out += ind + "begin\n";
+			generateBlock(out, level + 1, depth - 1, options);
+			out += ind + "end\n";
+			out += ind + "else\n";
+			out += ind + "begin\n";
+			out += ind + "  t := t - 1;\n";
+			out += ind + "end;\n";
+			break;
+		case 1:
+			out += ind + "for i" + QString::number(depth) + " := 0 to 1 do\n";
+			out += ind + "begin\n";
+			generateBlock(out, level + 1, depth - 1, options);
+			out += ind + "end;\n";
+			break;
+		case 2:
+			out += ind + "with r do\n";
+			out += ind + "begin\n";
+			out += ind + "  f" + QString::number((field + 1) % options.recordFields) + " := t;\n";
+			generateBlock(out, level + 1, depth - 1, options);
+			out += ind + "end;\n";
+			break;
+	}
+}
+
+}
+
+QString generatePascalSource(const SourceGeneratorOptions& options)
+{
+	const int recordTypes = std::max(1, options.recordTypes);
+	QString out;
+	out.reserve(options.procedures * (options.nestingDepth + 4) * 160 + options.initializerSize * 8);
+
+	out += "program generated;\n\n";
+
+	out += "type\n";
+	for (int t = 0; t < recordTypes; t++)
+	{
+		out += "  TRec" + QString::number(t) + " = record\n";
+		for (int f = 0; f < options.recordFields; f++)
+			out += "    f" + QString::number(f) + " : " + fieldType(f) + ";\n";
+		out += "  end;\n";
+	}
+	out += "\n";
+
+	out += "var acc : integer;\n";
+	for (int t = 0; t < recordTypes; t++)
+		out += "    rec" + QString::number(t) + " : TRec" + QString::number(t) + ";\n";
+	if (options.initializerSize > 0)
+	{
+		out += "    table : array[0.." + QString::number(options.initializerSize - 1) + "] of integer = (";
+		for (int i = 0; i < options.initializerSize; i++)
+		{
+			if (i % 16 == 0) out += "\n      ";
+			out += QString::number((i * 7919) % 10007);
+			if (i < options.initializerSize - 1) out += ", ";
+		}
+		out += "\n    );\n";
+	}
+	out += "\n";
+
+	QStringList loopVars;
+	for (int d = 1; d <= options.nestingDepth; d++)
+		if (d % 3 == 1)
+			loopVars << "i" + QString::number(d);
+
+	for (int p = 0; p < options.procedures; p++)
+	{
+		const QString recType = "TRec" + QString::number(p % recordTypes);
+		out += "procedure p" + QString::number(p) + "(a : integer; var r : " + recType + ");\n";
+		out += "var t : integer;\n";
+		if (!loopVars.isEmpty())
+			out += "    " + loopVars.join(", ") + " : integer;\n";
+		out += "begin\n";
+		out += "  t := a;\n";
+		generateBlock(out, 1, options.nestingDepth, options);
+		if (p > 0)
+		{
+			const int callee = p - 1;
+			out += "  if a > 0 then p" + QString::number(callee) + "(a - 1, rec" + QString::number(callee % recordTypes) + ");\n";
+		}
+		out += "end;\n\n";
+	}
+
+	out += "begin\n";
+	out += "  acc := 0;\n";
+	if (options.procedures > 0)
+	{
+		const int last = options.procedures - 1;
+		out += "  p" + QString::number(last) + "(3, rec" + QString::number(last % recordTypes) + ");\n";
+	}
+	if (options.initializerSize > 0)
+		out += "  acc := acc + table[" + QString::number(options.initializerSize - 1) + "];\n";
+	for (int b = 0; b < options.elseIfChain; b++)
+	{
+		out += b ? "  else if" : "  if";
+		out += " acc mod " + QString::number(options.elseIfChain) + " = " + QString::number(b) + " then acc := acc + " + QString::number(b + 1) + "\n";
+	}
+	if (options.elseIfChain > 0)
+		out += "  else acc := 0;\n";
+	out += "  writeln(acc);\n";
+	out += "end.\n";
+	return out;
+}
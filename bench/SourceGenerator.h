@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2017 Smirnov Vladimir mapron1@gmail.com
+ * Source code licensed under the Apache License, Version 2.0 (the "License");
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0 or in file COPYING-APACHE-2.0.txt
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.h
+ */
+#pragma once
+
+#include <QString>
+
+/// Generator of large valid Pascal programs for compiler throughput measurements.
+struct SourceGeneratorOptions
+{
+	int procedures = 2000;       //!< procedures count; each one calls previous one.
+	int nestingDepth = 8;        //!< nested if/for/with blocks inside each procedure.
+	int recordTypes = 16;        //!< record types, procedures use them round-robin.
+	int recordFields = 64;       //!< fields in each record.
+	int initializerSize = 8192;  //!< elements in constant array initializer.
+	int elseIfChain = 0;         //!< branches of "if ... else if" chain in main block; compile time must grow linearly.
+};
+
+QString generatePascalSource(const SourceGeneratorOptions& options);
@@ -0,0 +1,78 @@
+program binarytrees;
+
+{ Nodes live in preallocated arrays; a tree is released by resetting nodeCount. }
+
+const minDepth = 4;
+      maxDepth = 8;
+
+var leftNode, rightNode : array[0..2047] of integer;
+    nodeCount : integer;
+
+// function name is its result inside body, so recursion goes through forward declared helpers.
+function subTree(depth : integer) : integer; forward;
+function checkSubTree(node : integer) : integer; forward;
+
+function bottomUp(depth : integer) : integer;
+var node : integer;
+begin
+  node := nodeCount;
+  nodeCount := nodeCount + 1;
+  if depth > 0 then
+  begin
+    leftNode[node] := subTree(depth - 1);
+    rightNode[node] := subTree(depth - 1);
+  end
+  else
+  begin
+    leftNode[node] := -1;
+    rightNode[node] := -1;
+  end;
+  result := node;
+end;
+
+function check(node : integer) : integer;
+begin
+  if leftNode[node] < 0 then result := 1
+  else result := 1 + checkSubTree(leftNode[node]) + checkSubTree(rightNode[node]);
+end;
+
+function subTree(depth : integer) : integer;
+begin
+  result := bottomUp(depth);
+end;
+
+function checkSubTree(node : integer) : integer;
+begin
+  result := check(node);
+end;
+
+// declared after functions: locals may not shadow globals.
+var longLived, base, depth, iterations, i, chk : integer;
+
+begin
+  // constants are int64, function arguments are integer: pass depth through a variable.
+  depth := maxDepth + 1;
+  nodeCount := 0;
+  writeln('stretch tree check ' + check(bottomUp(depth)));
+
+  depth := maxDepth;
+  nodeCount := 0;
+  longLived := bottomUp(depth);
+  base := nodeCount;
+
+  depth := minDepth;
+  while depth <= maxDepth do
+  begin
+    iterations := 1;
+    for i := 1 to maxDepth - depth + minDepth do iterations := iterations * 2;
+    chk := 0;
+    for i := 1 to iterations do
+    begin
+      nodeCount := base;
+      chk := chk + check(bottomUp(depth));
+    end;
+    writeln('trees ' + iterations + ' depth ' + depth + ' check ' + chk);
+    depth := depth + 2;
+  end;
+  writeln('long lived tree check ' + check(longLived));
+end.
@@ -0,0 +1,70 @@
+program fannkuch;
+
+const n = 7;
+
+var perm, perm1, count : array[0..15] of integer;
+    maxFlips, checksum, permCount : integer;
+    r, i, j, k, t, flips, perm0 : integer;
+    done, more : boolean;
+begin
+  for i := 0 to n - 1 do perm1[i] := i;
+  maxFlips := 0;
+  checksum := 0;
+  permCount := 0;
+  r := n;
+  done := false;
+  while not done do
+  begin
+    while r <> 1 do
+    begin
+      count[r - 1] := r;
+      r := r - 1;
+    end;
+
+    for i := 0 to n - 1 do perm[i] := perm1[i];
+    flips := 0;
+    k := perm[0];
+    while k <> 0 do
+    begin
+      i := 0;
+      j := k;
+      while i < j do
+      begin
+        t := perm[i];
+        perm[i] := perm[j];
+        perm[j] := t;
+        i := i + 1;
+        j := j - 1;
+      end;
+      flips := flips + 1;
+      k := perm[0];
+    end;
+
+    if flips > maxFlips then maxFlips := flips;
+    if permCount mod 2 = 0 then checksum := checksum + flips
+    else checksum := checksum - flips;
+
+    { next permutation; break is only supported in for loops. }
+    more := true;
+    while more do
+    begin
+      if r = n then
+      begin
+        done := true;
+        more := false;
+      end
+      else
+      begin
+        perm0 := perm1[0];
+        for i := 0 to r - 1 do perm1[i] := perm1[i + 1];
+        perm1[r] := perm0;
+        count[r] := count[r] - 1;
+        if count[r] > 0 then more := false
+        else r := r + 1;
+      end;
+    end;
+    permCount := permCount + 1;
+  end;
+  writeln(checksum);
+  writeln(maxFlips);
+end.
@@ -0,0 +1,32 @@
+program mandelbrot;
+
+const size = 48;
+      maxIter = 50;
+
+var x, y, iter, inside : integer;
+    cr, ci, zr, zi, tr, ti : double;
+    escaped : boolean;
+begin
+  inside := 0;
+  for y := 0 to size - 1 do
+    for x := 0 to size - 1 do
+    begin
+      cr := 2.0 * x / size - 1.5;
+      ci := 2.0 * y / size - 1.0;
+      zr := 0.0;
+      zi := 0.0;
+      iter := 0;
+      escaped := false;
+      while (iter < maxIter) and not escaped do
+      begin
+        tr := zr * zr - zi * zi + cr;
+        ti := 2.0 * zr * zi + ci;
+        zr := tr;
+        zi := ti;
+        if zr * zr + zi * zi > 4.0 then escaped := true
+        else iter := iter + 1;
+      end;
+      if not escaped then inside := inside + 1;
+    end;
+  writeln(inside);
+end.
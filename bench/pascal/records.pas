@@ -0,0 +1,35 @@
+program records;
+
+type Point = record
+    x, y, z : double;
+    tag : integer;
+  end;
+  Points = array[0..63] of Point;
+
+var a, b : Points;
+    p, q : Point;
+    i, j : integer;
+    sum : double;
+begin
+  for i := 0 to 63 do
+  begin
+    a[i].x := i;
+    a[i].y := i * 2;
+    a[i].z := i * 3;
+    a[i].tag := i;
+  end;
+  sum := 0.0;
+  for j := 1 to 50 do
+  begin
+    b := a;
+    for i := 0 to 63 do
+    begin
+      p := b[i];
+      q := p;
+      q.x := q.x + j;
+      b[63 - i] := q;
+      sum := sum + q.x + q.y;
+    end;
+  end;
+  writeln(sum);
+end.
@@ -0,0 +1,66 @@
+program spectralnorm;
+
+const n = 60;
+
+{ u, v and tmp at offsets 0, n and 2 * n; procedures take offsets instead of var array parameters. }
+var w : array[0..179] of double;
+
+function A(i, j : integer) : double;
+var ij : double;
+begin
+  ij := i + j;
+  result := 1.0 / (ij * (ij + 1.0) / 2.0 + i + 1.0);
+end;
+
+procedure mulAv(x, y : integer);
+var i, j : integer;
+    sum : double;
+begin
+  for i := 0 to n - 1 do
+  begin
+    sum := 0.0;
+    for j := 0 to n - 1 do sum := sum + A(i, j) * w[x + j];
+    w[y + i] := sum;
+  end;
+end;
+
+procedure mulAtv(x, y : integer);
+var i, j : integer;
+    sum : double;
+begin
+  for i := 0 to n - 1 do
+  begin
+    sum := 0.0;
+    for j := 0 to n - 1 do sum := sum + A(j, i) * w[x + j];
+    w[y + i] := sum;
+  end;
+end;
+
+procedure mulAtAv(x, y : integer);
+begin
+  mulAv(x, 2 * n);
+  mulAtv(2 * n, y);
+end;
+
+// declared after functions: locals may not shadow globals.
+var i, u, v : integer;
+    vBv, vv : double;
+
+begin
+  u := 0;
+  v := n;
+  for i := 0 to n - 1 do w[u + i] := 1.0;
+  for i := 1 to 10 do
+  begin
+    mulAtAv(u, v);
+    mulAtAv(v, u);
+  end;
+  vBv := 0.0;
+  vv := 0.0;
+  for i := 0 to n - 1 do
+  begin
+    vBv := vBv + w[u + i] * w[v + i];
+    vv := vv + w[v + i] * w[v + i];
+  end;
+  writeln(sqrt(vBv / vv));
+end.
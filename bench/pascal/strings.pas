@@ -0,0 +1,19 @@
+program strings;
+
+var s, part : string;
+    i, total : integer;
+begin
+  total := 0;
+  s := '';
+  for i := 1 to 2000 do
+  begin
+    part := 'item' + i;
+    s := s + part + ';';
+    if i mod 200 = 0 then
+    begin
+      total := total + len(s);
+      s := '';
+    end;
+  end;
+  writeln(total);
+end.
@@ -4,10 +4,16 @@
 #include <BytecodeVM.h>
 #include <StadardLibrary.h>
 #include <ScriptVM.h>
+#include <ExpressionProgram.h>
 
 #include <CompilerFrontend.h>
 #include <ast.h>
+#include <OpcodeSequence.h>
+#include <StringVisitor.h>
 #include <QDebug>
+#include <QDir>
+#include <QProcess>
+#include <QTemporaryDir>
 #include <TreeVariant.h>
 #include <functional>
 
@@ -55,11 +61,56 @@ ScriptTest::~ScriptTest()
 
 }
 
+void ScriptTest::initTestCase()
+{
+	// budgets file format: "<program> <instructions> <peak stack>" per line.
+	// To update budgets after codegen optimization, run with SCRIPTTEST_UPDATE_BUDGETS=<path to tests/pascal/budgets.txt>.
+	_budgetsUpdateFile = qgetenv("SCRIPTTEST_UPDATE_BUDGETS");
+	QFile budgets(":/ru/pascal/budgets.txt");
+	budgets.open(QIODevice::ReadOnly);
+	foreach (QString line, QString::fromUtf8(budgets.readAll()).split('\n'))
+	{
+		line = line.trimmed();
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+		QStringList parts = line.split(' ', QString::SkipEmptyParts);
+		if (parts.size() < 3)
+			continue;
+		Budget b;
+		b.instructions = parts[1].toInt();
+		b.stackSize = parts[2].toInt();
+		_budgets[parts[0]] = b;
+	}
+}
+
+void ScriptTest::cleanupTestCase()
+{
+	if (_budgetsUpdateFile.isEmpty())
+		return;
+
+	QMap<QString, Budget> budgets = _budgets;
+	foreach (const QString& name, _measuredBudgets.keys())
+		budgets[name] = _measuredBudgets[name];
+
+	QFile file(_budgetsUpdateFile);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		qWarning() << "Failed to write budgets to" << _budgetsUpdateFile;
+		return;
+	}
+	// CRLF, as other test data, so regenerated file differs only in numbers.
+	QString out = "# program instructions peak_stack\r\n";
+	foreach (const QString& name, budgets.keys())
+		out += QString("%1 %2 %3\r\n").arg(name).arg(budgets[name].instructions).arg(budgets[name].stackSize);
+	file.write(out.toUtf8());
+}
+
 void ScriptTest::init()
 {
 	_parser->clearBindings();
 	_parser->addFuncs( SciptRuntimeLibrary::allStandardProtoTypes());
 	_firstRun = true;
+	_currentProgram.clear();
 }
 #define SKIP_CHECK(name) \
 	   if (_DO_SKIP(name)) return;
@@ -79,13 +130,15 @@ void ScriptTest::init()
 	QVERIFY2(_ST_PARSE_INVALID(name), name)
 
 #define VM_RUN \
-	QVERIFY(_VM_RUN())
+	QVERIFY(_VM_RUN());\
+	QVERIFY2(_CHECK_BUDGET(), qPrintable(_budgetMessage))
 
 #define QCOMPARE_OUT(output) QCOMPARE(QString::fromUtf8(_parser->getOutput()), QString(output));
 
 bool ScriptTest::_PASCAL_PARSE(QString name)
 {
 	if (_skip.contains(name)) return false;
+	_currentProgram = name;
 	_parser->setSemantic( CompilerFrontend::smPascal );
 	return _parser->parseText(testFile(name, "pascal"), false);
 }
@@ -99,6 +152,31 @@ bool ScriptTest::_VM_RUN()
 	return resultRun;
 }
 
+bool ScriptTest::_CHECK_BUDGET()
+{
+	_budgetMessage.clear();
+	if (_currentProgram.isEmpty())
+		return true;
+
+	Budget measured;
+	measured.instructions = _parser->vm()->getOpCnt();
+	measured.stackSize = _parser->vm()->getMaxStackSize();
+	_measuredBudgets[_currentProgram] = measured;
+	if (!_budgets.contains(_currentProgram) || !_budgetsUpdateFile.isEmpty())
+		return true;
+
+	const Budget& budget = _budgets[_currentProgram];
+	if (measured.instructions > budget.instructions || measured.stackSize > budget.stackSize)
+	{
+		_budgetMessage = QString("%1: instructions %2 (budget %3), peak stack %4 (budget %5)")
+				.arg(_currentProgram)
+				.arg(measured.instructions).arg(budget.instructions)
+				.arg(measured.stackSize).arg(budget.stackSize);
+		return false;
+	}
+	return true;
+}
+
 bool ScriptTest::_DO_SKIP(const QString &name)
 {
 	if (_run.contains(name)) return false;
@@ -273,6 +351,17 @@ void ScriptTest::testString()
 	});
 	VM_RUN;
 	QCOMPARE_OUT("five:5 \n");
+
+	ScriptVariant::releaseStringPool();
+	ScriptVariant::resetStringStats();
+	ScriptVariant a(std::string("abc"));
+	ScriptVariant b = a;
+	a.setValue(std::string("defgh"));
+	QCOMPARE(b.getString(), std::string("abc")); // shared buffer is not overwritten.
+	a.setValue(std::string("xy"));
+	QCOMPARE(a.getString(), std::string("xy"));
+	QCOMPARE(ScriptVariant::stringStats().allocated, size_t(2));
+	QCOMPARE(ScriptVariant::stringStats().reused, size_t(1));
 }
 
 void ScriptTest::testConvert()
@@ -311,6 +400,28 @@ void ScriptTest::nbody()
 	VM_RUN;
 	QCOMPARE_OUT("-0.169075163828524 \n"
 				 "-0.169087605234606 \n");
+	// literal parts of bodies table are copied from constant pool.
+	QVERIFY(_parser->vm()->constants());
+	QVERIFY(_parser->vm()->constants()->size() >= 18);
+
+	std::vector<uint8_t> image, image2;
+	QVERIFY(_parser->vm()->saveImage(image));
+	ScriptVM loaded;
+	QVERIFY(loaded.loadImage(image.data(), image.size()));
+	QCOMPARE(loaded._code.size(), _parser->vm()->_code.size());
+	QVERIFY(loaded.saveImage(image2));
+	QVERIFY(image == image2);
+	QVERIFY(!loaded.loadImage(image.data(), image.size() / 2));
+
+	ByteOrderBuffer compact;
+	ByteOrderDataStreamWriter writer(&compact);
+	QVERIFY(_parser->vm()->writeCompact(writer));
+	QVERIFY(compact.GetSize() < _parser->vm()->exportToHex().size() / 2);
+	compact.ResetRead();
+	ByteOrderDataStreamReader reader(&compact);
+	ScriptVM decoded;
+	QVERIFY(decoded.readCompact(reader));
+	QCOMPARE(decoded.exportToHex(), loaded.exportToHex());
 }
 
 void ScriptTest::cycles()
@@ -325,6 +436,175 @@ void ScriptTest::forwardDeclaration()
 	PASCAL_PARSE("forwardDeclaration");
 	VM_RUN;
 	QCOMPARE_OUT("a=2 \n");
+
+	// locations and labels are in side table, it survives export.
+	ScriptVM* vm = _parser->vm();
+	QCOMPARE(vm->_debugInfo.symbol(vm->_startPC), std::string("__start"));
+	QVERIFY(vm->_debugInfo.lines.size() > 1);
+	QVERIFY(vm->_debugInfo.lines.size() < vm->_code.size());
+	ScriptVM imported;
+	QVERIFY(imported.importFromHexString(vm->exportToHex()));
+	QCOMPARE(imported._code.size(), vm->_code.size());
+	QCOMPARE(imported._debugInfo.lines.size(), vm->_debugInfo.lines.size());
+	QCOMPARE(imported._debugInfo.symbols, vm->_debugInfo.symbols);
+	for (uint32_t pc = 0; pc < vm->_code.size(); pc++)
+		QVERIFY(imported._debugInfo.location(pc) == vm->_debugInfo.location(pc));
+}
+
+void ScriptTest::declarationPass()
+{
+	PASCAL_PARSE("declarationPass");
+	VM_RUN;
+	QCOMPARE_OUT("r=8 \n");
+
+	// global declared after procedure is unknown in its body.
+	_currentProgram.clear();
+	QVERIFY(!_parser->parseText("program p; procedure SetLate; begin late := 1; end; var late : integer; begin end.", false));
+	QVERIFY(_parser->messages()._messages.value(0)._message.contains("Undeclared symbol: late"));
+	// procedure declared later needs forward declaration, also when body is compiled on first call.
+	const QString callLater = "program p; procedure A; begin B(); end; procedure B; begin end; begin A(); end.";
+	QVERIFY(!_parser->parseText(callLater, false));
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, true);
+	const bool lazyParsed = _parser->parseText(callLater, false);
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, false);
+	QVERIFY(!lazyParsed);
+}
+
+void ScriptTest::lazyBodies()
+{
+	SKIP_CHECK("declarationPass");
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, true);
+	const bool parsed = _PASCAL_PARSE("declarationPass");
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, false);
+	QVERIFY(parsed);
+	QCOMPARE(_parser->compileStats().skippedBodies, 1);
+	VM_RUN;
+	QCOMPARE_OUT("r=8 \n");
+
+	// translation to C prints every body, so types of uncalled ones are needed too: "with" aliases record fields.
+	QString ctext;
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, true);
+	const bool translated = _parser->pascal2c("program p; type TPoint = record x, y : integer; end; var pt : TPoint; "
+			"procedure Unused; begin with pt do y := 2; end; begin end.", ctext);
+	_parser->setParserFlag(CompilerFrontend::poLazyBodies, false);
+	QVERIFY(translated);
+	QVERIFY2(ctext.contains("auto &y"), qPrintable(ctext));
+}
+
+void ScriptTest::parallelParseMessages()
+{
+	// sources are parsed in parallel, messages must not depend on which thread finished first.
+	TreeVariant sources;
+	const QStringList texts = QStringList()
+			<< "program a; var x : integer; begin x := ; end."
+			<< "program b; begin end."
+			<< "program c; var y : integer; begin y := 1 end end."
+			<< "program d;\nvar z : integer;\nbegin z := (1; end."
+			<< "program e; var x : integer; begin x := ; end."; // same position as in first source, reported again.
+	foreach (QString text, texts)
+	{
+		TreeVariant source;
+		source["text"] = text;
+		sources.append(source);
+	}
+	// syntax errors come first, in order of sources, each with index of its source.
+	const QStringList syntaxErrors = QStringList()
+			<< "0:Error: 1:40: invalid SimpleExpr"
+			<< "2:Error: 1:46: dot expected"
+			<< "3:Error: 3:16: invalid SimpleExpr"
+			<< "4:Error: 1:40: invalid SimpleExpr";
+	QStringList expected;
+	for (int run = 0; run < 20; run++)
+	{
+		QVERIFY(!_parser->parseDataObjectsList(sources));
+		QStringList messages;
+		foreach (const AST::CodeMessage& msg, _parser->messages()._messages)
+			messages << QString("%1:%2").arg(msg._loc._file).arg(msg.toString());
+		if (run == 0)
+			expected = messages;
+		QCOMPARE(messages.mid(0, syntaxErrors.size()), syntaxErrors);
+		QCOMPARE(messages, expected);
+	}
+}
+
+void ScriptTest::compileCache()
+{
+	QTemporaryDir cacheDir;
+	QVERIFY(cacheDir.isValid());
+	_parser->setCacheDirectory(cacheDir.path());
+
+	PASCAL_PARSE("forwardDeclaration");
+	QVERIFY(!_parser->compileStats().cacheHit);
+	VM_RUN;
+	QCOMPARE_OUT("a=2 \n");
+
+	// loaded program has no bindings, so standard library is bound again.
+	_firstRun = true;
+	PASCAL_PARSE("forwardDeclaration");
+	QVERIFY(_parser->compileStats().cacheHit);
+	VM_RUN;
+	QCOMPARE_OUT("a=2 \n");
+
+	// bindings are part of key.
+	_parser->addVars(QList<QPair<QString, QString> >() << qMakePair(QString("cacheKeyVar"), QString("integer")));
+	_firstRun = true;
+	PASCAL_PARSE("forwardDeclaration");
+	QVERIFY(!_parser->compileStats().cacheHit);
+
+	// image with valid header and corrupted code is compiled again, external variables stay bound.
+	TestVarTable v;
+	v.addValue("cacheOut", "int32", 0);
+	_parser->clearBindings();
+	_parser->addVars(v.idents);
+	const QString program = "program cacheOut; begin cacheOut := 5; end.";
+	QVERIFY(_parser->parseText(program));
+	const QStringList images = QDir(cacheDir.path()).entryList(QStringList() << "*.img");
+	QCOMPARE(images.size(), 3);
+	foreach (const QString& image, images)
+	{
+		QFile file(QDir(cacheDir.path()).filePath(image));
+		QVERIFY(file.open(QIODevice::ReadOnly));
+		QByteArray data = file.readAll();
+		file.close();
+		const uint32_t codeOffset = *reinterpret_cast<const uint32_t*>(data.constData() + 16); // ImageHeader::codeOffset
+		data[int(codeOffset)] = char(0xff);
+		QVERIFY(file.open(QIODevice::WriteOnly));
+		file.write(data);
+	}
+	QVERIFY(_parser->parseText(program));
+	QVERIFY(!_parser->compileStats().cacheHit);
+	v.bindVars(_parser);
+	QVERIFY(_parser->run(true));
+	QCOMPARE(v.getVar("cacheOut")->getValue<int>(), 5);
+	_parser->setCacheDirectory(QString());
+}
+
+void ScriptTest::stripUnusedFunctions()
+{
+	OpcodeSequence code;
+	auto addFunction = [&code](const char* name, const char* callee) {
+		code.Emit(BytecodeVM::PUSH, 1).symbolLabel = name;
+		if (callee)
+			code.Emit(BytecodeVM::CALL, 0).gotoLabel = callee;
+		code.Emit(BytecodeVM::RET);
+	};
+	addFunction("used", "usedindirectly");
+	addFunction("usedindirectly", nullptr);
+	addFunction("unused", "used");
+	addFunction("recursive", "recursive");
+	const size_t libraryEnd = code.size();
+	addFunction("scriptfunction", nullptr);
+	code.Emit(BytecodeVM::CALL, 0).symbolLabel = "__start";
+	code.back().gotoLabel = "used";
+	code.Emit(BytecodeVM::EXIT);
+
+	QCOMPARE(code.stripUnusedFunctions(libraryEnd), 2);
+	QStringList labels;
+	for (const CompilerOpcode& o : code)
+		if (o.symbolLabel.size())
+			labels << QString::fromStdString(o.symbolLabel);
+	QCOMPARE(labels, QStringList() << "used" << "usedindirectly" << "scriptfunction" << "__start");
+	QCOMPARE(code.size(), size_t(9));
 }
 
 
@@ -357,6 +637,30 @@ void ScriptTest::expr()
 	double result1 = v.getVar("result")->getValue<double>();
   //  qDebug() << "result1="<<result1;
 	QCOMPARE( result1, result);
+
+	ExpressionProgram program;
+	QVERIFY2(_parser->compileExpression(program), program.error().c_str());
+	v.getVar("result")->setValue(0.0, ScriptVariant::T_float64);
+	program.run();
+	QCOMPARE( v.getVar("result")->getValue<double>(), result);
+
+	// more records than one batch of lanes; #2 differs per record, one record is not a number.
+	std::vector<ScriptVariant> column(ExpressionProgram::batchLanes + 3), results(column.size());
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		column[i].setValue(10.0 + i, ScriptVariant::T_float64);
+		results[i].setValue(0.0, ScriptVariant::T_float64);
+	}
+	column[5].setValue(std::string("2.5"), ScriptVariant::T_string);
+	QVERIFY(program.setColumn("result", &results));
+	program.setColumn("_2", &column); // false when expression has no #2.
+	program.runBatch(results.size());
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		*v.getVar("#2") = column[i];
+		QVERIFY(_VM_RUN());
+		QCOMPARE( results[i].getValue<double>(), v.getVar("result")->getValue<double>());
+	}
 }
 
 void ScriptTest::expr_data()
@@ -420,6 +724,50 @@ void ScriptTest::expr_data()
 
 }
 
+void ScriptTest::exprInt64()
+{
+	// integers above 2^53 are not exact in double, batch must not pass them through float64 lanes.
+	const int64_t big = (int64_t(1) << 53) + 1;
+	TestVarTable v;
+	v.addValue("#5", "int64", big);
+	v.addValue("big", "int64", int64_t(0));
+	_parser->addVars(v.idents);
+	_parser->setSemantic( CompilerFrontend::smAssignment );
+
+	QFETCH(QString, expression);
+	QVERIFY(_parser->parseText("big:=" + expression));
+	v.bindVars(_parser);
+
+	ExpressionProgram program;
+	QVERIFY2(_parser->compileExpression(program), program.error().c_str());
+	std::vector<ScriptVariant> column(3), results(column.size());
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		column[i].setValue(big + int64_t(i) * 2, ScriptVariant::T_int64_t);
+		results[i].setValue(int64_t(0), ScriptVariant::T_int64_t);
+	}
+	QVERIFY(program.setColumn("big", &results));
+	program.setColumn("_5", &column);
+	program.runBatch(results.size());
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		*v.getVar("#5") = column[i];
+		QVERIFY(_VM_RUN());
+		QCOMPARE(v.getVar("big")->getValue<int64_t>() % 2, int64_t(1));
+		QCOMPARE(results[i].getValue<int64_t>(), v.getVar("big")->getValue<int64_t>());
+	}
+}
+
+void ScriptTest::exprInt64_data()
+{
+	QTest::addColumn<QString>("expression");
+
+	QTest::newRow("copy") << QString("#5");
+	QTest::newRow("parens") << QString("(#5)");
+	QTest::newRow("const") << QString("9007199254740993");
+	QTest::newRow("plus") << QString("#5+0");
+}
+
 void ScriptTest::pascal_with()
 {
 	PASCAL_PARSE("with");
@@ -458,6 +806,167 @@ void ScriptTest::pascal_breakContinue()
 				 "i=5 \n");
 }
 
+void ScriptTest::pascal_unaryOperations()
+{
+	PASCAL_PARSE("unaryOperations");
+
+	VM_RUN;
+
+	QCOMPARE_OUT("x=5 y=-6 \n"
+				 "x=5 y=0 \n"
+				 "x=5 y=-5 \n"
+				 "b=true c=false \n");
+}
+
+void ScriptTest::pascal_heap()
+{
+	PASCAL_PARSE("heap");
+	_parser->vm()->_resetHeapOnRun = false; // keep counters after run.
+
+	VM_RUN;
+
+	QCOMPARE_OUT("p.x+p.y=7 \n"
+				 "q.x=10 \n"
+				 "sum=5050 \n");
+	const ScriptHeap::Stats& stats = _parser->vm()->heap().stats();
+	QCOMPARE(stats.allocations, size_t(102));
+	QCOMPARE(stats.newBlocks, size_t(2));
+	QCOMPARE(stats.liveBlocks, size_t(0));
+	_parser->vm()->_resetHeapOnRun = true;
+}
+
+void ScriptTest::compiledFunctions()
+{
+	PASCAL_PARSE("nbody");
+	_parser->vm()->_compileThreshold = -1;
+	VM_RUN;
+	const QByteArray interpretedOutput = _parser->getOutput();
+	const int interpretedOpCnt = _parser->vm()->getOpCnt();
+	QCOMPARE(_parser->vm()->getCompiledFunctions(), 0);
+
+	PASCAL_PARSE("nbody");
+	_parser->vm()->_compileThreshold = 0; // every function is translated on first call.
+	_firstRun = true;
+	VM_RUN;
+	QVERIFY(_parser->vm()->getCompiledFunctions() > 0); // compile messages flag does not disable translation.
+	QCOMPARE(_parser->getOutput(), interpretedOutput);
+	QCOMPARE(_parser->vm()->getOpCnt(), interpretedOpCnt);
+
+	// translated functions are kept between runs of same code, and dropped when code is replaced.
+	const int compiledFunctions = _parser->vm()->getCompiledFunctions();
+	VM_RUN;
+	QCOMPARE(_parser->vm()->getCompiledFunctions(), compiledFunctions);
+	QCOMPARE(_parser->getOutput(), interpretedOutput);
+
+	PASCAL_PARSE("nbody");
+	QCOMPARE(_parser->vm()->getCompiledFunctions(), 0);
+	_parser->vm()->_optimizeThreshold = 0; // typed and fused handlers right after translation.
+	_parser->vm()->_optimizeInBackground = false;
+	_firstRun = true;
+	VM_RUN;
+	QVERIFY(_parser->vm()->getCompiledFunctions() > 0);
+	QCOMPARE(_parser->getOutput(), interpretedOutput);
+	QCOMPARE(_parser->vm()->getOpCnt(), interpretedOpCnt);
+
+	_parser->vm()->_compileThreshold = 8;
+	_parser->vm()->_optimizeThreshold = 1000;
+	_parser->vm()->_optimizeInBackground = true;
+}
+
+void ScriptTest::jitFunctions()
+{
+	PASCAL_PARSE("nbody");
+	_parser->vm()->_compileThreshold = 0;
+	_parser->vm()->_optimizeThreshold = 0;
+	_parser->vm()->_optimizeInBackground = false;
+	_parser->vm()->_useJit = false;
+	VM_RUN;
+	const QByteArray handlersOutput = _parser->getOutput();
+	const int handlersOpCnt = _parser->vm()->getOpCnt();
+	QCOMPARE(_parser->vm()->getJitFunctions(), 0);
+
+	// machine code keeps output and executed instruction count of handlers.
+	PASCAL_PARSE("nbody");
+	_parser->vm()->_useJit = true;
+	_firstRun = true;
+	VM_RUN;
+	if (ScriptVM::hasJit())
+		QVERIFY(_parser->vm()->getJitFunctions() > 0);
+	else
+		QCOMPARE(_parser->vm()->getJitFunctions(), 0);
+	QCOMPARE(_parser->getOutput(), handlersOutput);
+	QCOMPARE(_parser->vm()->getOpCnt(), handlersOpCnt);
+
+	_parser->vm()->_compileThreshold = 8;
+	_parser->vm()->_optimizeThreshold = 1000;
+	_parser->vm()->_optimizeInBackground = true;
+}
+
+void ScriptTest::nativeModule()
+{
+	SKIP_CHECK("nativeModule");
+	// bindings which can not be passed to module are reported by name, instead of C++ compiler errors.
+	QString ctext;
+	_parser->addVars(QList<QPair<QString, QString> >() << qMakePair(QString("title"), QString("string")));
+	_parser->addFuncs(QStringList() << "Swap(var a:integer; var b:integer)");
+	QVERIFY(!_parser->pascal2c("program rejected; var i : integer; begin i := 1; Swap(i, i); title := 'x'; end.",
+							   ctext, StringVisitor::fNativeModule));
+	QStringList rejected;
+	foreach (const AST::CodeMessage& msg, _parser->messages()._messages)
+		rejected << msg._message;
+	QCOMPARE(rejected.size(), 2);
+	QVERIFY2(rejected.filter("Swap").size() == 1 && rejected.filter("title").size() == 1, qPrintable(rejected.join("; ")));
+	init();
+
+	QProcess compiler;
+	compiler.start("c++", QStringList() << "--version");
+	if (!compiler.waitForFinished(-1) || compiler.exitStatus() != QProcess::NormalExit || compiler.exitCode() != 0)
+		QSKIP("No c++ compiler, native module is not built.");
+
+	// big is above 2^53, it is not rounded on the way to module and back.
+	const int64_t big = (int64_t(1) << 53) + 1;
+	TestVarTable v;
+	v.addValue("scale", "float64", 2.0);
+	v.addValue("total", "float64", 0.0);
+	v.addValue("big", "int64", big);
+	_parser->addVars(v.idents);
+
+	// bytecode runs are reference for module runs.
+	QStringList outputs;
+	QList<double> totals;
+	QList<int64_t> bigs;
+	PASCAL_PARSE("nativeModule");
+	v.bindVars(_parser);
+	for (int i = 0; i < 2; i++)
+	{
+		VM_RUN;
+		outputs << QString::fromUtf8(_parser->getOutput());
+		totals << v.getVar("total")->getValue<double>();
+		bigs << v.getVar("big")->getValue<int64_t>();
+	}
+	QCOMPARE(outputs.value(0), QString("1 220 \n"));
+	QCOMPARE(totals.value(0), 222.0); // Log is decimal logarithm.
+	QCOMPARE(bigs.value(0), big + 1);
+
+	QTemporaryDir moduleDir;
+	QVERIFY(moduleDir.isValid());
+	const bool built = _parser->buildNativeModule(testFile("nativeModule", "pascal"), moduleDir.path() + "/nativeModule");
+	QVERIFY2(built, qPrintable(_parser->messages()._messages.value(0)._message));
+	v.bindVars(_parser);
+	v.getVar("big")->setValue(big, ScriptVariant::T_int64_t);
+	_firstRun = true;
+	for (int i = 0; i < 2; i++) // second run must not see globals left by first one.
+	{
+		v.getVar("total")->setValue(0.0, ScriptVariant::T_float64);
+		QVERIFY(_parser->run(_firstRun));
+		_firstRun = false;
+		QCOMPARE(QString::fromUtf8(_parser->getOutput()), outputs.value(i));
+		QCOMPARE(v.getVar("total")->getValue<double>(), totals.value(i));
+		QCOMPARE(v.getVar("big")->getValue<int64_t>(), bigs.value(i));
+	}
+	_parser->vm()->unloadNativeModule();
+}
+
 void ScriptTest::ast_test()
 {
 	return;
@@ -2,6 +2,7 @@
 
 #include <QObject>
 #include <QSet>
+#include <QMap>
 
 class CompilerFrontend;
 class ScriptTest : public QObject
@@ -24,23 +25,38 @@ private slots:
 	void nbody();
 	void cycles();
 	void forwardDeclaration();
+	void declarationPass();
+	void lazyBodies();
+	void parallelParseMessages();
+	void compileCache();
+	void stripUnusedFunctions();
 
 	void expr();
 	void expr_data();
+	void exprInt64();
+	void exprInt64_data();
 
 	void pascal_with();
 	void pascal_pointers();
 	void pascal_breakContinue();
+	void pascal_unaryOperations();
+	void pascal_heap();
+	void compiledFunctions();
+	void jitFunctions();
+	void nativeModule();
 
 	void ast_test();
 
 
+	void initTestCase();
+	void cleanupTestCase();
 	void init();
 
 
 private:
 	bool _PASCAL_PARSE(QString name);
 	bool _VM_RUN();
+	bool _CHECK_BUDGET();
 	bool _DO_SKIP(const QString &name);
 	CompilerFrontend* _parser;
 	QSet<QString> _skip;
@@ -51,6 +67,17 @@ private:
 	void parserOutput();
 	QString testFile(QString name, QString folder = "pascal");
 
+	/// Executed instructions and peak stack of program; deterministic, so used as regression budget.
+	struct Budget {
+		int instructions = 0;
+		int stackSize = 0;
+	};
+	QString _currentProgram;
+	QString _budgetMessage;
+	QString _budgetsUpdateFile;
+	QMap<QString, Budget> _budgets;
+	QMap<QString, Budget> _measuredBudgets;
+
 
 };
 
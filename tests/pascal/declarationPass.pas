@@ -0,0 +1,36 @@
+program testProgr;
+
+// Twice calls Half, which is declared forward.
+function Half(a : integer) : integer; forward;
+
+function Twice(a : integer) : integer;
+var r : integer;
+
+	procedure Double(var x : integer);
+	begin
+		x := x * 2;
+	end;
+
+begin
+	r := Half(a);
+	Double(r);
+	Twice := r;
+end;
+
+function Half(a : integer) : integer;
+begin
+	Half := a + 1;
+end;
+
+procedure Unused(a : integer);
+begin
+	writeln('unused=' + Twice(a));
+end;
+
+// Declared after the procedures, so their bodies do not see it.
+var r : integer;
+
+begin;
+	r := Twice(3);
+	writeln('r=' + r);
+end.
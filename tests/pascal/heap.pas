@@ -0,0 +1,32 @@
+program A;
+
+type REC = record
+  x,y:integer;
+  end;
+
+var
+  p, q: ^REC;
+  i, sum: integer;
+
+begin
+New(p);
+p^.x := 3;
+p^.y := 4;
+New(q);
+q^.x := 10;
+sum := p^.x + p^.y;
+writeln('p.x+p.y=' + sum); // 7
+writeln('q.x=' + q^.x); // 10
+Dispose(p);
+
+sum := 0;
+for i := 1 to 100 do
+begin
+  New(p); // takes block disposed above
+  p^.x := i;
+  sum := sum + p^.x;
+  Dispose(p);
+end;
+writeln('sum=' + sum); // 5050
+Dispose(q);
+end.
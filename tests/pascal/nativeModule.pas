@@ -0,0 +1,22 @@
+program nativeModule;
+
+// scale, total and big are bound by host; calls shows that every run starts with zero globals.
+const count = 5;
+
+var i, calls : integer;
+    sum : double;
+
+function Square(x : double) : double;
+begin
+	Square := x * x;
+end;
+
+begin
+	calls := calls + 1;
+	sum := 0;
+	for i := 1 to count do
+		sum := sum + Square(i * scale);
+	total := sum + Log(100);
+	big := big + 1;
+	writeln(calls, sum);
+end.
@@ -0,0 +1,22 @@
+program a;
+
+var x, y : integer;
+    b, c : boolean;
+begin
+
+// unary operations make new value, operand variable stays unchanged.
+x := 5;
+y := ~x;
+writeln('x=' + x + ' y=' + y);
+
+y := not x;
+writeln('x=' + x + ' y=' + y);
+
+y := -x;
+writeln('x=' + x + ' y=' + y);
+
+b := true;
+c := not b;
+writeln('b=' + b + ' c=' + c);
+
+end.